@@ -0,0 +1,744 @@
+// Copyright James Puleo 2021
+// Copyright Soprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <LibSoprano/ChatArchive.h>
+#include <LibSoprano/ChatComponent.h>
+#include <LibSoprano/ChatTree.h>
+#include <LibSoprano/EntitySelector.h>
+#include <LibSoprano/EntitySnapshot.h>
+#include <LibSoprano/FanOutRenderer.h>
+#include <LibSoprano/AnsiRenderer.h>
+#include <LibSoprano/HtmlRenderer.h>
+#include <LibSoprano/JsonWriter.h>
+#include <LibSoprano/LanguageTable.h>
+#include <LibSoprano/LegacyRenderer.h>
+#include <LibSoprano/LegacyText.h>
+#include <LibSoprano/NbtWriter.h>
+#include <LibSoprano/RenderCache.h>
+#include <LibSoprano/Scoreboard.h>
+#include <LibSoprano/json.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace LibSoprano;
+
+static std::string s_chat_line = R"({"text":"<","extra":[{"text":"Notch","color":"gold","bold":true},)"
+                                 R"({"text":"> "},{"text":"Hello everyone, welcome to the server!","color":"#e0e0e0"}]})";
+
+static std::string make_wide_component(int children)
+{
+    std::string json = R"({"text":"Leaderboard: ","color":"yellow","extra":[)";
+    for(int i = 0; i < children; i++)
+    {
+        if(i != 0)
+            json += ',';
+        json += R"({"text":"Player)" + std::to_string(i) + R"( ","italic":true,"color":"aqua","extra":[{"text":")"
+             + std::to_string(i * 100) + R"(","underlined":true,"color":"#ff8800"}]})";
+    }
+    json += "]}";
+    return json;
+}
+
+// One character per child, each a little more red than the last.
+static std::string make_gradient_component(int children)
+{
+    std::string json = R"({"text":"","extra":[)";
+    for(int i = 0; i < children; i++)
+    {
+        if(i != 0)
+            json += ',';
+        json += fmt::format(R"({{"text":"#","color":"#{:02x}4080"}})", i * 255 / children);
+    }
+    json += "]}";
+    return json;
+}
+
+// Keeps the optimizer from throwing away the work we're measuring.
+static volatile std::size_t s_sink;
+
+template<typename Function>
+static void benchmark(const char* name, int iterations, Function function)
+{
+    // Warm up caches and allocators before timing anything.
+    for(int i = 0; i < iterations / 10; i++)
+        s_sink = s_sink + function();
+
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < iterations; i++)
+        s_sink = s_sink + function();
+    auto end = std::chrono::steady_clock::now();
+
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    printf("%-40s %12.1f ns/op\n", name, static_cast<double>(ns) / iterations);
+}
+
+static void benchmark_parse(const char* name, std::string& json, int iterations)
+{
+    printf("%s (%zu bytes)\n", name, json.size());
+
+    benchmark("  parse (json DOM)", iterations, [&json]()
+    {
+        auto dom = nlohmann::json::parse(json);
+        return ChatComponent::parse(dom).storage().get<ChatComponent>().children().size();
+    });
+
+    benchmark("  parse (SAX)", iterations, [&json]()
+    {
+        return ChatComponent::parse(json).storage().get<ChatComponent>().children().size();
+    });
+
+    benchmark("  parse (borrowed)", iterations, [&json]()
+    {
+        return ChatComponent::parse_borrowed(json).storage().get<ChatComponent>().children().size();
+    });
+
+    benchmark("  parse (flat tree)", iterations, [&json]()
+    {
+        return ChatTree::parse(json).storage().get<ChatTree>().size();
+    });
+
+    // A std::string's buffer is suitably aligned for a snapshot.
+    std::string snapshot;
+    StringSink sink(snapshot);
+    ChatTree::parse(json).unwrap().write_snapshot(sink);
+    benchmark("  view snapshot", iterations, [&snapshot]()
+    {
+        return ChatTree::view_snapshot(snapshot).storage().get<ChatTree>().size();
+    });
+}
+
+static void benchmark_render(const char* name, std::string& json, int iterations)
+{
+    printf("%s (%zu bytes)\n", name, json.size());
+
+    auto component = ChatComponent::parse(json).unwrap();
+    auto tree = ChatTree::parse(json).unwrap();
+    fmt::memory_buffer buffer;
+    BufferSink sink(buffer);
+    AnsiRenderer ansi;
+    HtmlRenderer html;
+    LegacyRenderer legacy;
+
+    benchmark("  to_ansi_string", iterations, [&component]()
+    {
+        return component.to_ansi_string().size();
+    });
+
+    benchmark("  ansi (reused buffer)", iterations, [&]()
+    {
+        buffer.clear();
+        ansi.render(component, sink);
+        return buffer.size();
+    });
+
+    benchmark("  ansi (flat tree, reused buffer)", iterations, [&]()
+    {
+        buffer.clear();
+        ansi.render(tree, sink);
+        return buffer.size();
+    });
+
+    benchmark("  to_html_string", iterations, [&component]()
+    {
+        return component.to_html_string().size();
+    });
+
+    benchmark("  html (reused buffer)", iterations, [&]()
+    {
+        buffer.clear();
+        html.render(component, sink);
+        return buffer.size();
+    });
+
+    benchmark("  html (flat tree, reused buffer)", iterations, [&]()
+    {
+        buffer.clear();
+        html.render(tree, sink);
+        return buffer.size();
+    });
+
+    benchmark("  legacy (reused buffer)", iterations, [&]()
+    {
+        buffer.clear();
+        legacy.render(component, sink);
+        return buffer.size();
+    });
+}
+
+static void benchmark_serialize(const char* name, std::string& json, int iterations)
+{
+    printf("%s (%zu bytes)\n", name, json.size());
+
+    auto dom = nlohmann::json::parse(json);
+    auto component = ChatComponent::parse(json).unwrap();
+    fmt::memory_buffer buffer;
+    BufferSink sink(buffer);
+    JsonWriter minified;
+    JsonWriter canonical(JsonWriter::Mode::Canonical);
+
+    benchmark("  dump (json DOM)", iterations, [&dom]()
+    {
+        return dom.dump().size();
+    });
+
+    benchmark("  to_json", iterations, [&component]()
+    {
+        return component.to_json().size();
+    });
+
+    benchmark("  json (minified, reused buffer)", iterations, [&]()
+    {
+        buffer.clear();
+        minified.render(component, sink);
+        return buffer.size();
+    });
+
+    benchmark("  json (canonical, reused buffer)", iterations, [&]()
+    {
+        buffer.clear();
+        canonical.render(component, sink);
+        return buffer.size();
+    });
+}
+
+static void benchmark_nbt(const char* name, std::string& json, int iterations)
+{
+    auto component = ChatComponent::parse(json).unwrap();
+    auto nbt = component.to_nbt();
+    printf("%s (%zu bytes, %zu as NBT)\n", name, json.size(), nbt.size());
+
+    fmt::memory_buffer buffer;
+    BufferSink sink(buffer);
+    NbtWriter writer;
+
+    benchmark("  try_parse (JSON, borrowed)", iterations, [&json]()
+    {
+        return ChatComponent::try_parse(json, true).storage().get<ChatComponent>().children().size();
+    });
+
+    benchmark("  try_parse_nbt (borrowed)", iterations, [&nbt]()
+    {
+        return ChatComponent::try_parse_nbt(nbt, true).storage().get<ChatComponent>().children().size();
+    });
+
+    benchmark("  ChatTree::try_parse_nbt", iterations, [&nbt]()
+    {
+        return ChatTree::try_parse_nbt(nbt).storage().get<ChatTree>().size();
+    });
+
+    benchmark("  nbt (reused buffer)", iterations, [&]()
+    {
+        buffer.clear();
+        writer.write(component, sink);
+        return buffer.size();
+    });
+}
+
+static void benchmark_legacy(const char* name, const std::string& text, int iterations)
+{
+    printf("%s (%zu bytes)\n", name, text.size());
+
+    std::string copy(text.size(), '\0');
+    benchmark("  memcpy", iterations, [&]()
+    {
+        memcpy(copy.data(), text.data(), text.size());
+        return copy.size();
+    });
+
+    benchmark("  find_section_sign", iterations, [&text]()
+    {
+        std::size_t count = 0;
+        for(auto at = LegacyText::find_section_sign(text); at != std::string_view::npos;
+            at = LegacyText::find_section_sign(text, at + 2))
+            count++;
+        return count;
+    });
+
+    benchmark("  try_parse_legacy (borrowed)", iterations, [&text]()
+    {
+        return ChatComponent::try_parse_legacy(text, true).storage().get<ChatComponent>().children().size();
+    });
+
+    benchmark("  try_parse_legacy", iterations, [&text]()
+    {
+        return ChatComponent::try_parse_legacy(text).storage().get<ChatComponent>().children().size();
+    });
+}
+
+static void benchmark_reject(const char* name, std::string json, int iterations)
+{
+    printf("%s (%zu bytes)\n", name, json.size());
+
+    benchmark("  reject (json DOM)", iterations, [&json]()
+    {
+        try
+        {
+            auto dom = nlohmann::json::parse(json);
+            return ChatComponent::parse(dom).storage().get<std::string>().size();
+        }
+        catch(const nlohmann::json::exception& e)
+        {
+            return strlen(e.what());
+        }
+    });
+
+    benchmark("  reject (error message)", iterations, [&json]()
+    {
+        return ChatComponent::parse_borrowed(json).storage().get<std::string>().size();
+    });
+
+    benchmark("  reject (try_parse)", iterations, [&json]()
+    {
+        return static_cast<std::size_t>(ChatComponent::try_parse(json, true).storage().get<ParseError>().offset());
+    });
+
+    benchmark("  accept (try_parse)", iterations, []()
+    {
+        return ChatComponent::try_parse(s_chat_line, true).storage().get<ChatComponent>().children().size();
+    });
+}
+
+static void benchmark_color_depths(const char* name, std::string& json, int iterations)
+{
+    printf("%s (%zu bytes)\n", name, json.size());
+
+    auto component = ChatComponent::parse(json).unwrap();
+    fmt::memory_buffer buffer;
+    BufferSink sink(buffer);
+
+    auto benchmark_depth = [&](const char* depth_name, AnsiRenderer::ColorDepth depth)
+    {
+        AnsiRenderer ansi(false, depth);
+        benchmark(depth_name, iterations, [&]()
+        {
+            buffer.clear();
+            ansi.render(component, sink);
+            return buffer.size();
+        });
+    };
+
+    benchmark_depth("  ansi (truecolor)", AnsiRenderer::ColorDepth::TrueColor);
+    benchmark_depth("  ansi (256 colors)", AnsiRenderer::ColorDepth::Palette256);
+    benchmark_depth("  ansi (16 colors)", AnsiRenderer::ColorDepth::Palette16);
+}
+
+static void benchmark_cache(const char* name, std::string& json, int iterations)
+{
+    printf("%s (%zu bytes)\n", name, json.size());
+
+    fmt::memory_buffer buffer;
+    BufferSink sink(buffer);
+    AnsiRenderer ansi;
+    RenderCache cache(1024 * 1024);
+
+    benchmark("  parse and render", iterations, [&]()
+    {
+        buffer.clear();
+        ansi.render(ChatComponent::try_parse(json, true).storage().get<ChatComponent>(), sink);
+        return buffer.size();
+    });
+
+    ansi.render(ChatComponent::try_parse(json, true).storage().get<ChatComponent>(), sink);
+    cache.insert(json, 0, 0, std::string_view(buffer.data(), buffer.size()));
+    benchmark("  cache hit", iterations, [&]()
+    {
+        buffer.clear();
+        sink.write(*cache.find(json, 0, 0));
+        return buffer.size();
+    });
+
+    benchmark("  cache miss", iterations, [&]()
+    {
+        return cache.find(json, 1, 0).has_value() ? 1 : 0;
+    });
+}
+
+// A day of chat: a few hundred players, saying the same sort of things.
+static void benchmark_translate(const char* name, int keys, int iterations)
+{
+    // A language file about the size of en_us.json, with the chat formats in it.
+    auto path = std::filesystem::temp_directory_path() / "soprano-benchmark-lang.json";
+    {
+        nlohmann::json language;
+        for(int i = 0; i < keys; i++)
+            language["block.minecraft.block_" + std::to_string(i)] = "Block number " + std::to_string(i);
+        language["chat.type.text"] = "<%s> %s";
+        language["multiplayer.player.joined"] = "%s joined the game";
+        auto bytes = language.dump();
+        auto file = fopen(path.string().c_str(), "wb");
+        fwrite(bytes.data(), 1, bytes.size(), file);
+        fclose(file);
+    }
+
+    printf("%s (%d keys)\n", name, keys);
+
+    benchmark("  open", iterations / 1000 + 1, [&path]()
+    {
+        return LanguageTable::open(path.string()).storage().get<LanguageTable>().size();
+    });
+
+    auto opened = LanguageTable::open(path.string());
+    auto language = std::move(opened.storage().get<LanguageTable>());
+    std::filesystem::remove(path);
+
+    std::size_t index = 0;
+    benchmark("  find", iterations, [&]()
+    {
+        index = (index + 7919) % keys;
+        auto key = "block.minecraft.block_" + std::to_string(index);
+        return static_cast<std::size_t>(language.find(key)->segment_count);
+    });
+
+    std::string json = R"({"translate":"chat.type.text","with":[{"text":"Notch","color":"gold"},"Hello everyone!"]})";
+    auto component = ChatComponent::parse(json).unwrap();
+    fmt::memory_buffer buffer;
+    BufferSink sink(buffer);
+    AnsiRenderer ansi;
+    ansi.set_language(&language);
+    benchmark("  ansi chat line (reused buffer)", iterations, [&]()
+    {
+        buffer.clear();
+        ansi.render(component, sink);
+        return buffer.size();
+    });
+}
+
+static void benchmark_fan_out(const char* name, const std::string& wide, int languages, int iterations)
+{
+    // Languages that only differ in how they say someone joined.
+    std::vector<LanguageTable> tables;
+    for(int i = 0; i < languages; i++)
+    {
+        auto path = std::filesystem::temp_directory_path() / ("soprano-benchmark-lang-" + std::to_string(i) + ".json");
+        nlohmann::json language;
+        language["chat.type.announcement"] = "[%s] %s";
+        language["multiplayer.player.joined"] = "%s joined the game (" + std::to_string(i) + ")";
+        auto bytes = language.dump();
+        auto file = fopen(path.string().c_str(), "wb");
+        fwrite(bytes.data(), 1, bytes.size(), file);
+        fclose(file);
+        auto opened = LanguageTable::open(path.string());
+        tables.push_back(std::move(opened.storage().get<LanguageTable>()));
+        std::filesystem::remove(path);
+    }
+
+    std::string json = R"({"text":"","extra":[{"translate":"multiplayer.player.joined","with":[{"text":"Notch","color":"gold"}]},)"
+                       R"({"translate":"chat.type.announcement","with":["Server",)" + wide + "]}]}";
+    auto component = ChatComponent::parse(json).unwrap();
+
+    printf("%s (%d languages, %zu bytes)\n", name, languages, json.size());
+
+    std::vector<const LanguageTable*> pointers;
+    std::vector<std::string> outputs(languages);
+    std::vector<StringSink> sinks;
+    std::vector<Sink*> sink_pointers;
+    sinks.reserve(languages);
+    for(int i = 0; i < languages; i++)
+    {
+        pointers.push_back(&tables[i]);
+        sink_pointers.push_back(&sinks.emplace_back(outputs[i]));
+    }
+
+    AnsiRenderer ansi;
+    benchmark("  ansi, one language at a time", iterations, [&]()
+    {
+        std::size_t size = 0;
+        for(int i = 0; i < languages; i++)
+        {
+            outputs[i].clear();
+            ansi.set_language(pointers[i]);
+            ansi.render(component, *sink_pointers[i]);
+            size += outputs[i].size();
+        }
+        return size;
+    });
+
+    FanOutRenderer<AnsiRenderer> fan_out;
+    benchmark("  ansi, fanned out", iterations, [&]()
+    {
+        for(auto& output : outputs)
+            output.clear();
+        fan_out.render(component, pointers, sink_pointers);
+        return outputs[0].size();
+    });
+}
+
+static void benchmark_scores(const char* name, int holders, int shown, int iterations)
+{
+    // A server's worth of scores, and a sidebar showing some of them.
+    const char* objectives[] = {"kills", "deaths", "level", "coins"};
+    Scoreboard scoreboard;
+    std::unordered_map<std::string, int32_t> by_key;
+    for(int i = 0; i < holders; i++)
+    {
+        auto holder = "Player" + std::to_string(i);
+        for(int j = 0; j < 4; j++)
+        {
+            scoreboard.set(holder, objectives[j], i * 4 + j);
+            by_key[holder + '\0' + objectives[j]] = i * 4 + j;
+        }
+    }
+
+    std::string json = R"({"text":"","extra":[)";
+    for(int i = 0; i < shown; i++)
+    {
+        if(i != 0)
+            json += ',';
+        json += R"({"text":"Player)" + std::to_string(i * 97 % holders) + R"(: "},{"score":{"name":"Player)"
+             + std::to_string(i * 97 % holders) + R"(","objective":")" + objectives[i % 4] + R"("},"color":"red"})";
+    }
+    json += "]}";
+    auto component = ChatComponent::parse(json).unwrap();
+
+    printf("%s (%zu scores, %d shown)\n", name, scoreboard.size(), shown);
+
+    benchmark("  resolve", iterations, [&]()
+    {
+        return scoreboard.resolve(component);
+    });
+
+    // The same lookups, a component at a time, in a map of strings.
+    std::string key;
+    benchmark("  std::unordered_map, one at a time", iterations, [&]()
+    {
+        std::size_t found = 0;
+        for(auto& child : component.children())
+        {
+            auto score = child.score();
+            if(!score)
+                continue;
+            key.assign(score->name.view());
+            key += '\0';
+            key.append(score->objective.view());
+            found += by_key.count(key);
+        }
+        return found;
+    });
+}
+
+static void benchmark_selectors(const char* name, int players, int mobs, int iterations)
+{
+    // A busy server, with its players and mobs over a couple of thousand blocks.
+    const char* types[] = {"zombie", "skeleton", "cow", "minecraft:creeper"};
+    const char* teams[] = {"red", "blue", ""};
+    std::vector<EntitySnapshot::Entity> entities;
+    for(int i = 0; i < players + mobs; i++)
+    {
+        auto& entity = entities.emplace_back();
+        bool player = i < players;
+        entity.name = (player ? "Player" : "Mob") + std::to_string(i);
+        entity.type = player ? "player" : types[i % 4];
+        entity.team = player ? teams[i % 3] : "";
+        if(i % 500 == 0)
+            entity.tags.push_back("boss");
+        entity.x = (i * 7919 % 2000) - 1000.0;
+        entity.y = 64 + i % 40;
+        entity.z = (i * 104729 % 2000) - 1000.0;
+    }
+    EntitySnapshot snapshot(entities);
+    SelectorOrigin origin{10, 70, -20, std::nullopt, 1};
+
+    printf("%s (%zu entities, %d players)\n", name, snapshot.size(), players);
+
+    const char* selectors[] = {"@p", "@a[team=red]", "@e[distance=..48]", "@e[type=zombie,distance=..64,limit=5]",
+                               "@e[tag=boss]", "@r[limit=3]", "Player42"};
+    std::vector<uint32_t> selected;
+    for(auto source : selectors)
+    {
+        auto selector = EntitySelector::compile(source).unwrap();
+        auto label = fmt::format("  {}", source);
+        benchmark(label.c_str(), iterations, [&]()
+        {
+            selector.select(snapshot, origin, selected);
+            return selected.size();
+        });
+    }
+
+    // A message mentioning a few of them, resolved from scratch each time.
+    std::string json = R"({"text":"","extra":[{"selector":"@p","color":"gold"},{"text":" is near "},)"
+                       R"({"selector":"@e[type=zombie,distance=..64,sort=nearest,limit=5]"}]})";
+    auto message = ChatComponent::parse(json).unwrap();
+    SelectorCache cache;
+    benchmark("  resolve", iterations, [&]()
+    {
+        auto component = message;
+        return snapshot.resolve(component, origin, cache);
+    });
+}
+
+static std::string make_chat_log(int lines)
+{
+    static const char* colors[] = {"gold", "aqua", "green", "#ff8800", "light_purple", "gray"};
+    static const char* messages[] = {"hello", "gg", "anyone want to trade diamonds?", "lol",
+                                     "where is spawn", "brb", "thanks for the help!", "nice build"};
+
+    std::string ndjson;
+    for(int i = 0; i < lines; i++)
+    {
+        auto player = (i * 7919) % 300;
+        if(i % 50 == 0)
+        {
+            ndjson += fmt::format(R"({{"text":"Player{} joined the game","color":"yellow"}})", player);
+        }
+        else
+        {
+            ndjson += fmt::format(R"({{"text":"<","extra":[{{"text":"Player{}","color":"{}","bold":{}}},)"
+                                  R"({{"text":"> "}},{{"text":"{} #{}"}}]}})",
+                                  player, colors[player % 6], player % 4 == 0 ? "true" : "false",
+                                  messages[(i * 31) % 8], i % 1000);
+        }
+        ndjson += '\n';
+    }
+    return ndjson;
+}
+
+// Visits every run of text, which is about as little as a scan can do.
+struct TextLength
+{
+    std::size_t length = 0;
+
+    bool enter(const RenderNode& node)
+    {
+        length += node.text.size();
+        return true;
+    }
+    void leave(const RenderNode&) {}
+};
+
+static void benchmark_archive(const char* name, int lines, int iterations)
+{
+    auto ndjson = make_chat_log(lines);
+    std::string bytes;
+    {
+        StringSink sink(bytes);
+        ChatArchiveWriter writer(sink);
+        std::size_t start = 0;
+        for(int i = 0; i < lines; i++)
+        {
+            auto end = ndjson.find('\n', start);
+            writer.append(ChatTree::parse(std::string_view(ndjson).substr(start, end - start)).unwrap(), i);
+            start = end + 1;
+        }
+    }
+    auto archive = ChatArchive::view(bytes).unwrap();
+
+    printf("%s (%d messages, %zu bytes of NDJSON, %zu bytes archived)\n", name, lines, ndjson.size(), bytes.size());
+
+    benchmark("  scan (NDJSON)", iterations, [&ndjson]()
+    {
+        TextLength visitor;
+        std::string_view rest = ndjson;
+        while(!rest.empty())
+        {
+            auto end = rest.find('\n');
+            ChatTree::try_parse(rest.substr(0, end)).storage().get<ChatTree>().walk(visitor);
+            rest.remove_prefix(end + 1);
+        }
+        return visitor.length;
+    });
+
+    benchmark("  scan (archive)", iterations, [&archive]()
+    {
+        TextLength visitor;
+        archive.for_each([&visitor](const ArchivedMessage& message)
+        {
+            message.walk(visitor);
+        });
+        return visitor.length;
+    });
+
+    benchmark("  view archive", iterations, [&bytes]()
+    {
+        return ChatArchive::view(bytes).storage().get<ChatArchive>().size();
+    });
+
+    fmt::memory_buffer buffer;
+    BufferSink sink(buffer);
+    AnsiRenderer ansi;
+    benchmark("  ansi (NDJSON, reused buffer)", iterations, [&]()
+    {
+        buffer.clear();
+        std::string_view rest = ndjson;
+        while(!rest.empty())
+        {
+            auto end = rest.find('\n');
+            ansi.render(ChatTree::try_parse(rest.substr(0, end)).storage().get<ChatTree>(), sink);
+            rest.remove_prefix(end + 1);
+        }
+        return buffer.size();
+    });
+
+    benchmark("  ansi (archive, reused buffer)", iterations, [&]()
+    {
+        buffer.clear();
+        archive.for_each([&](const ArchivedMessage& message)
+        {
+            ansi.render(message, sink);
+        });
+        return buffer.size();
+    });
+
+    std::size_t index = 0;
+    benchmark("  random message, ansi", iterations * lines / 10, [&]()
+    {
+        buffer.clear();
+        index = (index + 7919) % archive.size();
+        ansi.render(archive.message(index), sink);
+        return buffer.size();
+    });
+}
+
+int main()
+{
+    printf("sizeof(ChatComponent) = %zu\n", sizeof(ChatComponent));
+    printf("sizeof(ChatTree::Node) = %zu\n", sizeof(ChatTree::Node));
+    printf("sizeof(Color) = %zu\n\n", sizeof(Color));
+
+    auto wide = make_wide_component(64);
+    auto gradient = make_gradient_component(200);
+
+    benchmark_parse("Chat line", s_chat_line, 200000);
+    benchmark_parse("Wide component", wide, 5000);
+    benchmark_render("Chat line", s_chat_line, 200000);
+    benchmark_render("Wide component", wide, 5000);
+    benchmark_serialize("Chat line", s_chat_line, 200000);
+    benchmark_serialize("Wide component", wide, 5000);
+    benchmark_nbt("Chat line", s_chat_line, 200000);
+    benchmark_nbt("Wide component", wide, 5000);
+    benchmark_legacy("Legacy chat line", "§7[§6Notch§7] §fHello everyone, welcome to the §lserver§r!", 200000);
+    std::string plain_line;
+    while(plain_line.size() < 4096)
+        plain_line += "The quick brown fox jumps over the lazy dog. ";
+    benchmark_legacy("Legacy plain text", plain_line, 200000);
+    benchmark_color_depths("Gradient", gradient, 20000);
+    benchmark_cache("Chat line", s_chat_line, 200000);
+    benchmark_cache("Wide component", wide, 5000);
+    benchmark_archive("Chat log", 200000, 10);
+    benchmark_translate("Language file", 6000, 200000);
+    benchmark_fan_out("Wide announcement", wide, 12, 5000);
+    benchmark_scores("Sidebar", 100000, 200, 20000);
+    benchmark_selectors("Entities", 1000, 9000, 20000);
+    // The chat line cut off half way, and with a bad color at the end.
+    benchmark_reject("Truncated", s_chat_line.substr(0, s_chat_line.size() / 2), 200000);
+    benchmark_reject("Bad color", s_chat_line.substr(0, s_chat_line.size() - 3) + R"(,"color":"#zz"}]})", 200000);
+
+    return 0;
+}
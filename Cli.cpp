@@ -0,0 +1,653 @@
+// Copyright James Puleo 2021
+// Copyright Soprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <LibSoprano/BatchConverter.h>
+#include <LibSoprano/ChatArchive.h>
+#include <LibSoprano/ChatComponent.h>
+#include <LibSoprano/ChatTree.h>
+#include <LibSoprano/FanOutRenderer.h>
+#include <LibSoprano/HtmlRenderer.h>
+#include <LibSoprano/JsonWriter.h>
+#include <LibSoprano/LanguageTable.h>
+#include <LibSoprano/LegacyRenderer.h>
+#include <LibSoprano/MappedFile.h>
+#include <LibSoprano/Scoreboard.h>
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+#include <cxxopts.hpp>
+
+#ifdef SOPRANO_SERVER
+#include "Server.h"
+#endif
+
+// Converts every file (or stdin, for "-") as newline-delimited components.
+static int convert_batch(const std::vector<std::string>& files, const LibSoprano::BatchConverter::Options& options)
+{
+    LibSoprano::BatchConverter converter(options);
+    LibSoprano::FileSink output(stdout);
+    LibSoprano::FileSink errors(stderr);
+    bool had_errors = false;
+    bool io_failed = false;
+
+    for(auto& file : files)
+    {
+        auto is_stdin = file == "-";
+        auto input = is_stdin ? stdin : fopen(file.c_str(), "rb");
+        if(!input)
+        {
+            fprintf(stderr, "Couldn't open %s\n", file.c_str());
+            io_failed = true;
+            continue;
+        }
+
+        auto stats = converter.convert(input, is_stdin ? "<stdin>" : file, output, errors);
+        had_errors |= stats.errors > 0;
+
+        if(!is_stdin)
+            fclose(input);
+    }
+
+    if(fflush(stdout) != 0 || output.failed() || io_failed)
+        return 3;
+    return had_errors ? 2 : 0;
+}
+
+// Appends newline-delimited components from every file (or stdin, for "-")
+// to an archive. A line may start with its timestamp, in milliseconds since
+// the epoch, and a space; otherwise it's archived as of now.
+static int append_archive(const std::string& path, const std::vector<std::string>& files)
+{
+    // Blocks written after an unfinished one could never be read.
+    if(auto existing = LibSoprano::MappedFile::open(path); existing.isOk())
+    {
+        auto archive = LibSoprano::ChatArchive::view(existing.storage().get<LibSoprano::MappedFile>().data());
+        if(archive.isErr())
+        {
+            fprintf(stderr, "%s: %s\n", path.c_str(), archive.storage().get<std::string>().c_str());
+            return 3;
+        }
+        if(archive.storage().get<LibSoprano::ChatArchive>().unfinished_bytes())
+        {
+            fprintf(stderr, "%s ends with an unfinished block, which has to be cut off before appending\n", path.c_str());
+            return 3;
+        }
+    }
+
+    auto output = fopen(path.c_str(), "ab");
+    if(!output)
+    {
+        fprintf(stderr, "Couldn't open %s\n", path.c_str());
+        return 3;
+    }
+
+    LibSoprano::FileSink sink(output);
+    LibSoprano::ChatArchiveWriter writer(sink);
+    bool had_errors = false;
+    bool io_failed = false;
+
+    for(auto& file : files)
+    {
+        auto is_stdin = file == "-";
+        auto input = is_stdin ? stdin : fopen(file.c_str(), "rb");
+        if(!input)
+        {
+            fprintf(stderr, "Couldn't open %s\n", file.c_str());
+            io_failed = true;
+            continue;
+        }
+
+        auto name = is_stdin ? "<stdin>" : file.c_str();
+        std::string line;
+        std::size_t line_number = 0;
+        char buffer[64 * 1024];
+        bool more = true;
+        while(more)
+        {
+            line.clear();
+            while((more = fgets(buffer, sizeof(buffer), input) != nullptr))
+            {
+                line.append(buffer);
+                if(!line.empty() && line.back() == '\n')
+                    break;
+            }
+            if(!more && line.empty())
+                break;
+
+            line_number++;
+            std::string_view json = line;
+            while(!json.empty() && (json.back() == '\n' || json.back() == '\r'))
+                json.remove_suffix(1);
+            if(json.find_first_not_of(" \t") == std::string_view::npos)
+                continue;
+
+            auto now = std::chrono::system_clock::now().time_since_epoch();
+            int64_t timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(now).count();
+            // No component starts with a digit, so there's nothing ambiguous about this.
+            if(json.front() >= '0' && json.front() <= '9')
+            {
+                auto [end, error] = std::from_chars(json.data(), json.data() + json.size(), timestamp);
+                if(error == std::errc() && end != json.data() + json.size() && (*end == ' ' || *end == '\t'))
+                    json.remove_prefix(end - json.data() + 1);
+            }
+
+            auto tree = LibSoprano::ChatTree::try_parse(json);
+            if(tree.isErr())
+            {
+                auto message = tree.storage().get<LibSoprano::ParseError>().message(json);
+                fprintf(stderr, "%s:%zu: %s\n", name, line_number, message.c_str());
+                had_errors = true;
+                continue;
+            }
+
+            if(!writer.append(tree.storage().get<LibSoprano::ChatTree>(), timestamp))
+            {
+                fprintf(stderr, "%s:%zu: Couldn't archive the component\n", name, line_number);
+                had_errors = true;
+            }
+        }
+
+        io_failed |= ferror(input) != 0;
+        if(!is_stdin)
+            fclose(input);
+    }
+
+    auto written = writer.flush();
+    if(fclose(output) != 0 || !written || io_failed)
+    {
+        fprintf(stderr, "Couldn't write %s\n", path.c_str());
+        return 3;
+    }
+    return had_errors ? 2 : 0;
+}
+
+using Format = LibSoprano::BatchConverter::Format;
+
+// Renders a component, tree or archived message in any of the output formats,
+// resolving translations with language if there is one.
+template<typename Component>
+static void convert(const Component& component, LibSoprano::Sink& output, Format format,
+                    LibSoprano::AnsiRenderer::ColorDepth depth, const LibSoprano::LanguageTable* language = nullptr)
+{
+    if(format == Format::Html)
+    {
+        LibSoprano::HtmlRenderer renderer;
+        renderer.set_language(language);
+        renderer.render(component, output);
+    }
+    else if(format == Format::Json || format == Format::CanonicalJson)
+    {
+        LibSoprano::JsonWriter(format == Format::Json ? LibSoprano::JsonWriter::Mode::Minified
+                                                      : LibSoprano::JsonWriter::Mode::Canonical).render(component, output);
+    }
+    else if(format == Format::Legacy || format == Format::LegacyNamedColors)
+    {
+        LibSoprano::LegacyRenderer renderer(format == Format::Legacy ? LibSoprano::LegacyRenderer::HexColors::Sequence
+                                                                     : LibSoprano::LegacyRenderer::HexColors::Nearest);
+        renderer.set_language(language);
+        renderer.render(component, output);
+    }
+    else
+    {
+        LibSoprano::AnsiRenderer renderer(format == Format::EscapedAnsi, depth);
+        renderer.set_language(language);
+        renderer.render(component, output);
+    }
+}
+
+// Converts a component in more than one language at once, a line each.
+static void convert_languages(const LibSoprano::ChatComponent& component, LibSoprano::Sink& output, Format format,
+                              LibSoprano::AnsiRenderer::ColorDepth depth, const std::vector<LibSoprano::LanguageTable>& languages)
+{
+    std::vector<const LibSoprano::LanguageTable*> tables;
+    std::vector<std::string> lines(languages.size());
+    std::vector<LibSoprano::StringSink> sinks;
+    std::vector<LibSoprano::Sink*> line_sinks;
+    sinks.reserve(languages.size());
+    for(std::size_t i = 0; i < languages.size(); i++)
+    {
+        tables.push_back(&languages[i]);
+        line_sinks.push_back(&sinks.emplace_back(lines[i]));
+    }
+
+    if(format == Format::Html)
+    {
+        LibSoprano::FanOutRenderer<LibSoprano::HtmlRenderer>().render(component, tables, line_sinks);
+    }
+    else if(format == Format::Json || format == Format::CanonicalJson)
+    {
+        // JSON keeps translations as they are, so it's the same in every language.
+        for(auto sink : line_sinks)
+            convert(component, *sink, format, depth);
+    }
+    else if(format == Format::Legacy || format == Format::LegacyNamedColors)
+    {
+        LibSoprano::FanOutRenderer<LibSoprano::LegacyRenderer> renderer(
+            LibSoprano::LegacyRenderer(format == Format::Legacy ? LibSoprano::LegacyRenderer::HexColors::Sequence
+                                                                : LibSoprano::LegacyRenderer::HexColors::Nearest));
+        renderer.render(component, tables, line_sinks);
+    }
+    else
+    {
+        LibSoprano::FanOutRenderer<LibSoprano::AnsiRenderer> renderer(LibSoprano::AnsiRenderer(format == Format::EscapedAnsi, depth));
+        renderer.render(component, tables, line_sinks);
+    }
+
+    for(auto& line : lines)
+    {
+        output.write(line);
+        output.write('\n');
+    }
+}
+
+// Reads scores from a file of lines like "Steve kills 12": a holder, an
+// objective and a score, separated by spaces.
+static bool load_scores(const std::string& path, LibSoprano::Scoreboard& scoreboard)
+{
+    auto file = LibSoprano::MappedFile::open(path);
+    if(file.isErr())
+    {
+        fprintf(stderr, "%s\n", file.storage().get<std::string>().c_str());
+        return false;
+    }
+
+    auto data = file.storage().get<LibSoprano::MappedFile>().data();
+    std::string_view rest(reinterpret_cast<const char*>(data.data()), data.size());
+    std::size_t line_number = 0;
+    while(!rest.empty())
+    {
+        auto line = rest.substr(0, rest.find('\n'));
+        rest.remove_prefix(std::min(rest.size(), line.size() + 1));
+        line_number++;
+
+        std::string_view fields[3];
+        std::size_t field_count = 0;
+        while(field_count < 4)
+        {
+            auto start = line.find_first_not_of(" \t\r");
+            if(start == std::string_view::npos)
+                break;
+            line.remove_prefix(start);
+            auto field = line.substr(0, line.find_first_of(" \t\r"));
+            line.remove_prefix(field.size());
+            if(field_count < 3)
+                fields[field_count] = field;
+            field_count++;
+        }
+        if(field_count == 0)
+            continue;
+
+        int32_t score = 0;
+        auto& number = fields[2];
+        auto parsed = field_count == 3 ? std::from_chars(number.data(), number.data() + number.size(), score)
+                                       : std::from_chars_result{nullptr, std::errc::invalid_argument};
+        if(parsed.ec != std::errc() || parsed.ptr != number.data() + number.size()
+           || !scoreboard.set(fields[0], fields[1], score))
+        {
+            fprintf(stderr, "%s:%zu: Expected a holder, an objective and a score\n", path.c_str(), line_number);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Converts every message in an archive, or just one, a line each.
+static int convert_archive(const std::string& path, std::optional<std::size_t> index, Format format,
+                           LibSoprano::AnsiRenderer::ColorDepth depth)
+{
+    auto file = LibSoprano::MappedFile::open(path);
+    if(file.isErr())
+    {
+        fprintf(stderr, "%s\n", file.storage().get<std::string>().c_str());
+        return 3;
+    }
+
+    // Messages are rendered straight from the mapped file.
+    auto result = LibSoprano::ChatArchive::view(file.storage().get<LibSoprano::MappedFile>().data());
+    if(result.isErr())
+    {
+        fprintf(stderr, "%s: %s\n", path.c_str(), result.storage().get<std::string>().c_str());
+        return 2;
+    }
+
+    auto& archive = result.storage().get<LibSoprano::ChatArchive>();
+    if(archive.unfinished_bytes())
+        fprintf(stderr, "%s: Left out an unfinished block of %zu bytes at the end\n", path.c_str(), archive.unfinished_bytes());
+    if(index && *index >= archive.size())
+    {
+        fprintf(stderr, "%s only has %zu messages\n", path.c_str(), archive.size());
+        return 1;
+    }
+
+    LibSoprano::FileSink output(stdout);
+    auto convert_message = [&](const LibSoprano::ArchivedMessage& message)
+    {
+        convert(message, output, format, depth);
+        output.write('\n');
+    };
+
+    if(index)
+        convert_message(archive.message(*index));
+    else
+        archive.for_each(convert_message);
+
+    if(fflush(stdout) != 0 || output.failed())
+        return 3;
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    cxxopts::Options options(*argv, "Convert Minecraft chat components to ANSI or HTML");
+    options.add_options()
+            ("a,ansi",      "Output with ANSI sequences (the default)")
+            ("archive",     "Append newline-delimited chat components from files (or stdin) to an archive", cxxopts::value<std::string>())
+            ("b,batch",     "Convert newline-delimited chat components from files (or stdin)")
+            ("cache-size",  "How many megabytes of rendered output to keep for repeated components in batch or server mode (0 for none)", cxxopts::value<std::size_t>()->default_value("64"))
+            ("c,colors",    "The colors available for ANSI output: truecolor, 256 or 16", cxxopts::value<std::string>()->default_value("truecolor"))
+            ("e,escansi",   "Output with ANSI escape sequences (C++)")
+            ("h,html",      "Output as HTML")
+            ("json",        "Output the component back out as minified JSON")
+            ("canonical",   "Output the component as canonical JSON, which is the same for components that only differ in what they inherit")
+            ("legacy-out",  "Output as legacy text with § codes")
+            ("named-colors", "With --legacy-out, write hex colors as the nearest named color, for clients older than 1.16")
+            ("help",        "Shows help and exits")
+            ("i,input",     "The JSON chat component", cxxopts::value<std::string>())
+            ("load-archive", "Convert every message in an archive, a line each", cxxopts::value<std::string>())
+            ("message",     "Only convert the message at this index with --load-archive", cxxopts::value<std::size_t>())
+            ("load-nbt",    "Convert a component saved as network NBT, rather than JSON", cxxopts::value<std::string>())
+            ("nbt",         "Save the chat component as network NBT, rather than converting it", cxxopts::value<std::string>())
+            ("load-snapshot", "Convert a binary snapshot saved with --snapshot, rather than JSON", cxxopts::value<std::string>())
+            ("snapshot",    "Save the chat component to a binary snapshot file, rather than converting it", cxxopts::value<std::string>())
+            ("l,legacy",    "Read legacy text formatted with § codes, rather than JSON")
+            ("lang",        "A language file (like en_us.json) to resolve translations with; given more than once, the component is converted in each, a line each", cxxopts::value<std::vector<std::string>>())
+            ("scores",      "A file of scores to show score components with, a line each like \"Steve kills 12\"", cxxopts::value<std::string>())
+            ("j,jobs",      "How many threads to convert with in batch mode (0 for one per core)", cxxopts::value<unsigned>()->default_value("0"))
+            ("files",       "More files to convert in batch mode, - being stdin", cxxopts::value<std::vector<std::string>>());
+#ifdef SOPRANO_DISK_CACHE
+    options.add_options()
+            ("compact-cache",   "Shrink the disk cache down to its most recently used output, and exit")
+            ("disk-cache",      "A file to keep rendered output in between batch runs", cxxopts::value<std::string>())
+            ("disk-cache-size", "How many megabytes the disk cache holds, set when it's created or compacted", cxxopts::value<std::size_t>()->default_value("1024"));
+#endif
+#ifdef SOPRANO_SERVER
+    options.add_options()
+            ("client",      "Send requests from stdin to the server at a socket, and output the responses", cxxopts::value<std::string>())
+            ("serve",       "Serve render requests on a Unix socket until interrupted", cxxopts::value<std::string>());
+#endif
+
+    options.positional_help("[chat component | files...]").show_positional_help();
+
+    options.parse_positional({"input", "files"});
+    try
+    {
+        auto res = options.parse(argc, argv);
+        if(res.count("help"))
+        {
+            printf("%s\n", options.help().c_str());
+            return 0;
+        }
+
+        auto color_depth = LibSoprano::AnsiRenderer::ColorDepth::TrueColor;
+        auto colors = res["colors"].as<std::string>();
+        if(colors == "256")
+            color_depth = LibSoprano::AnsiRenderer::ColorDepth::Palette256;
+        else if(colors == "16")
+            color_depth = LibSoprano::AnsiRenderer::ColorDepth::Palette16;
+        else if(colors != "truecolor")
+        {
+            fprintf(stderr, "Unknown color depth \"%s\"\n", colors.c_str());
+            return 1;
+        }
+
+        auto legacy = res.count("legacy") > 0;
+        auto format = Format::Ansi;
+        if(res.count("html"))
+            format = Format::Html;
+        else if(res.count("json"))
+            format = Format::Json;
+        else if(res.count("canonical"))
+            format = Format::CanonicalJson;
+        else if(res.count("legacy-out"))
+            format = res.count("named-colors") ? Format::LegacyNamedColors : Format::Legacy;
+        else if(res.count("escansi"))
+            format = Format::EscapedAnsi;
+
+        std::vector<LibSoprano::LanguageTable> languages;
+        if(res.count("lang"))
+        {
+            for(auto& path : res["lang"].as<std::vector<std::string>>())
+            {
+                auto result = LibSoprano::LanguageTable::open(path);
+                if(result.isErr())
+                {
+                    fprintf(stderr, "%s\n", result.storage().get<std::string>().c_str());
+                    return 3;
+                }
+                languages.push_back(std::move(result.storage().get<LibSoprano::LanguageTable>()));
+            }
+        }
+        auto language = languages.empty() ? nullptr : &languages.front();
+
+#ifdef SOPRANO_DISK_CACHE
+        std::unique_ptr<LibSoprano::DiskCache> disk_cache;
+        if(res.count("disk-cache"))
+        {
+            auto& path = res["disk-cache"].as<std::string>();
+            auto disk_cache_bytes = res["disk-cache-size"].as<std::size_t>() * 1024 * 1024;
+            if(res.count("compact-cache"))
+            {
+                auto result = LibSoprano::DiskCache::compact(path, disk_cache_bytes);
+                if(result.isErr())
+                {
+                    fprintf(stderr, "%s\n", result.storage().get<std::string>().c_str());
+                    return 3;
+                }
+
+                auto& stats = result.storage().get<LibSoprano::DiskCache::Stats>();
+                printf("Kept %zu entries, %zu of %zu bytes\n", stats.entries, stats.used_bytes, stats.capacity);
+                return 0;
+            }
+
+            auto result = LibSoprano::DiskCache::open(path, disk_cache_bytes);
+            if(result.isErr())
+            {
+                fprintf(stderr, "%s\n", result.storage().get<std::string>().c_str());
+                return 3;
+            }
+            disk_cache = std::move(result.storage().get<std::unique_ptr<LibSoprano::DiskCache>>());
+        }
+        else if(res.count("compact-cache"))
+        {
+            fprintf(stderr, "--compact-cache needs a --disk-cache to compact\n");
+            return 1;
+        }
+#endif
+
+#ifdef SOPRANO_SERVER
+        if(res.count("serve"))
+        {
+            RenderServer server(res["cache-size"].as<std::size_t>() * 1024 * 1024);
+            if(!server.listen(res["serve"].as<std::string>()))
+                return 3;
+            server.run();
+            return 0;
+        }
+
+        if(res.count("client"))
+            return run_client(res["client"].as<std::string>());
+#endif
+
+        if(res.count("load-archive"))
+        {
+            std::optional<std::size_t> index;
+            if(res.count("message"))
+                index = res["message"].as<std::size_t>();
+            return convert_archive(res["load-archive"].as<std::string>(), index, format, color_depth);
+        }
+
+        if(res.count("batch") || res.count("archive"))
+        {
+            // Every positional argument is a file to convert.
+            std::vector<std::string> files;
+            if(res.count("input"))
+                files.push_back(res["input"].as<std::string>());
+            if(res.count("files"))
+            {
+                auto& more_files = res["files"].as<std::vector<std::string>>();
+                files.insert(files.end(), more_files.begin(), more_files.end());
+            }
+            if(files.empty())
+                files.push_back("-");
+
+            if(res.count("archive"))
+                return append_archive(res["archive"].as<std::string>(), files);
+
+            LibSoprano::BatchConverter::Options batch_options;
+            batch_options.color_depth = color_depth;
+            batch_options.threads = res["jobs"].as<unsigned>();
+            batch_options.cache_bytes = res["cache-size"].as<std::size_t>() * 1024 * 1024;
+#ifdef SOPRANO_DISK_CACHE
+            batch_options.disk_cache = disk_cache.get();
+#endif
+            batch_options.format = format;
+            batch_options.legacy_input = legacy;
+            if(languages.size() > 1)
+            {
+                fprintf(stderr, "Batch mode converts in one language at a time\n");
+                return 1;
+            }
+            if(res.count("scores"))
+            {
+                fprintf(stderr, "Batch mode doesn't resolve scores\n");
+                return 1;
+            }
+            batch_options.language = language;
+
+            return convert_batch(files, batch_options);
+        }
+
+        if(res.count("load-snapshot") || res.count("load-nbt"))
+        {
+            auto snapshot = res.count("load-snapshot") > 0;
+            auto& path = res[snapshot ? "load-snapshot" : "load-nbt"].as<std::string>();
+            auto file = LibSoprano::MappedFile::open(path);
+            if(file.isErr())
+            {
+                fprintf(stderr, "%s\n", file.storage().get<std::string>().c_str());
+                return 3;
+            }
+
+            // Snapshots are rendered straight from the mapped file.
+            auto data = file.storage().get<LibSoprano::MappedFile>().data();
+            auto tree = snapshot ? LibSoprano::ChatTree::view_snapshot(data) : LibSoprano::ChatTree::parse_nbt(data);
+            if(tree.isErr())
+            {
+                fprintf(stderr, "%s: %s\n", path.c_str(), tree.storage().get<std::string>().c_str());
+                return 2;
+            }
+
+            LibSoprano::FileSink output(stdout);
+            auto& root = tree.storage().get<LibSoprano::ChatTree>();
+            convert(root, output, format, color_depth);
+            output.write('\n');
+
+            if(fflush(stdout) != 0 || output.failed())
+                return 3;
+            return 0;
+        }
+
+        if(!res.count("input") || res.count("files"))
+        {
+            printf("%s\n", options.help().c_str());
+            return 1;
+        }
+
+        auto& input = res["input"].as<std::string>();
+        if(res.count("snapshot") || res.count("nbt"))
+        {
+            auto tree = legacy ? LibSoprano::ChatTree::parse_legacy(input) : LibSoprano::ChatTree::parse(input);
+            if(tree.isErr())
+            {
+                fprintf(stderr, "%s\n", tree.storage().get<std::string>().c_str());
+                return 2;
+            }
+
+            auto snapshot = res.count("snapshot") > 0;
+            auto& path = res[snapshot ? "snapshot" : "nbt"].as<std::string>();
+            auto file = fopen(path.c_str(), "wb");
+            if(!file)
+            {
+                fprintf(stderr, "Couldn't open %s\n", path.c_str());
+                return 3;
+            }
+
+            LibSoprano::FileSink output(file);
+            auto& root = tree.storage().get<LibSoprano::ChatTree>();
+            auto written = snapshot ? root.write_snapshot(output) : root.write_nbt(output);
+            if(fclose(file) != 0 || !written)
+            {
+                fprintf(stderr, "Couldn't write %s\n", path.c_str());
+                return 3;
+            }
+            return 0;
+        }
+
+        // Components read from JSON borrow their text from input, which outlives them.
+        auto component = legacy ? LibSoprano::ChatComponent::parse_legacy(input)
+                                : LibSoprano::ChatComponent::parse_borrowed(input);
+        if(component.isErr())
+        {
+            fprintf(stderr, "%s\n", component.storage().get<std::string>().c_str());
+            return 2;
+        }
+
+        auto& root = component.storage().get<LibSoprano::ChatComponent>();
+        if(res.count("scores"))
+        {
+            LibSoprano::Scoreboard scoreboard;
+            if(!load_scores(res["scores"].as<std::string>(), scoreboard))
+                return 3;
+            scoreboard.resolve(root);
+        }
+
+        LibSoprano::FileSink output(stdout);
+        if(languages.size() > 1)
+        {
+            convert_languages(root, output, format, color_depth, languages);
+        }
+        else
+        {
+            convert(root, output, format, color_depth, language);
+            output.write('\n');
+        }
+
+        if(fflush(stdout) != 0 || output.failed())
+            return 3;
+        return 0;
+    }
+    catch(const cxxopts::OptionException& e)
+    {
+        fprintf(stderr, "%s\n", e.what());
+        printf("%s\n", options.help().c_str());
+        return 1;
+    }
+}
@@ -0,0 +1,326 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "AnsiRenderer.h"
+#include "ChatArchive.h"
+#include "ChatComponent.h"
+#include "ChatTree.h"
+#include <algorithm>
+#include <array>
+
+namespace LibSoprano
+{
+    namespace
+    {
+        struct FlagCodes
+        {
+            Style::Flag flag;
+            uint8_t on;
+            uint8_t off;
+        };
+
+        // Obfuscated text has no real equivalent in a terminal, blinking is the closest.
+        constexpr std::array<FlagCodes, Style::flag_count> s_flag_codes =
+        {{
+            {Style::Flag::Bold, 1, 22},
+            {Style::Flag::Italic, 3, 23},
+            {Style::Flag::Underlined, 4, 24},
+            {Style::Flag::Strikethrough, 9, 29},
+            {Style::Flag::Obfuscated, 5, 25},
+        }};
+
+        constexpr uint8_t s_default_foreground = 39;
+
+        constexpr int distance(int r1, int g1, int b1, int r2, int g2, int b2)
+        {
+            return (r1 - r2) * (r1 - r2) + (g1 - g2) * (g1 - g2) + (b1 - b2) * (b1 - b2);
+        }
+
+        // The levels of each channel in xterm's 6x6x6 color cube (colors 16 to 231).
+        constexpr uint8_t s_cube_levels[] = {0, 95, 135, 175, 215, 255};
+
+        // Each channel can be matched on its own, since the cube is a grid.
+        constexpr auto s_nearest_cube_level = []()
+        {
+            std::array<uint8_t, 256> table{};
+            for(int value = 0; value < 256; value++)
+            {
+                for(uint8_t level = 1; level < std::size(s_cube_levels); level++)
+                {
+                    auto difference = value - s_cube_levels[level];
+                    auto best_difference = value - s_cube_levels[table[value]];
+                    if(difference * difference < best_difference * best_difference)
+                        table[value] = level;
+                }
+            }
+            return table;
+        }();
+
+        // xterm's gray ramp (colors 232 to 255) goes from 8 to 238 in steps of 10.
+        constexpr int gray_level(int index) { return 8 + index * 10; }
+
+        constexpr auto s_nearest_gray = []()
+        {
+            std::array<uint8_t, 256> table{};
+            for(int value = 0; value < 256; value++)
+            {
+                auto index = (value - 3) / 10;
+                table[value] = static_cast<uint8_t>(std::clamp(index, 0, 23));
+            }
+            return table;
+        }();
+
+        uint8_t nearest_256_color(unsigned int rgb)
+        {
+            int r = (rgb >> 16) & 0xFF;
+            int g = (rgb >> 8) & 0xFF;
+            int b = rgb & 0xFF;
+
+            auto r_level = s_nearest_cube_level[r];
+            auto g_level = s_nearest_cube_level[g];
+            auto b_level = s_nearest_cube_level[b];
+            auto cube_distance = distance(r, g, b, s_cube_levels[r_level], s_cube_levels[g_level], s_cube_levels[b_level]);
+
+            // The closest gray is the one closest to the average of the channels.
+            auto gray = s_nearest_gray[(r + g + b) / 3];
+            auto level = gray_level(gray);
+            if(distance(r, g, b, level, level, level) < cube_distance)
+                return 232 + gray;
+
+            return 16 + r_level * 36 + g_level * 6 + b_level;
+        }
+
+        // The basic colors don't form a grid, so there's no shortcut like
+        // there is for the cube: the result is cached instead (see BasicColorCache).
+        uint8_t nearest_basic_color(unsigned int rgb, AnsiRenderer::BasicColorCache& cache)
+        {
+            auto& entry = cache[(rgb * 0x9E3779B1u) >> 24];
+            // Empty entries have white in their upper bits, and 0xFF, which
+            // no color maps to, in their lower ones.
+            if((entry >> 8) == rgb && (entry & 0xFF) != 0xFF)
+                return entry & 0xFF;
+
+            int r = (rgb >> 16) & 0xFF;
+            int g = (rgb >> 8) & 0xFF;
+            int b = rgb & 0xFF;
+
+            // These are the named colors, as they're shown with their SGR codes.
+            auto named = Color::named_colors();
+            auto best = &named[0];
+            auto best_distance = distance(r, g, b, 0, 0, 0);
+            for(auto& color : named)
+            {
+                auto foreground = color.foreground;
+                auto color_distance = distance(r, g, b, foreground >> 16, (foreground >> 8) & 0xFF, foreground & 0xFF);
+                if(color_distance < best_distance)
+                {
+                    best = &color;
+                    best_distance = color_distance;
+                }
+            }
+
+            entry = (rgb << 8) | best->ansi_code;
+            return best->ansi_code;
+        }
+
+        // The parameters of a single SGR sequence, built up on the stack.
+        class Parameters
+        {
+        public:
+            // Parameters never go above 255.
+            void append(unsigned int parameter)
+            {
+                if(m_length != 0)
+                    m_buffer[m_length++] = ';';
+                if(parameter >= 100)
+                    m_buffer[m_length++] = static_cast<char>('0' + parameter / 100);
+                if(parameter >= 10)
+                    m_buffer[m_length++] = static_cast<char>('0' + parameter / 10 % 10);
+                m_buffer[m_length++] = static_cast<char>('0' + parameter % 10);
+            }
+
+            void append_color(const Color& color, AnsiRenderer::ColorDepth depth, AnsiRenderer::BasicColorCache& cache)
+            {
+                if(auto code = color.ansi_code())
+                {
+                    append(code);
+                    return;
+                }
+
+                auto rgb = color.foreground();
+                switch(depth)
+                {
+                    case AnsiRenderer::ColorDepth::TrueColor:
+                        append(38);
+                        append(2);
+                        append((rgb >> 16) & 0xFF);
+                        append((rgb >> 8) & 0xFF);
+                        append(rgb & 0xFF);
+                        break;
+                    case AnsiRenderer::ColorDepth::Palette256:
+                        append(38);
+                        append(5);
+                        append(nearest_256_color(rgb));
+                        break;
+                    case AnsiRenderer::ColorDepth::Palette16:
+                        append(nearest_basic_color(rgb, cache));
+                        break;
+                }
+            }
+
+            std::size_t size() const { return m_length; }
+            std::string_view view() const { return {m_buffer, m_length}; }
+
+        private:
+            // Reset, a truecolor foreground and every flag comes out to a little under 40 bytes.
+            char m_buffer[64];
+            std::size_t m_length = 0;
+        };
+    }
+
+    bool AnsiRenderer::render(const ChatComponent& component, Sink& sink)
+    {
+        begin(sink);
+        if(component.walk(*this, m_language))
+            finish();
+        return !sink.failed();
+    }
+
+    bool AnsiRenderer::render(const ChatTree& tree, Sink& sink)
+    {
+        begin(sink);
+        if(tree.walk(*this))
+            finish();
+        return !sink.failed();
+    }
+
+    bool AnsiRenderer::render(const ArchivedMessage& message, Sink& sink)
+    {
+        begin(sink);
+        if(message.walk(*this))
+            finish();
+        return !sink.failed();
+    }
+
+    void AnsiRenderer::begin(Sink& sink)
+    {
+        m_sink = &sink;
+        m_terminal = {};
+        m_states.clear();
+    }
+
+    void AnsiRenderer::finish()
+    {
+        // Leave the terminal the way we found it.
+        transition_to({});
+    }
+
+    void AnsiRenderer::transition_to(const State& target)
+    {
+        if(target == m_terminal)
+            return;
+
+        // Turn off or change only what differs...
+        Parameters diff;
+        bool turns_off = false;
+        if(target.style != m_terminal.style)
+        {
+            for(auto& codes : s_flag_codes)
+            {
+                auto enabled = target.style.is_enabled(codes.flag);
+                if(enabled == m_terminal.style.is_enabled(codes.flag))
+                    continue;
+                diff.append(enabled ? codes.on : codes.off);
+                turns_off |= !enabled;
+            }
+        }
+
+        if(target.color != m_terminal.color)
+        {
+            if(target.color)
+                diff.append_color(*target.color, m_depth, m_basic_colors);
+            else
+                diff.append(s_default_foreground);
+            turns_off |= !target.color;
+        }
+
+        // ...unless resetting everything and turning back on what's needed is
+        // shorter, which can only happen if something is being turned off.
+        Parameters reset;
+        if(turns_off)
+        {
+            reset.append(0);
+            for(auto& codes : s_flag_codes)
+            {
+                if(target.style.is_enabled(codes.flag))
+                    reset.append(codes.on);
+            }
+
+            if(target.color)
+                reset.append_color(*target.color, m_depth, m_basic_colors);
+        }
+
+        // Written all at once, since sinks are free to not be buffered.
+        std::string_view escape = m_escape ? Color::m_ansi_escape_escaped : Color::m_ansi_escape;
+        auto& shortest = turns_off && reset.size() < diff.size() ? reset : diff;
+        char sequence[sizeof(Parameters) + 8];
+        auto end = std::copy(escape.begin(), escape.end(), sequence);
+        *end++ = '[';
+        end = std::copy(shortest.view().begin(), shortest.view().end(), end);
+        *end++ = 'm';
+        m_sink->write(std::string_view(sequence, end - sequence));
+
+        m_terminal = target;
+    }
+
+    bool AnsiRenderer::enter(const RenderNode& node)
+    {
+        if(m_sink->failed())
+            return false;
+
+        State state;
+        if(m_states.empty())
+        {
+            state.color = node.color;
+            state.style = node.style;
+        }
+        else
+        {
+            auto& parent = m_states.back();
+            state.color = node.color ? node.color : parent.color;
+            state.style = node.style.inherit(parent.style);
+        }
+
+        // A flag explicitly set to false is the same as one that isn't there.
+        state.style = state.style.enabled();
+
+        // Nothing is written until there's text to show with it, so that
+        // components without text never cost any escape sequences.
+        if(!node.text.empty())
+        {
+            transition_to(state);
+            m_sink->write(node.text);
+        }
+
+        m_states.push_back(state);
+        return true;
+    }
+
+    void AnsiRenderer::leave(const RenderNode&)
+    {
+        m_states.pop_back();
+    }
+}
@@ -0,0 +1,110 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include "RenderNode.h"
+#include "Sink.h"
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace LibSoprano
+{
+    class ArchivedMessage;
+    class ChatComponent;
+    class ChatTree;
+    class LanguageTable;
+
+    // Renders components with ANSI escape sequences. The renderer keeps track
+    // of what the terminal is currently showing, and only emits the SGR
+    // parameters that change before each run of text, combined into a single
+    // sequence. A renderer can be reused across many components, which keeps
+    // its scratch memory around.
+    class AnsiRenderer
+    {
+    public:
+        // How many colors the terminal can show. Named colors always use the
+        // 16 basic colors, so that they follow the terminal's theme; this only
+        // affects hex colors, which are mapped to the nearest color available.
+        enum class ColorDepth : uint8_t
+        {
+            TrueColor,
+            Palette256,
+            Palette16
+        };
+
+        // If escape is set, the escape character is written as a C++ escape
+        // sequence, rather than the raw character.
+        explicit AnsiRenderer(bool escape = false, ColorDepth depth = ColorDepth::TrueColor)
+            : m_escape(escape), m_depth(depth)
+        {
+            m_basic_colors.fill(empty_cache_entry);
+        }
+
+        // Returns false if the sink failed, in which case rendering stopped
+        // at the component being written when it did.
+        bool render(const ChatComponent&, Sink&);
+        bool render(const ChatTree&, Sink&);
+        bool render(const ArchivedMessage&, Sink&);
+        // Translations are resolved with this language (see LanguageTable.h),
+        // or shown as their key without one. The language must outlive the
+        // renderer, or be unset first.
+        void set_language(const LanguageTable* language) { m_language = language; }
+
+        bool enter(const RenderNode&);
+        void leave(const RenderNode&);
+
+        // For rendering through enter and leave directly: begin starts over
+        // with the given sink, and finish leaves the terminal as it was.
+        void begin(Sink&);
+        void finish();
+        // Whether what's rendered next would come out the same as from other,
+        // at the same point of the same component (see FanOutRenderer.h).
+        bool same_state(const AnsiRenderer& other) const { return m_terminal == other.m_terminal; }
+
+        // Which of the 16 basic colors recently seen hex colors map to, as
+        // the color in the upper 24 bits and the SGR code in the lower 8.
+        using BasicColorCache = std::array<uint32_t, 256>;
+
+    private:
+        // No color maps to the code 0xFF, which is what tells this apart
+        // from white.
+        static constexpr uint32_t empty_cache_entry = 0xFFFFFFFF;
+
+        // The attributes a run of text is displayed with, after inheritance.
+        // Every flag that isn't enabled is off.
+        struct State
+        {
+            std::optional<Color> color;
+            Style style;
+
+            bool operator==(const State&) const = default;
+        };
+
+        void transition_to(const State&);
+
+        bool m_escape;
+        ColorDepth m_depth;
+        Sink* m_sink = nullptr;
+        const LanguageTable* m_language = nullptr;
+        // What the terminal is currently set to.
+        State m_terminal;
+        // The state of each component that we're inside of, innermost last.
+        std::vector<State> m_states;
+        BasicColorCache m_basic_colors;
+    };
+}
@@ -0,0 +1,300 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "BatchConverter.h"
+#include "ChatComponent.h"
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <fmt/format.h>
+
+namespace LibSoprano
+{
+    // Roughly how much input makes up a batch: enough that passing it between
+    // threads costs next to nothing compared to converting it.
+    static constexpr std::size_t s_batch_size = 64 * 1024;
+    // How many batches may be in flight for each worker, so that workers
+    // don't sit idle while the oldest batch is being written out.
+    static constexpr std::size_t s_batches_per_worker = 4;
+
+    BatchConverter::BatchConverter(const Options& options) : m_options(options)
+    {
+        if(m_options.threads == 0)
+            m_options.threads = std::max(1u, std::thread::hardware_concurrency());
+        auto threads = m_options.threads;
+
+        for(std::size_t i = 0; i < threads * s_batches_per_worker; i++)
+            m_batches.push_back(std::make_unique<Batch>());
+
+        for(unsigned i = 0; i < threads; i++)
+            m_workers.emplace_back(&BatchConverter::work, this);
+    }
+
+    BatchConverter::~BatchConverter()
+    {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stopping = true;
+        }
+        m_work_available.notify_all();
+
+        for(auto& worker : m_workers)
+            worker.join();
+    }
+
+    BatchConverter::Stats BatchConverter::convert(FILE* input, std::string_view name, Sink& output, Sink& errors)
+    {
+        Stats stats;
+        std::string carry;
+        // Batches handed to the workers in input order, and those that are free.
+        std::deque<Batch*> in_flight;
+        std::vector<Batch*> idle;
+        for(auto& batch : m_batches)
+            idle.push_back(batch.get());
+
+        auto write_oldest = [&]()
+        {
+            auto batch = in_flight.front();
+            in_flight.pop_front();
+            {
+                std::unique_lock lock(m_mutex);
+                m_batch_done.wait(lock, [batch]() { return batch->done; });
+            }
+
+            output.write(batch->output);
+            errors.write(batch->errors);
+            stats.lines += batch->line_count;
+            stats.errors += batch->error_count;
+            stats.cache_hits += batch->cache_hits;
+            idle.push_back(batch);
+        };
+
+        auto more = true;
+        std::size_t next_line = 1;
+        while(more && !output.failed())
+        {
+            if(idle.empty())
+                write_oldest();
+
+            auto batch = idle.back();
+            more = read_batch(input, *batch, carry);
+            if(batch->input.empty())
+                break;
+
+            idle.pop_back();
+            batch->name = name;
+            batch->first_line = next_line;
+            batch->done = false;
+            next_line += batch->line_count;
+            {
+                std::lock_guard lock(m_mutex);
+                m_queue.push_back(batch);
+            }
+            m_work_available.notify_one();
+            in_flight.push_back(batch);
+        }
+
+        while(!in_flight.empty())
+            write_oldest();
+
+        if(ferror(input))
+        {
+            errors.write(fmt::format("{}: Couldn't read all of the input\n", name));
+            stats.errors++;
+        }
+
+        return stats;
+    }
+
+    bool BatchConverter::read_batch(FILE* input, Batch& batch, std::string& carry)
+    {
+        batch.input.swap(carry);
+        carry.clear();
+
+        // Keep reading until there's a whole batch, and at least one whole line.
+        auto has_line = batch.input.find('\n') != std::string::npos;
+        auto more = true;
+        while(more && (!has_line || batch.input.size() < s_batch_size))
+        {
+            auto size = batch.input.size();
+            batch.input.resize(size + s_batch_size);
+            auto read = fread(batch.input.data() + size, 1, s_batch_size, input);
+            batch.input.resize(size + read);
+            more = read == s_batch_size;
+            has_line = has_line || memchr(batch.input.data() + size, '\n', read);
+        }
+
+        // A partial line at the end is left for the next batch, unless there's nothing left to finish it.
+        if(more)
+        {
+            auto end = batch.input.rfind('\n') + 1;
+            carry.assign(batch.input, end);
+            batch.input.resize(end);
+        }
+
+        batch.line_count = std::count(batch.input.begin(), batch.input.end(), '\n');
+        if(!batch.input.empty() && batch.input.back() != '\n')
+            batch.line_count++;
+
+        return more;
+    }
+
+    void BatchConverter::convert_batch(Batch& batch, AnsiRenderer& ansi, HtmlRenderer& html, JsonWriter& json,
+                                       LegacyRenderer& legacy, RenderCache* cache)
+    {
+        batch.output.clear();
+        batch.errors.clear();
+        batch.error_count = 0;
+        batch.cache_hits = 0;
+        batch.rendered.clear();
+        auto options = render_options();
+        auto language = m_options.language ? m_options.language->hash() : 0;
+
+        StringSink sink(batch.output);
+        std::string_view input = batch.input;
+        auto line_number = batch.first_line;
+
+        auto report = [&batch, &line_number](std::string_view message)
+        {
+            fmt::format_to(std::back_inserter(batch.errors), "{}:{}: {}\n", batch.name, line_number, message);
+            batch.error_count++;
+        };
+
+        while(!input.empty())
+        {
+            auto end = input.find('\n');
+            auto line = input.substr(0, end);
+            input.remove_prefix(end == std::string_view::npos ? input.size() : end + 1);
+            if(!line.empty() && line.back() == '\r')
+                line.remove_suffix(1);
+
+            auto cached = cache ? cache->find(line, options, language) : std::nullopt;
+#ifdef SOPRANO_DISK_CACHE
+            if(!cached && m_options.disk_cache)
+            {
+                cached = m_options.disk_cache->find(line, options, language);
+                if(cached && cache)
+                    cache->insert(line, options, language, *cached);
+            }
+#endif
+
+            if(cached)
+            {
+                sink.write(*cached);
+                batch.cache_hits++;
+            }
+            else if(line.find_first_not_of(" \t") != std::string_view::npos)
+            {
+                // The line outlives the component, so the text can be borrowed.
+                auto result = m_options.legacy_input ? ChatComponent::try_parse_legacy(line, true, m_options.limits)
+                                                     : ChatComponent::try_parse(line, true, m_options.limits);
+                if(result.isOk())
+                {
+                    auto& component = result.storage().get<ChatComponent>();
+                    auto start = batch.output.size();
+                    LimitedSink limited(sink, m_options.limits.max_output_bytes);
+                    bool rendered;
+                    if(m_options.format == Format::Html)
+                        rendered = html.render(component, limited);
+                    else if(m_options.format == Format::Json || m_options.format == Format::CanonicalJson)
+                        rendered = json.render(component, limited);
+                    else if(m_options.format == Format::Legacy || m_options.format == Format::LegacyNamedColors)
+                        rendered = legacy.render(component, limited);
+                    else
+                        rendered = ansi.render(component, limited);
+                    if(!rendered)
+                    {
+                        batch.output.resize(start);
+                        report("Output is too large");
+                    }
+                    else
+                    {
+                        if(cache)
+                            cache->insert(line, options, language, std::string_view(batch.output).substr(start));
+                        if(m_options.disk_cache)
+                            batch.rendered.push_back({line, start, batch.output.size() - start});
+                    }
+                }
+                else
+                {
+                    report(result.storage().get<ParseError>().message(line));
+                }
+            }
+
+            sink.write('\n');
+            line_number++;
+        }
+
+#ifdef SOPRANO_DISK_CACHE
+        // All at once, as every write to the disk cache takes a lock on the file.
+        if(!batch.rendered.empty())
+        {
+            std::vector<DiskCache::Item> items;
+            items.reserve(batch.rendered.size());
+            for(auto& rendered : batch.rendered)
+            {
+                items.push_back({rendered.json, options, language,
+                                 std::string_view(batch.output).substr(rendered.output_start, rendered.output_size)});
+            }
+            m_options.disk_cache->insert(items);
+        }
+#endif
+    }
+
+    uint32_t BatchConverter::render_options() const
+    {
+        return static_cast<uint32_t>(m_options.format) | static_cast<uint32_t>(m_options.color_depth) << 8
+             | static_cast<uint32_t>(m_options.legacy_input) << 16;
+    }
+
+    void BatchConverter::work()
+    {
+        // Each worker has its own renderers, which keep their scratch memory between lines.
+        AnsiRenderer ansi(m_options.format == Format::EscapedAnsi, m_options.color_depth);
+        HtmlRenderer html;
+        JsonWriter json(m_options.format == Format::CanonicalJson ? JsonWriter::Mode::Canonical : JsonWriter::Mode::Minified);
+        LegacyRenderer legacy(m_options.format == Format::LegacyNamedColors ? LegacyRenderer::HexColors::Nearest
+                                                                            : LegacyRenderer::HexColors::Sequence);
+        ansi.set_language(m_options.language);
+        html.set_language(m_options.language);
+        legacy.set_language(m_options.language);
+        // As are the caches, so that they need no locking.
+        std::optional<RenderCache> cache;
+        if(m_options.cache_bytes)
+            cache.emplace(m_options.cache_bytes / m_options.threads);
+
+        while(true)
+        {
+            Batch* batch;
+            {
+                std::unique_lock lock(m_mutex);
+                m_work_available.wait(lock, [this]() { return m_stopping || !m_queue.empty(); });
+                if(m_queue.empty())
+                    return;
+                batch = m_queue.front();
+                m_queue.pop_front();
+            }
+
+            convert_batch(*batch, ansi, html, json, legacy, cache ? &*cache : nullptr);
+
+            {
+                std::lock_guard lock(m_mutex);
+                batch->done = true;
+            }
+            m_batch_done.notify_all();
+        }
+    }
+}
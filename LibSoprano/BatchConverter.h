@@ -0,0 +1,147 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include "AnsiRenderer.h"
+#include "DiskCache.h"
+#include "HtmlRenderer.h"
+#include "JsonWriter.h"
+#include "LanguageTable.h"
+#include "LegacyRenderer.h"
+#include "Limits.h"
+#include "RenderCache.h"
+#include "Sink.h"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace LibSoprano
+{
+    // Converts newline-delimited chat components (NDJSON, one component per
+    // line) across a pool of worker threads. Input is read in batches of
+    // whole lines, which the workers parse and render into buffers of their
+    // own, and the results are written back in input order. Only a fixed
+    // number of batches are ever in flight, so memory use is bounded no
+    // matter how long the input is.
+    //
+    // Every line of input gives exactly one line of output, so that the two
+    // can be matched up: a line that fails gives an empty line, and its error
+    // goes to the error sink along with its line number. Blank lines are
+    // passed through as they are.
+    class BatchConverter
+    {
+    public:
+        enum class Format : uint8_t
+        {
+            Ansi,
+            EscapedAnsi,
+            Html,
+            // Written back out as JSON (see JsonWriter.h).
+            Json,
+            CanonicalJson,
+            // As legacy text with § codes (see LegacyRenderer.h), with hex
+            // colors as §x sequences or as the nearest named color.
+            Legacy,
+            LegacyNamedColors
+        };
+
+        struct Options
+        {
+            Format format = Format::Ansi;
+            // Whether lines are legacy text with § codes (see LegacyText.h), rather than JSON.
+            bool legacy_input = false;
+            // What translations are resolved with, shared by every worker.
+            const LanguageTable* language = nullptr;
+            AnsiRenderer::ColorDepth color_depth = AnsiRenderer::ColorDepth::TrueColor;
+            // How many worker threads to use, or 0 for one per hardware thread.
+            unsigned threads = 0;
+            // Applied to every line separately. The output of a line that
+            // renders to more than max_output_bytes is dropped.
+            Limits limits;
+            // How much rendered output to keep for lines that repeat, split
+            // evenly between the workers, or 0 to render every line afresh.
+            std::size_t cache_bytes = 0;
+            // Looked in after the in-memory cache, and given every line that's
+            // rendered afresh, so later runs can skip them.
+            DiskCache* disk_cache = nullptr;
+        };
+
+        struct Stats
+        {
+            std::size_t lines = 0;
+            std::size_t errors = 0;
+            // How many lines were answered from either cache.
+            std::size_t cache_hits = 0;
+        };
+
+        explicit BatchConverter(const Options&);
+        ~BatchConverter();
+
+        // Converts all of input, which is called name in error messages. The
+        // workers are kept around between calls.
+        Stats convert(FILE* input, std::string_view name, Sink& output, Sink& errors);
+
+    private:
+        // A line rendered afresh, and where its output is, for the disk cache.
+        struct Rendered
+        {
+            std::string_view json;
+            std::size_t output_start;
+            std::size_t output_size;
+        };
+
+        struct Batch
+        {
+            std::string input;
+            std::size_t first_line = 0;
+            std::size_t line_count = 0;
+            std::string_view name;
+
+            std::string output;
+            std::string errors;
+            std::size_t error_count = 0;
+            std::size_t cache_hits = 0;
+            std::vector<Rendered> rendered;
+            bool done = false;
+        };
+
+        // Fills the batch with the next lines of input, carrying over any
+        // partial line to the next one. Returns false at the end of input.
+        bool read_batch(FILE* input, Batch&, std::string& carry);
+        void convert_batch(Batch&, AnsiRenderer&, HtmlRenderer&, JsonWriter&, LegacyRenderer&, RenderCache*);
+        // Identifies the input, format and colors in the caches.
+        uint32_t render_options() const;
+        void work();
+
+        Options m_options;
+        std::vector<std::thread> m_workers;
+        std::vector<std::unique_ptr<Batch>> m_batches;
+
+        std::mutex m_mutex;
+        std::condition_variable m_work_available;
+        std::condition_variable m_batch_done;
+        std::deque<Batch*> m_queue;
+        bool m_stopping = false;
+    };
+}
@@ -0,0 +1,353 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "ChatArchive.h"
+#include "Hash.h"
+#include "HtmlRenderer.h"
+#include <fmt/format.h>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <type_traits>
+
+namespace LibSoprano
+{
+    // Every column is written as it is in memory.
+    static_assert(std::is_trivially_copyable_v<ArchiveBlock::StyleEntry> && sizeof(ArchiveBlock::StyleEntry) == 8);
+    static_assert(std::is_trivially_copyable_v<ArchiveBlock::Segment> && sizeof(ArchiveBlock::Segment) == 8);
+
+    // Followed by the columns, each starting on an 8 byte boundary.
+    struct ArchiveBlockHeader
+    {
+        char magic[8];
+        uint32_t version;
+        // Reads back differently on a machine of the other byte order.
+        uint32_t byte_order;
+        uint32_t message_count;
+        uint32_t node_count;
+        uint32_t style_count;
+        uint32_t segment_count;
+        uint32_t text_size;
+        uint32_t reserved;
+        // The whole block, header and padding included.
+        uint64_t block_size;
+    };
+
+    static_assert(sizeof(ArchiveBlockHeader) % 8 == 0);
+
+    static constexpr char s_archive_magic[8] = {'S', 'O', 'P', 'R', 'A', 'R', 'C', 'H'};
+    static constexpr uint32_t s_archive_version = 1;
+    static constexpr uint32_t s_byte_order = 0x01020304;
+    // Style ids are 16 bits, and a message has at most this many components.
+    static constexpr std::size_t s_max_styles = 1 << 16;
+
+    static uint64_t pad(uint64_t size)
+    {
+        return (size + 7) / 8 * 8;
+    }
+
+    // Where each column starts, relative to the start of the block.
+    struct ArchiveLayout
+    {
+        explicit ArchiveLayout(const ArchiveBlockHeader& header)
+        {
+            timestamps = sizeof(ArchiveBlockHeader);
+            message_nodes = timestamps + pad(uint64_t(header.message_count) * sizeof(int64_t));
+            node_ends = message_nodes + pad((uint64_t(header.message_count) + 1) * sizeof(uint32_t));
+            node_segments = node_ends + pad(uint64_t(header.node_count) * sizeof(uint32_t));
+            node_styles = node_segments + pad(uint64_t(header.node_count) * sizeof(uint32_t));
+            styles = node_styles + pad(uint64_t(header.node_count) * sizeof(uint16_t));
+            segments = styles + uint64_t(header.style_count) * sizeof(ArchiveBlock::StyleEntry);
+            text = segments + uint64_t(header.segment_count) * sizeof(ArchiveBlock::Segment);
+            size = text + pad(header.text_size);
+        }
+
+        uint64_t timestamps;
+        uint64_t message_nodes;
+        uint64_t node_ends;
+        uint64_t node_segments;
+        uint64_t node_styles;
+        uint64_t styles;
+        uint64_t segments;
+        uint64_t text;
+        uint64_t size;
+    };
+
+    // Walking and rendering trust every index in a block, so a damaged block
+    // has to be caught here. Returns the message the damage is in, if any.
+    static std::optional<uint32_t> find_damage(const ArchiveBlock& block, const ArchiveBlockHeader& header)
+    {
+        for(uint32_t i = 0; i < header.segment_count; i++)
+        {
+            if(uint64_t(block.segments[i].offset) + block.segments[i].length > header.text_size)
+                return 0;
+        }
+
+        for(uint32_t i = 0; i < header.style_count; i++)
+        {
+            // Past the table of named colors.
+            uint32_t color;
+            memcpy(&color, &block.styles[i].color, sizeof(color));
+            if((color >> 24) > Color::named_colors().size())
+                return 0;
+        }
+
+        if(block.message_nodes[0] != 0 || block.message_nodes[header.message_count] != header.node_count)
+            return 0;
+
+        for(uint32_t message = 0; message < header.message_count; message++)
+        {
+            auto first = block.message_nodes[message];
+            auto last = block.message_nodes[message + 1];
+            if(first >= last || last > header.node_count)
+                return message;
+
+            InlineStack<uint32_t> open;
+            for(auto i = first; i < last; i++)
+            {
+                while(!open.empty() && block.node_ends[open.top()] <= i)
+                    open.pop();
+
+                auto end = block.node_ends[i];
+                auto parent_end = open.empty() ? last : block.node_ends[open.top()];
+                if(end <= i || end > parent_end || (i == first && end != last)
+                   || block.node_segments[i] >= header.segment_count || block.node_styles[i] >= header.style_count)
+                    return message;
+
+                if(end > i + 1)
+                    open.push(i);
+            }
+        }
+
+        return {};
+    }
+
+    Result<ChatArchive, ChatArchive::Error> ChatArchive::view(std::string_view bytes)
+    {
+        if(reinterpret_cast<uintptr_t>(bytes.data()) % alignof(int64_t) != 0)
+            return Err(Error("The chat archive isn't aligned in memory"));
+
+        ChatArchive archive;
+        std::size_t offset = 0;
+        while(offset < bytes.size())
+        {
+            auto remaining = bytes.size() - offset;
+            ArchiveBlockHeader header;
+            if(remaining < sizeof(header))
+            {
+                archive.m_unfinished_bytes = remaining;
+                break;
+            }
+            memcpy(&header, bytes.data() + offset, sizeof(header));
+
+            if(memcmp(header.magic, s_archive_magic, sizeof(s_archive_magic)) != 0)
+            {
+                if(offset == 0)
+                    return Err(Error("Not a chat archive"));
+                return Err(fmt::format("The chat archive is damaged at byte {}", offset));
+            }
+            if(header.version != s_archive_version)
+                return Err(fmt::format("Unsupported chat archive version {}", header.version));
+            if(header.byte_order != s_byte_order)
+                return Err(Error("The chat archive was written on a machine of the other byte order"));
+
+            ArchiveLayout layout(header);
+            if(layout.size != header.block_size)
+                return Err(fmt::format("The chat archive is damaged at byte {}", offset));
+            if(header.block_size > remaining)
+            {
+                archive.m_unfinished_bytes = remaining;
+                break;
+            }
+
+            auto data = bytes.data() + offset;
+            ArchiveBlock block;
+            block.first_message = archive.m_message_count;
+            block.message_count = header.message_count;
+            block.timestamps = reinterpret_cast<const int64_t*>(data + layout.timestamps);
+            block.message_nodes = reinterpret_cast<const uint32_t*>(data + layout.message_nodes);
+            block.node_ends = reinterpret_cast<const uint32_t*>(data + layout.node_ends);
+            block.node_segments = reinterpret_cast<const uint32_t*>(data + layout.node_segments);
+            block.node_styles = reinterpret_cast<const uint16_t*>(data + layout.node_styles);
+            block.styles = reinterpret_cast<const ArchiveBlock::StyleEntry*>(data + layout.styles);
+            block.segments = reinterpret_cast<const ArchiveBlock::Segment*>(data + layout.segments);
+            block.text = data + layout.text;
+
+            if(auto damaged = find_damage(block, header))
+                return Err(fmt::format("The chat archive is damaged at message {}", block.first_message + *damaged));
+
+            archive.m_blocks.push_back(block);
+            archive.m_message_count += header.message_count;
+            offset += header.block_size;
+        }
+
+        return Ok(std::move(archive));
+    }
+
+    ArchivedMessage ChatArchive::message(std::size_t index) const
+    {
+        auto block = std::upper_bound(m_blocks.begin(), m_blocks.end(), index, [](std::size_t index, const ArchiveBlock& block)
+        {
+            return index < block.first_message;
+        });
+        --block;
+        return {*block, static_cast<uint32_t>(index - block->first_message)};
+    }
+
+    bool ChatArchiveWriter::append(const ChatTree& tree, int64_t timestamp)
+    {
+        if(tree.empty() || tree.size() > s_max_styles)
+            return false;
+
+        std::size_t text_size = 0;
+        for(auto& node : tree.nodes())
+            text_size += node.text_length;
+
+        // Start a new block before any column could overflow. Text is counted
+        // in full, as though none of it were repeated.
+        constexpr auto max = std::numeric_limits<uint32_t>::max();
+        if(m_timestamps.size() >= m_block_messages || m_styles.size() + tree.size() > s_max_styles
+           || m_node_ends.size() + tree.size() > max || m_text.size() + text_size > max)
+        {
+            if(!flush())
+                return false;
+        }
+
+        auto first = static_cast<uint32_t>(m_node_ends.size());
+        m_timestamps.push_back(timestamp);
+        m_message_nodes.push_back(first);
+
+        for(auto& node : tree.nodes())
+        {
+            m_node_ends.push_back(first + node.end);
+            m_node_segments.push_back(intern_segment(tree.text(node)));
+            m_node_styles.push_back(intern_style(tree, node));
+        }
+
+        return !m_sink.failed();
+    }
+
+    uint16_t ChatArchiveWriter::intern_style(const ChatTree& tree, const ChatTree::Node& node)
+    {
+        auto color = tree.color(node);
+        uint32_t color_bits = 0;
+        if(color)
+            memcpy(&color_bits, color, sizeof(color_bits));
+
+        // Everything that tells two entries apart, packed into one key.
+        auto key = uint64_t(color_bits) | uint64_t(node.style.bits()) << 32 | uint64_t(color != nullptr) << 48;
+        auto [it, inserted] = m_style_ids.try_emplace(key, static_cast<uint16_t>(m_styles.size()));
+        if(inserted)
+            m_styles.push_back({color ? *color : Color(0), node.style, color != nullptr});
+        return it->second;
+    }
+
+    uint32_t ChatArchiveWriter::intern_segment(std::string_view text)
+    {
+        auto hash = hash_bytes(text);
+        auto [begin, end] = m_segment_ids.equal_range(hash);
+        for(auto it = begin; it != end; ++it)
+        {
+            auto& segment = m_segments[it->second];
+            if(std::string_view(m_text.data() + segment.offset, segment.length) == text)
+                return it->second;
+        }
+
+        auto id = static_cast<uint32_t>(m_segments.size());
+        m_segments.push_back({static_cast<uint32_t>(m_text.size()), static_cast<uint32_t>(text.size())});
+        m_text.append(text);
+        m_segment_ids.emplace(hash, id);
+        return id;
+    }
+
+    bool ChatArchiveWriter::flush()
+    {
+        if(m_timestamps.empty())
+            return !m_sink.failed();
+
+        m_message_nodes.push_back(static_cast<uint32_t>(m_node_ends.size()));
+
+        ArchiveBlockHeader header;
+        memcpy(header.magic, s_archive_magic, sizeof(s_archive_magic));
+        header.version = s_archive_version;
+        header.byte_order = s_byte_order;
+        header.message_count = static_cast<uint32_t>(m_timestamps.size());
+        header.node_count = static_cast<uint32_t>(m_node_ends.size());
+        header.style_count = static_cast<uint32_t>(m_styles.size());
+        header.segment_count = static_cast<uint32_t>(m_segments.size());
+        header.text_size = static_cast<uint32_t>(m_text.size());
+        header.reserved = 0;
+        header.block_size = ArchiveLayout(header).size;
+
+        auto write = [this](const void* data, std::size_t size, bool padded)
+        {
+            static constexpr char zeroes[8] = {};
+            m_sink.write(std::string_view(static_cast<const char*>(data), size));
+            if(padded && size % 8 != 0)
+                m_sink.write(std::string_view(zeroes, 8 - size % 8));
+        };
+
+        write(&header, sizeof(header), false);
+        write(m_timestamps.data(), m_timestamps.size() * sizeof(int64_t), true);
+        write(m_message_nodes.data(), m_message_nodes.size() * sizeof(uint32_t), true);
+        write(m_node_ends.data(), m_node_ends.size() * sizeof(uint32_t), true);
+        write(m_node_segments.data(), m_node_segments.size() * sizeof(uint32_t), true);
+        write(m_node_styles.data(), m_node_styles.size() * sizeof(uint16_t), true);
+        write(m_styles.data(), m_styles.size() * sizeof(ArchiveBlock::StyleEntry), false);
+        write(m_segments.data(), m_segments.size() * sizeof(ArchiveBlock::Segment), false);
+        write(m_text.data(), m_text.size(), true);
+
+        m_timestamps.clear();
+        m_message_nodes.clear();
+        m_node_ends.clear();
+        m_node_segments.clear();
+        m_node_styles.clear();
+        m_styles.clear();
+        m_segments.clear();
+        m_text.clear();
+        m_style_ids.clear();
+        m_segment_ids.clear();
+
+        return !m_sink.failed();
+    }
+
+    bool ArchivedMessage::render_ansi(Sink& sink, bool escape, AnsiRenderer::ColorDepth depth) const
+    {
+        return AnsiRenderer(escape, depth).render(*this, sink);
+    }
+
+    bool ArchivedMessage::render_html(Sink& sink) const
+    {
+        return HtmlRenderer().render(*this, sink);
+    }
+
+    std::string ArchivedMessage::to_ansi_string(bool escape, AnsiRenderer::ColorDepth depth) const
+    {
+        std::string buffer;
+        StringSink sink(buffer);
+        render_ansi(sink, escape, depth);
+        return buffer;
+    }
+
+    std::string ArchivedMessage::to_html_string() const
+    {
+        std::string buffer;
+        StringSink sink(buffer);
+        render_html(sink);
+        return buffer;
+    }
+}
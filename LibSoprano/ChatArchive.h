@@ -0,0 +1,219 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include "result.h"
+#include "AnsiRenderer.h"
+#include "ChatTree.h"
+#include "InlineStack.h"
+#include "RenderNode.h"
+#include "Sink.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace LibSoprano
+{
+    // One block of an archive, as its columns. Nodes are numbered across the
+    // whole block, and stored in pre-order just like a ChatTree's.
+    struct ArchiveBlock
+    {
+        // The style and color of a node, stored once per block however many
+        // nodes share them.
+        struct StyleEntry
+        {
+            Color color;
+            Style style;
+            uint16_t has_color;
+        };
+
+        struct Segment
+        {
+            uint32_t offset;
+            uint32_t length;
+        };
+
+        // The index of the block's first message in the whole archive.
+        std::size_t first_message = 0;
+        uint32_t message_count = 0;
+        const int64_t* timestamps = nullptr;
+        // The first node of each message, plus one past the last node.
+        const uint32_t* message_nodes = nullptr;
+        // One past the index of each node's last descendant.
+        const uint32_t* node_ends = nullptr;
+        const uint32_t* node_segments = nullptr;
+        const uint16_t* node_styles = nullptr;
+        const StyleEntry* styles = nullptr;
+        const Segment* segments = nullptr;
+        const char* text = nullptr;
+    };
+
+    // A single message in an archive, read straight out of its block's columns.
+    class ArchivedMessage
+    {
+    public:
+        ArchivedMessage(const ArchiveBlock& block, uint32_t index) : m_block(&block), m_index(index) {}
+
+        int64_t timestamp() const { return m_block->timestamps[m_index]; }
+        // The number of components in the message.
+        std::size_t size() const { return last() - first(); }
+
+        // These return false if the sink failed part way through.
+        bool render_ansi(Sink&, bool escape = false, AnsiRenderer::ColorDepth = AnsiRenderer::ColorDepth::TrueColor) const;
+        bool render_html(Sink&) const;
+        std::string to_ansi_string(bool escape = false, AnsiRenderer::ColorDepth = AnsiRenderer::ColorDepth::TrueColor) const;
+        std::string to_html_string() const;
+
+        // Visits every component in document order (see RenderNode.h). Returns
+        // false if the visitor stopped early.
+        template<typename Visitor>
+        bool walk(Visitor& visitor) const
+        {
+            InlineStack<uint32_t> open;
+            for(auto i = first(); i < last(); i++)
+            {
+                while(!open.empty() && m_block->node_ends[open.top()] <= i)
+                {
+                    visitor.leave(render_node(open.top()));
+                    open.pop();
+                }
+
+                if(!visitor.enter(render_node(i)))
+                    return false;
+
+                if(m_block->node_ends[i] == i + 1)
+                    visitor.leave(render_node(i));
+                else
+                    open.push(i);
+            }
+
+            while(!open.empty())
+            {
+                visitor.leave(render_node(open.top()));
+                open.pop();
+            }
+
+            return true;
+        }
+
+    private:
+        uint32_t first() const { return m_block->message_nodes[m_index]; }
+        uint32_t last() const { return m_block->message_nodes[m_index + 1]; }
+
+        RenderNode render_node(uint32_t node) const
+        {
+            auto& style = m_block->styles[m_block->node_styles[node]];
+            auto& segment = m_block->segments[m_block->node_segments[node]];
+            return {std::string_view(m_block->text + segment.offset, segment.length),
+                    style.has_color ? std::optional(style.color) : std::nullopt, style.style};
+        }
+
+        const ArchiveBlock* m_block;
+        uint32_t m_index;
+    };
+
+    // An append-only archive of chat messages, stored a column at a time. The
+    // archive is a run of blocks, each of which stands on its own: a
+    // timestamp and first node per message, then the nodes of every message
+    // as columns of descendant ends, text segment ids and style ids, then a
+    // dictionary of the distinct style and color combinations, then a table
+    // of distinct text segments over a pool of their bytes. Repeated text
+    // (names, prefixes, whole announcements) is stored once per block.
+    //
+    // Appending to an archive just writes more blocks after the last, so two
+    // archives concatenated together are an archive too. An archive is read
+    // in place, straight from the file's bytes, without parsing any JSON.
+    class ChatArchive
+    {
+    public:
+        using Error = std::string;
+
+        // Checks over every block, and returns an archive that borrows the
+        // bytes without copying them. The bytes must be aligned to 8 bytes,
+        // and outlive the archive. A block cut short at the very end (say,
+        // still being appended) is left out, rather than being an error.
+        static Result<ChatArchive, Error> view(std::string_view bytes);
+
+        std::size_t size() const { return m_message_count; }
+        bool empty() const { return m_message_count == 0; }
+        const std::vector<ArchiveBlock>& blocks() const { return m_blocks; }
+        // How many bytes at the end were left out as an unfinished block.
+        std::size_t unfinished_bytes() const { return m_unfinished_bytes; }
+
+        // Finds a message by its index (which must be less than size()), with a
+        // binary search over the blocks.
+        ArchivedMessage message(std::size_t index) const;
+
+        // Visits every message in order, which is a plain run over each block.
+        template<typename Function>
+        void for_each(Function function) const
+        {
+            for(auto& block : m_blocks)
+            {
+                for(uint32_t i = 0; i < block.message_count; i++)
+                    function(ArchivedMessage(block, i));
+            }
+        }
+
+    private:
+        std::vector<ArchiveBlock> m_blocks;
+        std::size_t m_message_count = 0;
+        std::size_t m_unfinished_bytes = 0;
+    };
+
+    // Collects messages into a block, and writes it to a sink once it's full
+    // (or flushed). Messages only become readable once their block is written.
+    class ChatArchiveWriter
+    {
+    public:
+        static constexpr std::size_t default_block_messages = 65536;
+
+        explicit ChatArchiveWriter(Sink& sink, std::size_t block_messages = default_block_messages)
+            : m_sink(sink), m_block_messages(block_messages ? block_messages : 1) {}
+        // Writes whatever is left, ignoring failure; flush first to find out.
+        ~ChatArchiveWriter() { flush(); }
+
+        // Returns false if the sink has failed, or the message is empty or has
+        // more than 65536 components, which is more than a block can hold.
+        bool append(const ChatTree&, int64_t timestamp);
+        // Writes the messages collected so far as a block, if there are any.
+        bool flush();
+
+    private:
+        uint16_t intern_style(const ChatTree&, const ChatTree::Node&);
+        uint32_t intern_segment(std::string_view);
+
+        Sink& m_sink;
+        std::size_t m_block_messages;
+
+        std::vector<int64_t> m_timestamps;
+        std::vector<uint32_t> m_message_nodes;
+        std::vector<uint32_t> m_node_ends;
+        std::vector<uint32_t> m_node_segments;
+        std::vector<uint16_t> m_node_styles;
+        std::vector<ArchiveBlock::StyleEntry> m_styles;
+        std::vector<ArchiveBlock::Segment> m_segments;
+        std::string m_text;
+
+        // From the style and color packed together, and from a hash of the
+        // text, to their ids.
+        std::unordered_map<uint64_t, uint16_t> m_style_ids;
+        std::unordered_multimap<uint64_t, uint32_t> m_segment_ids;
+    };
+}
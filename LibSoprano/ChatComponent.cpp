@@ -15,67 +15,255 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "ChatComponent.h"
+#include "ChatComponentParser.h"
+#include "AnsiRenderer.h"
+#include "HtmlRenderer.h"
+#include "JsonReader.h"
+#include "LegacyText.h"
+#include "NbtWriter.h"
 #include <fmt/format.h>
-#include <sstream>
-#include <imgui/imgui_internal.h>
-#include <climits>
+#include <json.hpp>
+#include <limits>
 
 using namespace nlohmann;
 
 namespace LibSoprano
 {
-    // https://stackoverflow.com/questions/105252/how-do-i-convert-between-big-endian-and-little-endian-values-in-c
-    template <typename T>
-    static T swap_endian(T u)
+    Result<ChatComponent, ChatComponent::Error> ChatComponent::parse(std::string& raw_json)
+    {
+        auto result = try_parse(raw_json);
+        if(result.isOk())
+            return Ok(std::move(result.storage().get<ChatComponent>()));
+
+        // Syntax errors keep the text they've always had here, which is
+        // nlohmann's. Going through it again only costs anything on failure.
+        auto& error = result.storage().get<ParseError>();
+        if(error.code() == ParseError::Code::Syntax)
+        {
+            try
+            {
+                auto parsed = json::parse(raw_json);
+            }
+            catch(json::exception& e)
+            {
+                return Err(std::string(e.what()));
+            }
+        }
+
+        return Err(error.message(raw_json));
+    }
+
+    Result<ChatComponent, ChatComponent::Error> ChatComponent::parse_borrowed(std::string_view raw_json)
+    {
+        auto result = try_parse(raw_json, true);
+        if(result.isErr())
+            return Err(result.storage().get<ParseError>().message(raw_json));
+        return Ok(std::move(result.storage().get<ChatComponent>()));
+    }
+
+    Result<ChatComponent, ParseError> ChatComponent::try_parse(std::string_view raw_json, bool borrow_text,
+                                                               const Limits& limits) noexcept
     {
-        static_assert (CHAR_BIT == 8, "CHAR_BIT != 8");
+        ChatComponent comp;
+        ChatComponentBuilder builder(comp);
+        JsonReader reader(raw_json);
+        ChatComponentParser parser(builder, reader, limits, borrow_text);
 
-        union
+        if(!reader.parse(parser))
         {
-            T u;
-            unsigned char u8[sizeof(T)];
-        } source, dest;
+            // Without a syntax error, the parser stopped the reader itself on hitting a limit.
+            if(reader.error() == JsonReader::Error::None)
+                return Err(parser.error());
+            return Err(ParseError::syntax(reader.error(), static_cast<uint32_t>(reader.offset())));
+        }
 
-        source.u = u;
+        if(parser.error())
+            return Err(parser.error());
 
-        for (size_t k = 0; k < sizeof(T); k++)
-            dest.u8[k] = source.u8[sizeof(T) - k - 1];
+        return Ok(std::move(comp));
+    }
 
-        return dest.u;
+    Result<ChatComponent, ChatComponent::Error> ChatComponent::parse_nbt(std::string_view nbt)
+    {
+        auto result = try_parse_nbt(nbt);
+        if(result.isErr())
+            return Err(result.storage().get<ParseError>().nbt_message(nbt));
+        return Ok(std::move(result.storage().get<ChatComponent>()));
     }
 
-    Result<ChatComponent, ChatComponent::Error> ChatComponent::parse(std::string& raw_json)
+    Result<ChatComponent, ParseError> ChatComponent::try_parse_nbt(std::string_view nbt, bool borrow_text,
+                                                                   const Limits& limits, std::size_t* size) noexcept
     {
-        json json;
-        try
+        ChatComponent comp;
+        ChatComponentBuilder builder(comp);
+        NbtReader reader(nbt);
+        ChatComponentParser parser(builder, reader, limits, borrow_text);
+
+        if(!reader.parse(parser))
         {
-            json = json::parse(raw_json);
-            if(!json.is_object())
-                return Err(std::string("Component must be an object"));
+            if(reader.error() == NbtReader::Error::None)
+                return Err(parser.error());
+            return Err(ParseError::nbt(reader.error(), static_cast<uint32_t>(reader.offset())));
         }
-        catch(json::exception& e)
+
+        if(parser.error())
+            return Err(parser.error());
+
+        if(size)
+            *size = reader.offset();
+        return Ok(std::move(comp));
+    }
+
+    Result<ChatComponent, ChatComponent::Error> ChatComponent::parse_legacy(std::string_view text)
+    {
+        auto result = try_parse_legacy(text);
+        if(result.isErr())
+            return Err(result.storage().get<ParseError>().message(text));
+        return Ok(std::move(result.storage().get<ChatComponent>()));
+    }
+
+    Result<ChatComponent, ParseError> ChatComponent::try_parse_legacy(std::string_view text, bool borrow_text,
+                                                                      const Limits& limits) noexcept
+    {
+        ChatComponent comp;
+        ChatComponentBuilder builder(comp);
+        if(auto error = LegacyText::read(builder, text, limits, borrow_text))
+            return Err(error);
+        return Ok(std::move(comp));
+    }
+
+    // Reads a hexadecimal number just like std::stoul(string, nullptr, 16) always
+    // has (leading whitespace, a sign and a 0x prefix are all accepted), but
+    // without throwing.
+    static std::optional<unsigned long> parse_hex(std::string_view string)
+    {
+        auto digit = [&string](std::size_t i) -> int
+        {
+            if(i >= string.size())
+                return -1;
+            auto c = string[i];
+            if(c >= '0' && c <= '9')
+                return c - '0';
+            if(c >= 'a' && c <= 'f')
+                return c - 'a' + 10;
+            if(c >= 'A' && c <= 'F')
+                return c - 'A' + 10;
+            return -1;
+        };
+
+        std::size_t i = 0;
+        while(i < string.size() && (string[i] == ' ' || (string[i] >= '\t' && string[i] <= '\r')))
+            i++;
+
+        auto negative = false;
+        if(i < string.size() && (string[i] == '+' || string[i] == '-'))
+            negative = string[i++] == '-';
+
+        if(digit(i) == 0 && i + 1 < string.size() && (string[i + 1] == 'x' || string[i + 1] == 'X') && digit(i + 2) >= 0)
+            i += 2;
+
+        if(digit(i) < 0)
+            return {};
+
+        unsigned long value = 0;
+        for(; digit(i) >= 0; i++)
         {
-            return Err(std::string(e.what()));
+            if(value > (std::numeric_limits<unsigned long>::max() >> 4))
+                return {};
+            value = (value << 4) | digit(i);
         }
 
-        return parse(json);
+        return negative ? -value : value;
+    }
+
+    Result<Color, ParseError::Code> ChatComponent::parse_color(std::string_view col_str) noexcept
+    {
+        if(col_str.rfind('#') == 0)
+        {
+            // FIXME: This won't fail if it encounters a non-base-16 character
+            // after the first character, and will simply return the value up
+            // until encountering it. That's not right! (I'm not even sure the
+            // use case for that...)
+            auto color = parse_hex(col_str.substr(1));
+            if(!color)
+                return Err(ParseError::Code::InvalidHexColor);
+
+            return Ok(Color(static_cast<unsigned int>(*color)));
+        }
+
+        auto color = Color::from_name(col_str);
+        if(!color)
+            return Err(ParseError::Code::InvalidColorName);
+        return Ok(*color);
     }
 
     // TODO: Some annoying code duplication... could template some of this
     // (or macros if we were so evil)
-    Result<ChatComponent, ChatComponent::Error> ChatComponent::parse(json& json)
+    Result<json*, ChatComponent::Error> ChatComponent::parse_properties(json& json, ChatComponent& comp,
+                                                                        nlohmann::json*& with)
     {
-        ChatComponent comp;
-
+        with = nullptr;
         if(json.contains("text"))
         {
-            auto val = json["text"];
+            auto& val = json["text"];
             if(val.is_string())
             {
                 comp.m_type = Type::String;
-                comp.m_text = val.get<std::string>();
+                comp.m_text = Text::owned(val.get_ref<const std::string&>());
             }
         }
+        else if(json.contains("translate"))
+        {
+            auto& val = json["translate"];
+            comp.m_type = Type::Translation;
+            if(val.is_string())
+                comp.m_text = Text::owned(val.get_ref<const std::string&>());
+
+            if(json.contains("with"))
+            {
+                with = &json["with"];
+                if(!with->is_array())
+                    return Err(std::string("Property \"with\" must be an array"));
+            }
+        }
+        else if(json.contains("score"))
+        {
+            auto& val = json["score"];
+            if(!val.is_object())
+                return Err(std::string("Property \"score\" must be an object"));
+
+            // Numbers and booleans are taken as strings, as they are.
+            auto score = std::make_unique<Score>();
+            auto part = [&val](const char* key, Text& text)
+            {
+                if(!val.contains(key))
+                    return false;
+                auto& part = val[key];
+                if(part.is_string())
+                    text = Text::owned(part.get_ref<const std::string&>());
+                else if(part.is_number() || part.is_boolean())
+                    text = Text::owned(part.dump());
+                else
+                    return false;
+                return true;
+            };
+
+            auto has_value = val.contains("value");
+            if(!part("name", score->name) || !part("objective", score->objective)
+               || (has_value && !part("value", score->value)))
+                return Err(std::string("A score needs a name and an objective, which must be strings"));
+
+            comp.m_type = Type::Score;
+            comp.m_text = score->value;
+            comp.m_score = std::move(score);
+        }
+        else if(json.contains("selector"))
+        {
+            auto& val = json["selector"];
+            comp.m_type = Type::Selector;
+            if(val.is_string())
+                comp.m_text = Text::owned(val.get_ref<const std::string&>());
+        }
         else
         {
             return Err(std::string("Imcomplete or unsupported component"));
@@ -83,228 +271,281 @@ namespace LibSoprano
 
         if(json.contains("bold"))
         {
-            auto val = json["bold"];
+            auto& val = json["bold"];
             if(!val.is_boolean())
                 return Err(std::string("Property \"bold\" must be a boolean"));
-            comp.m_bold = val.get<bool>();
+            comp.m_style.set(Style::Flag::Bold, val.get<bool>());
         }
 
         if(json.contains("italic"))
         {
-            auto val = json["italic"];
+            auto& val = json["italic"];
             if(!val.is_boolean())
                 return Err(std::string("Property \"italic\" must be a boolean"));
-            comp.m_italic = val.get<bool>();
+            comp.m_style.set(Style::Flag::Italic, val.get<bool>());
         }
 
         if(json.contains("underlined"))
         {
-            auto val = json["underlined"];
+            auto& val = json["underlined"];
             if(!val.is_boolean())
                 return Err(std::string("Property \"underlined\" must be a boolean"));
-            comp.m_underlined = val.get<bool>();
+            comp.m_style.set(Style::Flag::Underlined, val.get<bool>());
         }
 
         if(json.contains("strikethrough"))
         {
-            auto val = json["strikethrough"];
+            auto& val = json["strikethrough"];
             if(!val.is_boolean())
                 return Err(std::string("Property \"strikethrough\" must be a boolean"));
-            comp.m_strikethrough = val.get<bool>();
+            comp.m_style.set(Style::Flag::Strikethrough, val.get<bool>());
         }
 
         if(json.contains("obfuscated"))
         {
-            auto val = json["obfuscated"];
+            auto& val = json["obfuscated"];
             if(!val.is_boolean())
                 return Err(std::string("Property \"obfuscated\" must be a boolean"));
-            comp.m_obfuscated = val.get<bool>();
+            comp.m_style.set(Style::Flag::Obfuscated, val.get<bool>());
         }
 
         if(json.contains("color"))
         {
-            auto val = json["color"];
+            auto& val = json["color"];
             if(val.is_string())
             {
-                auto col_str = val.get<std::string>();
-                if(col_str.rfind("#") == 0)
-                {
-                    unsigned long color;
-                    try
-                    {
-                        // FIXME: This won't throw if it encounters a non-base-16 character
-                        // after the first character, and will simply return the value up
-                        // until encountering it. That's not right! (I'm not even sure the
-                        // use case for that...)
-                        color = std::stoul(col_str.substr(1), nullptr, 16);
-                    }
-                    catch(std::logic_error&)
-                    {
-                        return Err(fmt::format("Invalid \"color\" hexadecimal property ({})", col_str));
-                    }
-
-                    comp.m_color = Color(color);
-                }
-                else
-                {
-                    auto color = Color::from_name(col_str.c_str());
-                    if(!color)
-                        return Err(fmt::format("Invalid \"color\" name property ({})", col_str));
-                    comp.m_color = *color;
-                }
+                auto& col_str = val.get_ref<const std::string&>();
+                auto color = parse_color(col_str);
+                if(color.isErr())
+                    return Err(ParseError::color_message(color.unwrapErr(), col_str));
+                comp.m_color = color.unwrap();
             }
         }
 
+        nlohmann::json* extra = nullptr;
         if(json.contains("extra"))
         {
-            auto val = json["extra"];
-            if(!val.is_array())
+            extra = &json["extra"];
+            if(!extra->is_array())
                 return Err(std::string("Property \"extra\" must be an array"));
-
-            for(auto comp_json : val)
-            {
-                auto child_comp = ChatComponent::parse(comp_json);
-                if(child_comp.isErr())
-                    return child_comp;
-
-                comp.m_children.push_back(child_comp.unwrap());
-            }
         }
 
-        return Ok(comp);
+        return Ok(extra);
     }
 
-    std::string ChatComponent::to_ansi_string(bool escape, bool reset, ChatComponent* parent)
+    Result<ChatComponent, ChatComponent::Error> ChatComponent::parse(json& json, const Limits& limits)
     {
-        auto use_color = m_color && m_color->ansi_color();
-        std::stringstream buffer;
-
-        auto insert_escape = [escape, &buffer]()
+        // The children (or arguments) of each component being parsed, and which one is next.
+        struct Frame
         {
-            if(escape)
-                buffer << Color::m_ansi_escape_escaped;
-            else
-                buffer << Color::m_ansi_escape;
+            nlohmann::json* array;
+            std::size_t next_child;
+            std::vector<ChatComponent>* children;
+            bool arguments;
         };
 
-        if(use_color)
+        ChatComponent root;
+        std::vector<Frame> frames;
+        std::size_t node_count = 0;
+        std::size_t text_bytes = 0;
+
+        auto begin = [&](nlohmann::json& json, ChatComponent& comp, bool is_argument) -> std::optional<Error>
         {
-            insert_escape();
-            buffer << m_color->ansi_color();
-        }
+            auto limit_error = [](ParseError::Code code)
+            {
+                return ParseError(code, 0).message({});
+            };
 
-        buffer << m_text;
+            if(++node_count > limits.max_nodes)
+                return limit_error(ParseError::Code::TooManyNodes);
+            if(frames.size() + 1 > limits.max_depth)
+                return limit_error(ParseError::Code::TooDeep);
 
-        for(auto comp : m_children)
-        {
-            buffer << comp.to_ansi_string(escape, false, this);
-            if(use_color && parent && parent->color() && parent->color()->ansi_color())
+            // An argument that isn't an object is the same as a component with it as its text.
+            if(is_argument && (json.is_string() || json.is_number() || json.is_boolean()))
             {
-                insert_escape();
-                buffer << parent->color()->ansi_color();
+                comp.m_text = Text::owned(json.is_string() ? json.get_ref<const std::string&>() : json.dump());
+                text_bytes += comp.text().size();
+                if(text_bytes > limits.max_text_bytes)
+                    return limit_error(ParseError::Code::TooMuchText);
+                return {};
             }
-        }
 
-        if(reset)
+            nlohmann::json* with;
+            auto extra = parse_properties(json, comp, with);
+            if(extra.isErr())
+                return std::move(extra.storage().get<Error>());
+
+            text_bytes += comp.text().size();
+            if(auto score = comp.score())
+                text_bytes += score->name.view().size() + score->objective.view().size();
+            if(text_bytes > limits.max_text_bytes)
+                return limit_error(ParseError::Code::TooMuchText);
+
+            // Children never move once they're there, since we reserve up
+            // front. The arguments go on top, so that they're parsed first.
+            if(auto array = extra.storage().get<nlohmann::json*>())
+            {
+                comp.m_children.reserve(array->size());
+                frames.push_back({array, 0, &comp.m_children, false});
+            }
+            if(with)
+            {
+                comp.m_arguments.reserve(with->size());
+                frames.push_back({with, 0, &comp.m_arguments, true});
+            }
+
+            return {};
+        };
+
+        if(auto error = begin(json, root, false))
+            return Err(std::move(*error));
+
+        while(!frames.empty())
         {
-            insert_escape();
-            buffer << Color::m_ansi_reset;
+            auto& frame = frames.back();
+            if(frame.next_child == frame.array->size())
+            {
+                frames.pop_back();
+                continue;
+            }
+
+            auto& child_json = (*frame.array)[frame.next_child++];
+            auto& child = frame.children->emplace_back();
+            if(auto error = begin(child_json, child, frame.arguments))
+                return Err(std::move(*error));
         }
 
-        return buffer.str();
+        return Ok(std::move(root));
     }
 
-    std::string ChatComponent::to_html_string()
+    ChatComponent::ChatComponent(const ChatComponent& other) : ChatComponent(other, Shallow{})
     {
-        std::stringstream html_buffer;
-        std::stringstream style_buffer;
-
-        html_buffer << "<span style=\"";
-
-        if(m_color)
-            style_buffer << fmt::format("color: #{:x};", m_color->foreground());
+        struct Pending
+        {
+            const ChatComponent* from;
+            ChatComponent* to;
+        };
 
-        if(m_bold)
+        std::vector<Pending> pending{{&other, this}};
+        while(!pending.empty())
         {
-            style_buffer << "font-weight: ";
-            if(*m_bold)
-                style_buffer << "bold;";
-            else
-                style_buffer << "normal;";
+            auto [from, to] = pending.back();
+            pending.pop_back();
+
+            auto copy = [&pending](const std::vector<ChatComponent>& from, std::vector<ChatComponent>& to)
+            {
+                to.reserve(from.size());
+                for(auto& child : from)
+                    to.push_back(ChatComponent(child, Shallow{}));
+                for(std::size_t i = 0; i < from.size(); i++)
+                {
+                    if(!from[i].m_children.empty() || !from[i].m_arguments.empty())
+                        pending.push_back({&from[i], &to[i]});
+                }
+            };
+            copy(from->m_children, to->m_children);
+            copy(from->m_arguments, to->m_arguments);
         }
+    }
+
+    ChatComponent& ChatComponent::operator=(const ChatComponent& other)
+    {
+        if(this != &other)
+            *this = ChatComponent(other);
+        return *this;
+    }
 
-        if(m_italic)
+    ChatComponent::~ChatComponent()
+    {
+        // Without any grandchildren, the children's own destructors have
+        // nothing to recurse into. Arguments count as children here.
+        auto has_grandchildren = false;
+        for(auto* children : {&m_children, &m_arguments})
         {
-            style_buffer << "font-style: ";
-            if(*m_italic)
-                 style_buffer << "italic;";
-            else
-                style_buffer << "normal;";
+            for(auto& child : *children)
+                has_grandchildren |= !child.m_children.empty() || !child.m_arguments.empty();
         }
+        if(!has_grandchildren)
+            return;
 
-        if(m_underlined)
+        auto pending = std::move(m_children);
+        for(auto& argument : m_arguments)
+            pending.push_back(std::move(argument));
+        while(!pending.empty())
         {
-            style_buffer << "text-decoration-line: ";
-            if(*m_underlined)
-                 style_buffer << "underline;";
-            else
-                style_buffer << "inherit;";
+            auto children = std::move(pending.back().m_children);
+            auto arguments = std::move(pending.back().m_arguments);
+            pending.pop_back();
+            for(auto& child : children)
+                pending.push_back(std::move(child));
+            for(auto& argument : arguments)
+                pending.push_back(std::move(argument));
         }
+    }
 
-        html_buffer << style_buffer.str() << "\">" << m_text;
+    bool ChatComponent::render_ansi(Sink& sink, bool escape, AnsiRenderer::ColorDepth depth) const
+    {
+        return AnsiRenderer(escape, depth).render(*this, sink);
+    }
 
-        for(auto comp : m_children)
-            html_buffer << comp.to_html_string();
+    bool ChatComponent::render_html(Sink& sink) const
+    {
+        return HtmlRenderer().render(*this, sink);
+    }
 
-        html_buffer << "</span>";
+    std::string ChatComponent::to_ansi_string(bool escape, AnsiRenderer::ColorDepth depth) const
+    {
+        std::string buffer;
+        StringSink sink(buffer);
+        render_ansi(sink, escape, depth);
+        return buffer;
+    }
 
-        return html_buffer.str();
+    std::string ChatComponent::to_html_string() const
+    {
+        std::string buffer;
+        StringSink sink(buffer);
+        render_html(sink);
+        return buffer;
     }
 
-    void ChatComponent::draw_imgui(ChatComponent::FontOptions* font_opts, bool same_line)
+    bool ChatComponent::render_legacy(Sink& sink, LegacyRenderer::HexColors hex_colors) const
     {
-        if(m_color)
-            ImGui::PushStyleColor(ImGuiCol_Text, (swap_endian(m_color->foreground()) >> 8) | 0xFF000000);
-
-        // TODO: make this code disappear. it's hideous.
-        if(bold() && !italic() && *bold())
-            ImGui::PushFont(font_opts->bold);
-        else if(italic() && !bold() && *italic())
-            ImGui::PushFont(font_opts->italic);
-        else if(bold() && italic())
-        {
-            if(*bold() && !*italic())
-                ImGui::PushFont(font_opts->bold);
-            else if(!*bold() && *italic())
-                ImGui::PushFont(font_opts->italic);
-            else if(*bold() && *italic())
-                ImGui::PushFont(font_opts->bold_italic);
-            else
-                ImGui::PushFont(font_opts->regular);
-        }
-        else if(bold() && !italic() && !*bold())
-            ImGui::PushFont(font_opts->regular);
-        else if(!bold() && italic() && !*italic())
-            ImGui::PushFont(font_opts->regular);
-        else if(bold() && italic() && !*bold() && !*italic())
-            ImGui::PushFont(font_opts->regular);
-        else
-            ImGui::PushFont(font_opts->regular);
+        return LegacyRenderer(hex_colors).render(*this, sink);
+    }
 
-        // FIXME: Each time we call TextWrapped, it stores the location at which
-        // it wants to wrap back to, which is under the starting character. We
-        // actually want it under the starting character of the FIRST call to this,
-        // so it wraps under the initial parent, and not under it's own start.
-        if(same_line)
-            ImGui::SameLine(0.0f, 0.0f);
-        ImGui::TextWrapped("%s", m_text.c_str());
+    std::string ChatComponent::to_legacy_string(LegacyRenderer::HexColors hex_colors) const
+    {
+        std::string buffer;
+        StringSink sink(buffer);
+        render_legacy(sink, hex_colors);
+        return buffer;
+    }
 
-        for(auto comp : m_children)
-            comp.draw_imgui(font_opts, true);
+    bool ChatComponent::write_json(Sink& sink, JsonWriter::Mode mode) const
+    {
+        return JsonWriter(mode).render(*this, sink);
+    }
 
-        if(m_color)
-            ImGui::PopStyleColor();
+    std::string ChatComponent::to_json(JsonWriter::Mode mode) const
+    {
+        std::string buffer;
+        StringSink sink(buffer);
+        write_json(sink, mode);
+        return buffer;
+    }
 
-        ImGui::PopFont();
+    bool ChatComponent::write_nbt(Sink& sink) const
+    {
+        return NbtWriter().write(*this, sink);
+    }
+
+    std::string ChatComponent::to_nbt() const
+    {
+        std::string buffer;
+        StringSink sink(buffer);
+        write_nbt(sink);
+        return buffer;
     }
 }
@@ -16,20 +16,38 @@
 
 #pragma once
 #include "result.h"
+#include "AnsiRenderer.h"
 #include "Color.h"
+#include "InlineStack.h"
+#include "JsonWriter.h"
+#include "LanguageTable.h"
+#include "LegacyRenderer.h"
+#include "Limits.h"
+#include "ParseError.h"
+#include "RenderNode.h"
+#include "Sink.h"
+#include "Style.h"
+#include "Text.h"
+#include <memory>
 #include <string>
+#include <string_view>
 #include <optional>
-#include <json.hpp>
-#include <imgui/imgui.h>
+#include <json_fwd.hpp>
 
 namespace LibSoprano
 {
     class ChatComponent
     {
+        template<typename, typename>
+        friend class ChatComponentParser;
+        friend class ChatComponentBuilder;
+        friend class EntitySnapshot;
+        friend class Scoreboard;
+
     public:
         using Error = std::string;
 
-        enum class Type
+        enum class Type : uint8_t
         {
             String,
             Translation,
@@ -38,43 +56,220 @@ namespace LibSoprano
             Selector
         };
 
-        struct FontOptions
+        // Whose score in which objective a score component shows, and what it
+        // shows without a scoreboard to look it up in (see Scoreboard.h).
+        struct Score
         {
-            ImFont* regular = nullptr;
-            ImFont* bold = nullptr;
-            ImFont* italic = nullptr;
-            ImFont* bold_italic = nullptr;
+            Text name;
+            Text objective;
+            Text value;
         };
 
+        // Every way of parsing enforces limits (see Limits.h), which are the
+        // defaults unless given. Syntax errors from parse(std::string&) read as
+        // nlohmann's do, and from the rest as "Syntax error at byte N: ...".
         static Result<ChatComponent, Error> parse(std::string&);
-        static Result<ChatComponent, Error> parse(nlohmann::json&);
+        static Result<ChatComponent, Error> parse(nlohmann::json&, const Limits& = {});
+        // Parses without copying any text that doesn't need unescaping: the
+        // component borrows it from raw_json, which must outlive it.
+        static Result<ChatComponent, Error> parse_borrowed(std::string_view raw_json);
+        // Never throws, nor allocates for a failure, which makes it the one to use
+        // on untrusted input. If borrow_text is set, this borrows like parse_borrowed.
+        static Result<ChatComponent, ParseError> try_parse(std::string_view raw_json, bool borrow_text = false,
+                                                           const Limits& = {}) noexcept;
+        // The same for a component in network NBT (see NbtReader.h). Anything
+        // after it is left alone; if size is given, it's set to how many bytes
+        // the component took.
+        static Result<ChatComponent, Error> parse_nbt(std::string_view nbt);
+        static Result<ChatComponent, ParseError> try_parse_nbt(std::string_view nbt, bool borrow_text = false,
+                                                               const Limits& = {}, std::size_t* size = nullptr) noexcept;
+        // The same for legacy text formatted with § codes (see LegacyText.h),
+        // which only fails on exceeding the limits.
+        static Result<ChatComponent, Error> parse_legacy(std::string_view text);
+        static Result<ChatComponent, ParseError> try_parse_legacy(std::string_view text, bool borrow_text = false,
+                                                                  const Limits& = {}) noexcept;
+
+        ChatComponent() = default;
+        // Copying and destroying work through a list of pending components,
+        // so that no amount of nesting recurses.
+        ChatComponent(const ChatComponent&);
+        ChatComponent(ChatComponent&&) noexcept = default;
+        ChatComponent& operator=(const ChatComponent&);
+        ChatComponent& operator=(ChatComponent&&) noexcept = default;
+        ~ChatComponent();
 
-        const std::optional<bool>& bold() const { return m_bold; }
-        const std::optional<bool>& italic() const { return m_italic; }
-        const std::optional<bool>& underlined() const { return m_underlined; }
-        const std::optional<bool>& strikethrough() const { return m_strikethrough; }
-        const std::optional<bool>& obfuscated() const { return m_obfuscated; }
+        Style style() const { return m_style; }
+        std::optional<bool> bold() const { return m_style.bold(); }
+        std::optional<bool> italic() const { return m_style.italic(); }
+        std::optional<bool> underlined() const { return m_style.underlined(); }
+        std::optional<bool> strikethrough() const { return m_style.strikethrough(); }
+        std::optional<bool> obfuscated() const { return m_style.obfuscated(); }
         const std::optional<Color>& color() const { return m_color; }
-        Type type() { return m_type; }
-        const std::string& text() const { return m_text; }
+        Type type() const { return m_type; }
+        // For a translation, this is its key, for a score, what it shows, and
+        // for a selector, the selector (see EntitySnapshot.h).
+        std::string_view text() const { return m_text.view(); }
+        // Only set for scores.
+        const Score* score() const { return m_type == Type::Score ? m_score.get() : nullptr; }
         const std::vector<ChatComponent>& children() const { return m_children; }
+        // What a translation's format puts in place of %s ("with").
+        const std::vector<ChatComponent>& arguments() const { return m_arguments; }
+
+        // These return false if the sink failed part way through.
+        bool render_ansi(Sink&, bool escape = false, AnsiRenderer::ColorDepth = AnsiRenderer::ColorDepth::TrueColor) const;
+        bool render_html(Sink&) const;
+        std::string to_ansi_string(bool escape = false, AnsiRenderer::ColorDepth = AnsiRenderer::ColorDepth::TrueColor) const;
+        std::string to_html_string() const;
+        bool render_legacy(Sink&, LegacyRenderer::HexColors = LegacyRenderer::HexColors::Sequence) const;
+        std::string to_legacy_string(LegacyRenderer::HexColors = LegacyRenderer::HexColors::Sequence) const;
+        // Writes the component back out as JSON (see JsonWriter.h).
+        bool write_json(Sink&, JsonWriter::Mode = JsonWriter::Mode::Minified) const;
+        std::string to_json(JsonWriter::Mode = JsonWriter::Mode::Minified) const;
+        // Writes the component as network NBT (see NbtWriter.h).
+        bool write_nbt(Sink&) const;
+        std::string to_nbt() const;
+
+        // Visits this component and its children in document order (see
+        // RenderNode.h). Returns false if the visitor stopped early.
+        //
+        // A translation is visited with no text of its own, followed by the
+        // pieces of its format in the given language (literal text, and its
+        // arguments), and then its children. Without a language, or a
+        // translation of its key, it's visited as its key. Visitors with a
+        // keeps_translations member see translations as they are instead:
+        // their key as text, then their arguments, then their children. A
+        // score is visited with what it shows as its text, which is only its
+        // score once it's been resolved (see Scoreboard::resolve), and a
+        // selector as the selector, since resolving one turns it into text.
+        template<typename Visitor>
+        bool walk(Visitor& visitor, const LanguageTable* language = nullptr) const
+        {
+            constexpr bool keeps_translations = requires { Visitor::keeps_translations; };
+
+            struct Frame
+            {
+                const ChatComponent* component;
+                // What's left of a resolved translation's format...
+                const LanguageTable::Segment* next_segment;
+                const LanguageTable::Segment* end_segment;
+                // ...or of the arguments of one that's kept as it is.
+                std::size_t next_argument;
+                std::size_t next_child;
+            };
+
+            InlineStack<Frame> frames;
+            // Leaves straight away if there's nothing inside the component.
+            auto enter = [&](const ChatComponent& component, bool is_argument)
+            {
+                Frame frame{&component, nullptr, nullptr, component.m_arguments.size(), 0};
+                auto node = component.render_node();
+                node.is_argument = is_argument;
+                ScoreSource score;
+                if(auto source = component.score())
+                {
+                    score = {source->name.view(), source->objective.view()};
+                    node.score = &score;
+                }
+                node.is_selector = component.m_type == Type::Selector;
+                if(component.m_type == Type::Translation)
+                {
+                    if constexpr(keeps_translations)
+                    {
+                        node.is_translation = true;
+                        frame.next_argument = 0;
+                    }
+                    else if(auto translation = language ? language->find(node.text) : std::nullopt)
+                    {
+                        if(translation->argument_count > component.m_arguments.size())
+                        {
+                            node.text = translation->format;
+                        }
+                        else
+                        {
+                            node.text = {};
+                            frame.next_segment = translation->segments;
+                            frame.end_segment = translation->segments + translation->segment_count;
+                        }
+                    }
+                }
+
+                if(!visitor.enter(node))
+                    return false;
+
+                if(frame.next_segment == frame.end_segment && frame.next_argument == component.m_arguments.size()
+                   && component.m_children.empty())
+                    visitor.leave(node);
+                else
+                    frames.push(frame);
+                return true;
+            };
+
+            if(!enter(*this, false))
+                return false;
+
+            while(!frames.empty())
+            {
+                auto& frame = frames.top();
+                auto& component = *frame.component;
+                if(frame.next_segment != frame.end_segment)
+                {
+                    auto& segment = *frame.next_segment++;
+                    if(segment.is_argument())
+                    {
+                        if(!enter(component.m_arguments[segment.argument()], false))
+                            return false;
+                    }
+                    else
+                    {
+                        // Literal text inherits everything from the translation.
+                        RenderNode literal{language->text(segment), std::nullopt, {}};
+                        if(!visitor.enter(literal))
+                            return false;
+                        visitor.leave(literal);
+                    }
+                }
+                else if(frame.next_argument < component.m_arguments.size())
+                {
+                    if(!enter(component.m_arguments[frame.next_argument++], true))
+                        return false;
+                }
+                else if(frame.next_child < component.m_children.size())
+                {
+                    if(!enter(component.m_children[frame.next_child++], false))
+                        return false;
+                }
+                else
+                {
+                    visitor.leave(component.render_node());
+                    frames.pop();
+                }
+            }
+
+            return true;
+        }
 
-        std::string to_ansi_string(bool escape = false, bool reset = true, ChatComponent* parent = nullptr);
-        std::string to_html_string();
-        void draw_imgui(FontOptions* = nullptr, bool same_line = false);
     private:
-        // These are optional as they might not be present.
-        // If they aren't present, they either inherit their
-        // parent, or defaults to false.
-        std::optional<bool> m_bold;
-        std::optional<bool> m_italic;
-        std::optional<bool> m_underlined;
-        std::optional<bool> m_strikethrough;
-        std::optional<bool> m_obfuscated;
-        std::optional<Color> m_color;
-        Type m_type;
-        std::string m_text;
+        // Copies everything but the children and arguments.
+        struct Shallow {};
+        ChatComponent(const ChatComponent& other, Shallow)
+            : m_text(other.m_text), m_score(other.m_score ? std::make_unique<Score>(*other.m_score) : nullptr),
+              m_color(other.m_color), m_style(other.m_style), m_type(other.m_type) {}
+
+        // Sets everything but the children from json (a score's too),
+        // returning its "extra" array if it has one, and setting with to a
+        // translation's "with" array if it has one.
+        static Result<nlohmann::json*, Error> parse_properties(nlohmann::json&, ChatComponent&, nlohmann::json*& with);
+        RenderNode render_node() const { return {text(), m_color, m_style}; }
 
+        static Result<Color, ParseError::Code> parse_color(std::string_view) noexcept;
+
+        // Ordered largest first, so that there's no padding in between.
+        Text m_text;
         std::vector<ChatComponent> m_children;
+        std::vector<ChatComponent> m_arguments;
+        std::unique_ptr<Score> m_score;
+        std::optional<Color> m_color;
+        Style m_style;
+        Type m_type = Type::String;
     };
 }
@@ -0,0 +1,639 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "ChatComponentParser.h"
+#include <bit>
+#include <cstring>
+
+namespace LibSoprano
+{
+    template<typename Builder, typename Reader>
+    typename ChatComponentParser<Builder, Reader>::Property
+    ChatComponentParser<Builder, Reader>::property_from_key(std::string_view key)
+    {
+        auto is = [&key](const char* name, std::size_t length)
+        {
+            return memcmp(key.data(), name, length) == 0;
+        };
+
+        switch(key.size())
+        {
+            case 4:
+                if(is("text", 4))
+                    return Property::Text;
+                if(is("bold", 4))
+                    return Property::Bold;
+                if(Builder::has_translations && is("with", 4))
+                    return Property::With;
+                break;
+            case 5:
+                if(is("color", 5))
+                    return Property::Color;
+                if(is("extra", 5))
+                    return Property::Extra;
+                if(Builder::has_scores && is("score", 5))
+                    return Property::Score;
+                break;
+            case 6:
+                if(is("italic", 6))
+                    return Property::Italic;
+                break;
+            case 8:
+                if(Builder::has_selectors && is("selector", 8))
+                    return Property::Selector;
+                break;
+            case 9:
+                if(Builder::has_translations && is("translate", 9))
+                    return Property::Translate;
+                break;
+            case 10:
+                if(is("underlined", 10))
+                    return Property::Underlined;
+                if(is("obfuscated", 10))
+                    return Property::Obfuscated;
+                break;
+            case 13:
+                if(is("strikethrough", 13))
+                    return Property::Strikethrough;
+                break;
+        }
+
+        return Property::Unknown;
+    }
+
+    template<typename Builder, typename Reader>
+    bool ChatComponentParser<Builder, Reader>::begin_component(typename Builder::Node node)
+    {
+        ParseError::Code exceeded = ParseError::Code::None;
+        if(++m_node_count > m_limits.max_nodes)
+            exceeded = ParseError::Code::TooManyNodes;
+        else if(next_depth() > m_limits.max_depth)
+            exceeded = ParseError::Code::TooDeep;
+
+        if(exceeded != ParseError::Code::None)
+        {
+            m_error = {exceeded, value_offset()};
+            return false;
+        }
+
+        m_frames.push_back({node, value_offset()});
+        return true;
+    }
+
+    template<typename Builder, typename Reader>
+    bool ChatComponentParser<Builder, Reader>::plain_argument(std::string_view text, bool borrowed)
+    {
+        if constexpr(Builder::has_translations)
+        {
+            // Counted like any other component.
+            ParseError::Code exceeded = ParseError::Code::None;
+            if(++m_node_count > m_limits.max_nodes)
+                exceeded = ParseError::Code::TooManyNodes;
+            else if(next_depth() > m_limits.max_depth)
+                exceeded = ParseError::Code::TooDeep;
+            else if((m_text_bytes += text.size()) > m_limits.max_text_bytes)
+                exceeded = ParseError::Code::TooMuchText;
+
+            if(exceeded != ParseError::Code::None)
+            {
+                m_error = {exceeded, value_offset()};
+                return false;
+            }
+
+            auto node = m_builder.begin_argument(m_frames.back().node);
+            m_builder.set_text(node, text, m_borrow_text && borrowed);
+            m_builder.end(node);
+        }
+        return true;
+    }
+
+    template<typename Builder, typename Reader>
+    void ChatComponentParser<Builder, Reader>::set_flag(Frame& frame, Style::Flag flag, Property property, const bool* boolean)
+    {
+        if(boolean)
+        {
+            m_builder.set_flag(frame.node, flag, *boolean);
+            frame.invalid &= ~bit(property);
+        }
+        else
+        {
+            set_invalid(frame, property);
+        }
+    }
+
+    template<typename Builder, typename Reader>
+    void ChatComponentParser<Builder, Reader>::set_invalid(Frame& frame, Property property)
+    {
+        frame.invalid |= bit(property);
+        frame.invalid_offsets[static_cast<uint8_t>(property)] = value_offset();
+    }
+
+    template<typename Builder, typename Reader>
+    void ChatComponentParser<Builder, Reader>::child_error(Frame& parent, ParseError error)
+    {
+        // Children are parsed in order, so the first one to fail is the one reported.
+        if(!parent.child_error)
+            parent.child_error = error;
+    }
+
+    template<typename Builder, typename Reader>
+    bool ChatComponentParser<Builder, Reader>::score_value(Frame& frame, const std::string_view* string, bool borrowed,
+                                                           const bool* boolean, bool is_container)
+    {
+        if constexpr(Builder::has_scores)
+        {
+            auto part = frame.score_part;
+            frame.score_part = ScorePart::None;
+            auto part_bit = static_cast<uint8_t>(1 << static_cast<uint8_t>(part));
+            if(part != ScorePart::None && (string || boolean))
+            {
+                // Booleans (and numbers, which come in as strings) are taken as they are.
+                auto text = string ? *string : *boolean ? "true" : "false";
+                m_text_bytes += text.size();
+                if(m_text_bytes > m_limits.max_text_bytes)
+                {
+                    m_error = {ParseError::Code::TooMuchText, value_offset()};
+                    return false;
+                }
+                m_builder.set_score(frame.node, part, text, string ? m_borrow_text && borrowed : true);
+                frame.score_parts |= part_bit;
+                frame.invalid_score_parts &= ~part_bit;
+            }
+            else if(part != ScorePart::None)
+            {
+                frame.score_parts &= ~part_bit;
+                frame.invalid_score_parts |= part_bit;
+                frame.invalid_score_offsets[static_cast<uint8_t>(part)] = value_offset();
+            }
+        }
+
+        if(is_container)
+            m_skip_depth++;
+        return true;
+    }
+
+    template<typename Builder, typename Reader>
+    bool ChatComponentParser<Builder, Reader>::value(const std::string_view* string, bool borrowed, const bool* boolean,
+                                             bool is_object, bool is_array)
+    {
+        if(m_skip_depth > 0)
+        {
+            if(is_object || is_array)
+                m_skip_depth++;
+            return true;
+        }
+
+        if(!m_root_started)
+        {
+            m_root_started = true;
+            if(is_object)
+                return begin_component(m_builder.begin_root());
+
+            m_error = {ParseError::Code::NotAnObject, value_offset()};
+            if(is_array)
+                m_skip_depth++;
+            return true;
+        }
+
+        auto& frame = m_frames.back();
+
+        if(frame.in_score)
+            return score_value(frame, string, borrowed, boolean, is_object || is_array);
+
+        if(frame.in_with)
+        {
+            if constexpr(Builder::has_translations)
+            {
+                if(is_object)
+                    return begin_component(m_builder.begin_argument(frame.node));
+                if(string)
+                    return plain_argument(*string, borrowed);
+                if(boolean)
+                    return plain_argument(*boolean ? "true" : "false", true);
+            }
+
+            if(!frame.argument_error)
+                frame.argument_error = {ParseError::Code::IncompleteComponent, value_offset()};
+            if(is_array)
+                m_skip_depth++;
+            return true;
+        }
+
+        if(frame.in_extra)
+        {
+            if(is_object)
+                return begin_component(m_builder.begin_child(frame.node));
+
+            child_error(frame, {ParseError::Code::IncompleteComponent, value_offset()});
+            if(is_array)
+                m_skip_depth++;
+            return true;
+        }
+
+        auto property = frame.property;
+        frame.property = Property::Unknown;
+
+        switch(property)
+        {
+            case Property::Text:
+                frame.has_text = true;
+                if(string)
+                {
+                    m_text_bytes += string->size();
+                    if(m_text_bytes > m_limits.max_text_bytes)
+                    {
+                        m_error = {ParseError::Code::TooMuchText, value_offset()};
+                        return false;
+                    }
+                    m_builder.set_text(frame.node, *string, m_borrow_text && borrowed);
+                }
+                else
+                {
+                    m_builder.set_text(frame.node, {}, true);
+                }
+                break;
+            case Property::Bold:
+                set_flag(frame, Style::Flag::Bold, property, boolean);
+                break;
+            case Property::Italic:
+                set_flag(frame, Style::Flag::Italic, property, boolean);
+                break;
+            case Property::Underlined:
+                set_flag(frame, Style::Flag::Underlined, property, boolean);
+                break;
+            case Property::Strikethrough:
+                set_flag(frame, Style::Flag::Strikethrough, property, boolean);
+                break;
+            case Property::Obfuscated:
+                set_flag(frame, Style::Flag::Obfuscated, property, boolean);
+                break;
+            case Property::Color:
+                frame.color_error = {};
+                m_builder.set_color(frame.node, {});
+                if(string)
+                {
+                    auto color = ChatComponent::parse_color(*string);
+                    if(color.isOk())
+                    {
+                        if(!m_builder.set_color(frame.node, color.storage().get<Color>()))
+                        {
+                            m_error = {ParseError::Code::TooManyColors, value_offset()};
+                            return false;
+                        }
+                    }
+                    else
+                        frame.color_error = {color.storage().get<ParseError::Code>(), value_offset()};
+                }
+                break;
+            case Property::Extra:
+                if(is_array)
+                {
+                    m_builder.clear_children(frame.node);
+                    frame.child_error = {};
+                    frame.invalid &= ~bit(property);
+                    frame.in_extra = true;
+                    return true;
+                }
+                set_invalid(frame, property);
+                break;
+            case Property::Translate:
+                if constexpr(Builder::has_translations)
+                {
+                    // "text" wins over "translate", wherever either of them is.
+                    if(frame.has_text)
+                        break;
+                    frame.has_translation = true;
+                    if(string)
+                    {
+                        m_text_bytes += string->size();
+                        if(m_text_bytes > m_limits.max_text_bytes)
+                        {
+                            m_error = {ParseError::Code::TooMuchText, value_offset()};
+                            return false;
+                        }
+                        m_builder.set_translation(frame.node, *string, m_borrow_text && borrowed);
+                    }
+                    else
+                    {
+                        m_builder.set_translation(frame.node, {}, true);
+                    }
+                }
+                break;
+            case Property::With:
+                if constexpr(Builder::has_translations)
+                {
+                    if(is_array)
+                    {
+                        m_builder.clear_arguments(frame.node);
+                        frame.argument_error = {};
+                        frame.invalid &= ~bit(property);
+                        frame.in_with = true;
+                        return true;
+                    }
+                    set_invalid(frame, property);
+                }
+                break;
+            case Property::Score:
+                if constexpr(Builder::has_scores)
+                {
+                    // Like "translate", "text" wins over "score", and so does "translate".
+                    if(frame.has_text || frame.has_translation)
+                        break;
+                    frame.has_score = true;
+                    if(is_object)
+                    {
+                        m_builder.begin_score(frame.node);
+                        frame.invalid &= ~bit(property);
+                        frame.in_score = true;
+                        frame.score_parts = 0;
+                        frame.invalid_score_parts = 0;
+                        frame.score_offset = value_offset();
+                        return true;
+                    }
+                    set_invalid(frame, property);
+                }
+                break;
+            case Property::Selector:
+                if constexpr(Builder::has_selectors)
+                {
+                    // Anything else a component can be wins over a selector.
+                    if(frame.has_text || frame.has_translation || frame.has_score)
+                        break;
+                    frame.has_selector = true;
+                    if(string)
+                    {
+                        m_text_bytes += string->size();
+                        if(m_text_bytes > m_limits.max_text_bytes)
+                        {
+                            m_error = {ParseError::Code::TooMuchText, value_offset()};
+                            return false;
+                        }
+                        m_builder.set_selector(frame.node, *string, m_borrow_text && borrowed);
+                    }
+                    else
+                    {
+                        m_builder.set_selector(frame.node, {}, true);
+                    }
+                }
+                break;
+            case Property::Unknown:
+            case Property::Count:
+                break;
+        }
+
+        if(is_object || is_array)
+            m_skip_depth++;
+        return true;
+    }
+
+    template<typename Builder, typename Reader>
+    bool ChatComponentParser<Builder, Reader>::null()
+    {
+        return value(nullptr, false, nullptr);
+    }
+
+    template<typename Builder, typename Reader>
+    bool ChatComponentParser<Builder, Reader>::boolean(bool val)
+    {
+        return value(nullptr, false, &val);
+    }
+
+    template<typename Builder, typename Reader>
+    bool ChatComponentParser<Builder, Reader>::number(std::string_view val)
+    {
+        // Numbers only mean anything as arguments, or in a score, as they are.
+        if(in_arguments())
+            return plain_argument(val, false);
+        if(in_score())
+            return value(&val, false, nullptr);
+        return value(nullptr, false, nullptr);
+    }
+
+    template<typename Builder, typename Reader>
+    bool ChatComponentParser<Builder, Reader>::string(std::string_view val, bool borrowed)
+    {
+        return value(&val, borrowed, nullptr);
+    }
+
+    template<typename Builder, typename Reader>
+    bool ChatComponentParser<Builder, Reader>::start_object()
+    {
+        return value(nullptr, false, nullptr, true);
+    }
+
+    template<typename Builder, typename Reader>
+    bool ChatComponentParser<Builder, Reader>::key(std::string_view val)
+    {
+        if(m_skip_depth > 0)
+            return true;
+
+        auto& frame = m_frames.back();
+        if(!frame.in_score)
+        {
+            frame.property = property_from_key(val);
+        }
+        else if(val == "name")
+        {
+            frame.score_part = ScorePart::Name;
+        }
+        else if(val == "objective")
+        {
+            frame.score_part = ScorePart::Objective;
+        }
+        else if(val == "value")
+        {
+            frame.score_part = ScorePart::Value;
+        }
+        return true;
+    }
+
+    template<typename Builder, typename Reader>
+    bool ChatComponentParser<Builder, Reader>::end_object()
+    {
+        if(m_skip_depth > 0)
+        {
+            m_skip_depth--;
+            return true;
+        }
+
+        // The end of a "score" object, rather than of the component it's in.
+        if(m_frames.back().in_score)
+        {
+            m_frames.back().in_score = false;
+            return true;
+        }
+
+        auto frame = std::move(m_frames.back());
+        m_frames.pop_back();
+        m_builder.end(frame.node);
+
+        auto invalid = [&frame](Property property, ParseError::Code code, uint8_t detail = 0) -> ParseError
+        {
+            return {code, frame.invalid_offsets[static_cast<uint8_t>(property)], detail};
+        };
+        auto not_a_boolean = [&invalid](Property property, Style::Flag flag)
+        {
+            return invalid(property, ParseError::Code::NotABoolean, static_cast<uint8_t>(flag));
+        };
+
+        // Arguments only matter to translations, and are checked first, like "translate" itself.
+        // So is "score", and then its name and objective.
+        auto is_translation = !frame.has_text && frame.has_translation;
+        auto is_score = !frame.has_text && !frame.has_translation && frame.has_score;
+        auto score_part = [](ScorePart part) { return static_cast<uint8_t>(1 << static_cast<uint8_t>(part)); };
+        auto score_error = [&frame, &score_part]() -> ParseError
+        {
+            for(auto part : {ScorePart::Name, ScorePart::Objective, ScorePart::Value})
+            {
+                if(frame.invalid_score_parts & score_part(part))
+                    return {ParseError::Code::IncompleteScore, frame.invalid_score_offsets[static_cast<uint8_t>(part)]};
+            }
+            if((frame.score_parts & score_part(ScorePart::Name)) && (frame.score_parts & score_part(ScorePart::Objective)))
+                return {};
+            return {ParseError::Code::IncompleteScore, frame.score_offset};
+        };
+
+        ParseError error;
+        if(!frame.has_text && !frame.has_translation && !frame.has_score && !frame.has_selector)
+            error = {ParseError::Code::IncompleteComponent, frame.offset};
+        else if(is_translation && (frame.invalid & bit(Property::With)))
+            error = invalid(Property::With, ParseError::Code::WithNotAnArray);
+        else if(is_translation && frame.argument_error)
+            error = frame.argument_error;
+        else if(is_score && (frame.invalid & bit(Property::Score)))
+            error = invalid(Property::Score, ParseError::Code::ScoreNotAnObject);
+        else if(is_score && score_error())
+            error = score_error();
+        else if(frame.invalid & bit(Property::Bold))
+            error = not_a_boolean(Property::Bold, Style::Flag::Bold);
+        else if(frame.invalid & bit(Property::Italic))
+            error = not_a_boolean(Property::Italic, Style::Flag::Italic);
+        else if(frame.invalid & bit(Property::Underlined))
+            error = not_a_boolean(Property::Underlined, Style::Flag::Underlined);
+        else if(frame.invalid & bit(Property::Strikethrough))
+            error = not_a_boolean(Property::Strikethrough, Style::Flag::Strikethrough);
+        else if(frame.invalid & bit(Property::Obfuscated))
+            error = not_a_boolean(Property::Obfuscated, Style::Flag::Obfuscated);
+        else if(frame.color_error)
+            error = frame.color_error;
+        else if(frame.invalid & bit(Property::Extra))
+            error = invalid(Property::Extra, ParseError::Code::ExtraNotAnArray);
+        else if(frame.child_error)
+            error = frame.child_error;
+
+        if(m_frames.empty())
+        {
+            m_error = error;
+        }
+        else if(error)
+        {
+            auto& parent = m_frames.back();
+            if(!parent.in_with)
+                child_error(parent, error);
+            else if(!parent.argument_error)
+                parent.argument_error = error;
+        }
+
+        return true;
+    }
+
+    template<typename Builder, typename Reader>
+    bool ChatComponentParser<Builder, Reader>::start_array()
+    {
+        return value(nullptr, false, nullptr, false, true);
+    }
+
+    template<typename Builder, typename Reader>
+    bool ChatComponentParser<Builder, Reader>::end_array()
+    {
+        // The only arrays that aren't skipped are the "extra" or "with" of the innermost component.
+        if(m_skip_depth > 0)
+        {
+            m_skip_depth--;
+        }
+        else
+        {
+            m_frames.back().in_extra = false;
+            m_frames.back().in_with = false;
+        }
+        return true;
+    }
+
+    ChatTreeBuilder::Node ChatTreeBuilder::begin_child(Node)
+    {
+        auto index = static_cast<Node>(m_nodes.size());
+        m_nodes.emplace_back();
+        return index;
+    }
+
+    void ChatTreeBuilder::set_text(Node node, std::string_view text, bool)
+    {
+        m_nodes[node].text_offset = static_cast<uint32_t>(m_text.size());
+        m_nodes[node].text_length = static_cast<uint32_t>(text.size());
+        m_text.append(text);
+    }
+
+    bool ChatTreeBuilder::set_color(Node node, std::optional<Color> color)
+    {
+        m_nodes[node].color = ChatTree::no_color;
+        if(!color)
+            return true;
+
+        auto [it, inserted] = m_color_indices.try_emplace(std::bit_cast<uint32_t>(*color), static_cast<uint16_t>(m_colors.size()));
+        if(inserted)
+        {
+            if(m_colors.size() == ChatTree::no_color)
+            {
+                m_color_indices.erase(it);
+                return false;
+            }
+            m_colors.push_back(*color);
+        }
+        m_nodes[node].color = it->second;
+        return true;
+    }
+
+    ChatTree ChatTreeBuilder::build() const
+    {
+        // Text that was overwritten by a duplicate key, or whose component was
+        // dropped by a duplicate "extra", doesn't make it into the tree.
+        std::size_t text_size = 0;
+        for(auto& node : m_nodes)
+            text_size += node.text_length;
+
+        ChatTree tree(m_nodes.size(), m_colors.size(), text_size);
+        auto nodes = tree.m_nodes;
+        auto text = tree.m_text;
+        std::size_t text_offset = 0;
+
+        for(std::size_t i = 0; i < m_nodes.size(); i++)
+        {
+            nodes[i] = m_nodes[i];
+            memcpy(text + text_offset, m_text.data() + m_nodes[i].text_offset, m_nodes[i].text_length);
+            nodes[i].text_offset = static_cast<uint32_t>(text_offset);
+            text_offset += m_nodes[i].text_length;
+        }
+
+        memcpy(tree.m_colors, m_colors.data(), m_colors.size() * sizeof(Color));
+
+        return tree;
+    }
+
+    template class ChatComponentParser<ChatComponentBuilder>;
+    template class ChatComponentParser<ChatTreeBuilder>;
+    template class ChatComponentParser<ChatComponentBuilder, NbtReader>;
+    template class ChatComponentParser<ChatTreeBuilder, NbtReader>;
+}
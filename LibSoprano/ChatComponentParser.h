@@ -0,0 +1,280 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include "ChatComponent.h"
+#include "ChatTree.h"
+#include "JsonReader.h"
+#include "Limits.h"
+#include "NbtReader.h"
+#include "ParseError.h"
+#include "Style.h"
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace LibSoprano
+{
+    // The properties of a score component's "score" object.
+    enum class ScorePart : uint8_t
+    {
+        None,
+        Name,
+        Objective,
+        Value
+    };
+
+    // Builds a chat component straight from the events of a JsonReader,
+    // without ever materializing a json DOM. Every key is dispatched exactly
+    // once, and text can borrow from the input (see ChatComponent::parse_borrowed).
+    //
+    // The DOM parser checks the properties of a component in a fixed order
+    // (text, translate, score or selector, with, bold, ..., color, extra), and the last duplicate of a
+    // key wins. Events arrive in document order instead, so each open
+    // component remembers the outcome of every property, and the error is
+    // only picked once the component is closed. Semantic errors never stop
+    // the parse, as a syntax error anywhere in the input takes precedence.
+    // Errors are kept as a ParseError pointing at the offending value, so
+    // nothing is allocated or thrown for them. Exceeding one of the Limits is
+    // the exception: that stops the reader straight away.
+    //
+    // What actually gets built is up to the Builder, which must provide:
+    //     using Node = ...; // A handle to a component being built
+    //     Node begin_root();
+    //     Node begin_child(Node parent);
+    //     void set_text(Node, std::string_view, bool borrowed);
+    //     void set_flag(Node, Style::Flag, bool);
+    //     bool set_color(Node, std::optional<Color>); // False if there's no room for another color
+    //     void clear_children(Node);
+    //     void end(Node);
+    // Builders that can hold translations set has_translations, and also provide:
+    //     Node begin_argument(Node translation);
+    //     void set_translation(Node, std::string_view key, bool borrowed);
+    //     void clear_arguments(Node);
+    // Otherwise, "translate" and "with" are ignored like any other unknown key.
+    // The same goes for builders that can hold scores, which set has_scores:
+    //     void begin_score(Node); // Which then has no name, objective or value
+    //     void set_score(Node, ScorePart, std::string_view, bool borrowed);
+    // And for builders that can hold selectors, which set has_selectors:
+    //     void set_selector(Node, std::string_view pattern, bool borrowed);
+    template<typename Builder, typename Reader = JsonReader>
+    class ChatComponentParser
+    {
+    public:
+        // The reader (a JsonReader or an NbtReader) is only used to find the
+        // offsets of errors.
+        ChatComponentParser(Builder& builder, const Reader& reader, const Limits& limits = {},
+                            bool borrow_text = false)
+            : m_builder(builder), m_reader(reader), m_limits(limits), m_borrow_text(borrow_text) {}
+
+        // Only valid once parsing has finished without a syntax error, or
+        // once the parser has stopped the reader.
+        ParseError error() const { return m_error; }
+
+        bool null();
+        bool boolean(bool);
+        bool number(std::string_view);
+        bool string(std::string_view, bool borrowed);
+        bool key(std::string_view);
+        bool start_object();
+        bool end_object();
+        bool start_array();
+        bool end_array();
+
+    private:
+        enum class Property : uint8_t
+        {
+            Unknown,
+            Text,
+            Bold,
+            Italic,
+            Underlined,
+            Strikethrough,
+            Obfuscated,
+            Color,
+            Extra,
+            Translate,
+            With,
+            Score,
+            Selector,
+            Count
+        };
+
+        struct Frame
+        {
+            typename Builder::Node node;
+            uint32_t offset = 0;
+            Property property = Property::Unknown;
+            bool has_text = false;
+            bool has_translation = false;
+            bool in_extra = false;
+            bool in_with = false;
+            bool has_score = false;
+            bool has_selector = false;
+            bool in_score = false;
+            ScorePart score_part = ScorePart::None;
+            // One bit per ScorePart that's been set, and one per ScorePart
+            // that currently has the wrong type, along with where that is.
+            uint8_t score_parts = 0;
+            uint8_t invalid_score_parts = 0;
+            uint32_t score_offset = 0;
+            uint32_t invalid_score_offsets[4] = {};
+            // One bit per Property that currently holds a value of the wrong type.
+            uint16_t invalid = 0;
+            // Where the value of each Property that has the wrong type is.
+            uint32_t invalid_offsets[static_cast<uint8_t>(Property::Count)] = {};
+            ParseError color_error = {};
+            ParseError child_error = {};
+            ParseError argument_error = {};
+        };
+
+        static Property property_from_key(std::string_view);
+        static uint16_t bit(Property property) { return 1 << static_cast<uint8_t>(property); }
+
+        // Handles any non-container value, as well as the start of a container
+        // (in which case is_object or is_array is set). Returns false once a
+        // limit is exceeded.
+        bool value(const std::string_view* string, bool borrowed, const bool* boolean, bool is_object = false,
+                   bool is_array = false);
+        bool begin_component(typename Builder::Node);
+        // Adds an argument to a translation that isn't a component, but a
+        // string, number or boolean, which is the same as a component with
+        // that as its text.
+        bool plain_argument(std::string_view text, bool borrowed);
+        bool in_arguments() const { return m_skip_depth == 0 && !m_frames.empty() && m_frames.back().in_with; }
+        bool in_score() const { return m_skip_depth == 0 && !m_frames.empty() && m_frames.back().in_score; }
+        // Handles a value inside a "score" object.
+        bool score_value(Frame&, const std::string_view* string, bool borrowed, const bool* boolean, bool is_container);
+        void set_flag(Frame&, Style::Flag, Property, const bool*);
+        void set_invalid(Frame&, Property);
+        void child_error(Frame& parent, ParseError);
+        uint32_t value_offset() const { return static_cast<uint32_t>(m_reader.value_offset()); }
+        // How deep the component being started would be, counting what NBT
+        // unwraps along with the components around it.
+        std::size_t next_depth() const
+        {
+            if constexpr(std::is_same_v<Reader, NbtReader>)
+                return m_frames.size() + 1 + m_reader.unwrapped_depth();
+            else
+                return m_frames.size() + 1;
+        }
+
+        Builder& m_builder;
+        const Reader& m_reader;
+        Limits m_limits;
+        bool m_borrow_text;
+        std::size_t m_node_count = 0;
+        std::size_t m_text_bytes = 0;
+        bool m_root_started = false;
+        std::vector<Frame> m_frames;
+        // Depth of containers that don't contribute to the component, and are
+        // only walked to find syntax errors.
+        std::size_t m_skip_depth = 0;
+        ParseError m_error;
+    };
+
+    class ChatComponentBuilder
+    {
+    public:
+        using Node = ChatComponent*;
+        static constexpr bool has_translations = true;
+        static constexpr bool has_scores = true;
+        static constexpr bool has_selectors = true;
+
+        explicit ChatComponentBuilder(ChatComponent& root) : m_root(root) {}
+
+        Node begin_root() { return &m_root; }
+        Node begin_child(Node parent) { return &parent->m_children.emplace_back(); }
+        Node begin_argument(Node translation) { return &translation->m_arguments.emplace_back(); }
+        void set_text(Node node, std::string_view text, bool borrowed)
+        {
+            node->m_text = borrowed ? Text::borrowed(text) : Text::owned(text);
+            node->m_type = ChatComponent::Type::String;
+        }
+        void set_translation(Node node, std::string_view key, bool borrowed)
+        {
+            node->m_text = borrowed ? Text::borrowed(key) : Text::owned(key);
+            node->m_type = ChatComponent::Type::Translation;
+        }
+        void begin_score(Node node)
+        {
+            node->m_score = std::make_unique<ChatComponent::Score>();
+            node->m_text = {};
+            node->m_type = ChatComponent::Type::Score;
+        }
+        void set_score(Node node, ScorePart part, std::string_view text, bool borrowed)
+        {
+            auto value = borrowed ? Text::borrowed(text) : Text::owned(text);
+            if(part == ScorePart::Name)
+                node->m_score->name = std::move(value);
+            else if(part == ScorePart::Objective)
+                node->m_score->objective = std::move(value);
+            else
+                node->m_text = node->m_score->value = std::move(value);
+        }
+        void set_selector(Node node, std::string_view pattern, bool borrowed)
+        {
+            node->m_text = borrowed ? Text::borrowed(pattern) : Text::owned(pattern);
+            node->m_type = ChatComponent::Type::Selector;
+        }
+        void set_flag(Node node, Style::Flag flag, bool value) { node->m_style.set(flag, value); }
+        bool set_color(Node node, std::optional<Color> color)
+        {
+            node->m_color = color;
+            return true;
+        }
+        void clear_children(Node node) { node->m_children.clear(); }
+        void clear_arguments(Node node) { node->m_arguments.clear(); }
+        void end(Node) {}
+
+    private:
+        ChatComponent& m_root;
+    };
+
+    // Collects the nodes in pre-order, then packs them into a ChatTree, which
+    // only ever holds text.
+    class ChatTreeBuilder
+    {
+    public:
+        using Node = uint32_t;
+        static constexpr bool has_translations = false;
+        static constexpr bool has_scores = false;
+        static constexpr bool has_selectors = false;
+
+        Node begin_root() { return begin_child(0); }
+        Node begin_child(Node parent);
+        void set_text(Node, std::string_view, bool borrowed);
+        void set_flag(Node node, Style::Flag flag, bool value) { m_nodes[node].style.set(flag, value); }
+        void set_style(Node node, Style style) { m_nodes[node].style = style; }
+        // A tree can only hold as many different colors as there are
+        // indices below no_color.
+        bool set_color(Node, std::optional<Color>);
+        void clear_children(Node node) { m_nodes.resize(node + 1); }
+        void end(Node node) { m_nodes[node].end = static_cast<uint32_t>(m_nodes.size()); }
+
+        ChatTree build() const;
+
+    private:
+        std::vector<ChatTree::Node> m_nodes;
+        std::vector<Color> m_colors;
+        // The index of each color in m_colors, by its bits.
+        std::unordered_map<uint32_t, uint16_t> m_color_indices;
+        std::string m_text;
+    };
+}
@@ -0,0 +1,364 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "ChatTree.h"
+#include "AnsiRenderer.h"
+#include "ChatComponentParser.h"
+#include "HtmlRenderer.h"
+#include "JsonReader.h"
+#include "LegacyText.h"
+#include "NbtWriter.h"
+#include <fmt/format.h>
+#include <cstring>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+namespace LibSoprano
+{
+    // The color table is copied around with memcpy, and never destroyed.
+    static_assert(std::is_trivially_copyable_v<Color>);
+    // Nodes and colors are written to snapshots as they are in memory.
+    static_assert(std::is_trivially_copyable_v<ChatTree::Node> && sizeof(ChatTree::Node) == 16);
+    static_assert(sizeof(Color) == 4 && alignof(Color) <= 4);
+
+    // Followed by the nodes, the color table and the text pool, just as a
+    // tree has them in memory.
+    struct SnapshotHeader
+    {
+        char magic[8];
+        uint32_t version;
+        // Reads back differently on a machine of the other byte order.
+        uint32_t byte_order;
+        uint32_t node_count;
+        uint32_t color_count;
+        uint32_t text_size;
+        uint32_t reserved;
+    };
+
+    static constexpr char s_snapshot_magic[8] = {'S', 'O', 'P', 'R', 'S', 'N', 'A', 'P'};
+    static constexpr uint32_t s_snapshot_version = 1;
+    static constexpr uint32_t s_byte_order = 0x01020304;
+
+    static std::size_t align_up(std::size_t offset, std::size_t alignment)
+    {
+        return (offset + alignment - 1) / alignment * alignment;
+    }
+
+    ChatTree::ChatTree(std::size_t node_count, std::size_t color_count, std::size_t text_size)
+        : m_node_count(static_cast<uint32_t>(node_count)), m_color_count(static_cast<uint32_t>(color_count)),
+          m_text_size(static_cast<uint32_t>(text_size))
+    {
+        auto colors_offset = align_up(node_count * sizeof(Node), alignof(Color));
+        auto text_offset = colors_offset + color_count * sizeof(Color);
+
+        m_storage = std::make_unique<std::byte[]>(text_offset + text_size);
+        m_nodes = reinterpret_cast<Node*>(m_storage.get());
+        m_colors = reinterpret_cast<Color*>(m_storage.get() + colors_offset);
+        m_text = reinterpret_cast<char*>(m_storage.get() + text_offset);
+    }
+
+    ChatTree::ChatTree(const ChatTree& other) : ChatTree(other.m_node_count, other.m_color_count, other.m_text_size)
+    {
+        // Everything is trivially copyable. The other tree might be a view of
+        // a snapshot, so its parts are copied separately.
+        if(other.m_node_count)
+            memcpy(m_nodes, other.m_nodes, m_node_count * sizeof(Node));
+        if(other.m_color_count)
+            memcpy(m_colors, other.m_colors, m_color_count * sizeof(Color));
+        if(other.m_text_size)
+            memcpy(m_text, other.m_text, m_text_size);
+    }
+
+    ChatTree::ChatTree(ChatTree&& other) noexcept
+    {
+        swap(other);
+    }
+
+    ChatTree& ChatTree::operator=(ChatTree other)
+    {
+        swap(other);
+        return *this;
+    }
+
+    void ChatTree::swap(ChatTree& other) noexcept
+    {
+        std::swap(m_storage, other.m_storage);
+        std::swap(m_nodes, other.m_nodes);
+        std::swap(m_colors, other.m_colors);
+        std::swap(m_text, other.m_text);
+        std::swap(m_node_count, other.m_node_count);
+        std::swap(m_color_count, other.m_color_count);
+        std::swap(m_text_size, other.m_text_size);
+    }
+
+    Result<ChatTree, ChatTree::Error> ChatTree::parse(std::string_view raw_json)
+    {
+        auto result = try_parse(raw_json);
+        if(result.isErr())
+            return Err(result.storage().get<ParseError>().message(raw_json));
+        return Ok(std::move(result.storage().get<ChatTree>()));
+    }
+
+    Result<ChatTree, ParseError> ChatTree::try_parse(std::string_view raw_json, const Limits& limits) noexcept
+    {
+        ChatTreeBuilder builder;
+        JsonReader reader(raw_json);
+        ChatComponentParser parser(builder, reader, limits);
+
+        if(!reader.parse(parser))
+        {
+            // Without a syntax error, the parser stopped the reader itself on hitting a limit.
+            if(reader.error() == JsonReader::Error::None)
+                return Err(parser.error());
+            return Err(ParseError::syntax(reader.error(), static_cast<uint32_t>(reader.offset())));
+        }
+
+        if(parser.error())
+            return Err(parser.error());
+
+        return Ok(builder.build());
+    }
+
+    Result<ChatTree, ChatTree::Error> ChatTree::parse_nbt(std::string_view nbt)
+    {
+        auto result = try_parse_nbt(nbt);
+        if(result.isErr())
+            return Err(result.storage().get<ParseError>().nbt_message(nbt));
+        return Ok(std::move(result.storage().get<ChatTree>()));
+    }
+
+    Result<ChatTree, ParseError> ChatTree::try_parse_nbt(std::string_view nbt, const Limits& limits,
+                                                         std::size_t* size) noexcept
+    {
+        ChatTreeBuilder builder;
+        NbtReader reader(nbt);
+        ChatComponentParser parser(builder, reader, limits);
+
+        if(!reader.parse(parser))
+        {
+            if(reader.error() == NbtReader::Error::None)
+                return Err(parser.error());
+            return Err(ParseError::nbt(reader.error(), static_cast<uint32_t>(reader.offset())));
+        }
+
+        if(parser.error())
+            return Err(parser.error());
+
+        if(size)
+            *size = reader.offset();
+        return Ok(builder.build());
+    }
+
+    Result<ChatTree, ChatTree::Error> ChatTree::parse_legacy(std::string_view text)
+    {
+        auto result = try_parse_legacy(text);
+        if(result.isErr())
+            return Err(result.storage().get<ParseError>().message(text));
+        return Ok(std::move(result.storage().get<ChatTree>()));
+    }
+
+    Result<ChatTree, ParseError> ChatTree::try_parse_legacy(std::string_view text, const Limits& limits) noexcept
+    {
+        ChatTreeBuilder builder;
+        if(auto error = LegacyText::read(builder, text, limits, false))
+            return Err(error);
+        return Ok(builder.build());
+    }
+
+    Result<ChatTree, ChatTree::Error> ChatTree::from_component(const ChatComponent& root)
+    {
+        struct Frame
+        {
+            const ChatComponent* component;
+            ChatTreeBuilder::Node node;
+            std::size_t next_child;
+        };
+
+        ChatTreeBuilder builder;
+        std::vector<Frame> frames;
+
+        // Trees only hold plain text, like the ChatTree parsers accept.
+        auto begin = [&builder, &frames](const ChatComponent& component, ChatTreeBuilder::Node node) -> std::optional<Error>
+        {
+            if(component.type() != ChatComponent::Type::String)
+                return Error("Imcomplete or unsupported component");
+
+            builder.set_text(node, component.text(), false);
+            builder.set_style(node, component.style());
+
+            frames.push_back({&component, node, 0});
+            if(!builder.set_color(node, component.color()))
+                return Error("Too many different colors");
+            return {};
+        };
+
+        if(auto error = begin(root, builder.begin_root()))
+            return Err(std::move(*error));
+        while(!frames.empty())
+        {
+            auto& frame = frames.back();
+            if(frame.next_child == frame.component->children().size())
+            {
+                builder.end(frame.node);
+                frames.pop_back();
+                continue;
+            }
+
+            auto& child = frame.component->children()[frame.next_child++];
+            if(auto error = begin(child, builder.begin_child(frame.node)))
+                return Err(std::move(*error));
+        }
+
+        return Ok(builder.build());
+    }
+
+    Result<ChatTree, ChatTree::Error> ChatTree::view_snapshot(std::string_view bytes)
+    {
+        SnapshotHeader header;
+        if(bytes.size() < sizeof(header))
+            return Err(Error("Not a chat snapshot"));
+        memcpy(&header, bytes.data(), sizeof(header));
+
+        if(memcmp(header.magic, s_snapshot_magic, sizeof(s_snapshot_magic)) != 0)
+            return Err(Error("Not a chat snapshot"));
+        if(header.version != s_snapshot_version)
+            return Err(fmt::format("Unsupported chat snapshot version {}", header.version));
+        if(header.byte_order != s_byte_order)
+            return Err(Error("The chat snapshot was written on a machine of the other byte order"));
+        if(reinterpret_cast<uintptr_t>(bytes.data()) % alignof(Node) != 0)
+            return Err(Error("The chat snapshot isn't aligned in memory"));
+
+        auto nodes_size = uint64_t(header.node_count) * sizeof(Node);
+        auto colors_size = uint64_t(header.color_count) * sizeof(Color);
+        if(sizeof(header) + nodes_size + colors_size + header.text_size != bytes.size())
+            return Err(Error("The chat snapshot is truncated"));
+
+        ChatTree tree;
+        // The tree never writes to its nodes once built, so they can be read-only memory.
+        auto data = const_cast<char*>(bytes.data()) + sizeof(header);
+        tree.m_nodes = reinterpret_cast<Node*>(data);
+        tree.m_colors = reinterpret_cast<Color*>(data + nodes_size);
+        tree.m_text = data + nodes_size + colors_size;
+        tree.m_node_count = header.node_count;
+        tree.m_color_count = header.color_count;
+        tree.m_text_size = header.text_size;
+
+        // Walking trusts every node's end to be in order, and text and colors
+        // to be in bounds, so a damaged snapshot has to be caught here.
+        InlineStack<uint32_t> open;
+        for(uint32_t i = 0; i < tree.m_node_count; i++)
+        {
+            auto& node = tree.m_nodes[i];
+            while(!open.empty() && tree.m_nodes[open.top()].end <= i)
+                open.pop();
+
+            auto parent_end = open.empty() ? tree.m_node_count : tree.m_nodes[open.top()].end;
+            if(node.end <= i || node.end > parent_end || (i == 0 && node.end != tree.m_node_count)
+               || uint64_t(node.text_offset) + node.text_length > tree.m_text_size
+               || (node.color != no_color && node.color >= tree.m_color_count))
+                return Err(fmt::format("The chat snapshot is damaged at node {}", i));
+
+            if(node.end > i + 1)
+                open.push(i);
+        }
+
+        return Ok(std::move(tree));
+    }
+
+    bool ChatTree::write_snapshot(Sink& sink) const
+    {
+        SnapshotHeader header;
+        memcpy(header.magic, s_snapshot_magic, sizeof(s_snapshot_magic));
+        header.version = s_snapshot_version;
+        header.byte_order = s_byte_order;
+        header.node_count = m_node_count;
+        header.color_count = m_color_count;
+        header.text_size = m_text_size;
+        header.reserved = 0;
+
+        sink.write(std::string_view(reinterpret_cast<const char*>(&header), sizeof(header)));
+        sink.write(std::string_view(reinterpret_cast<const char*>(m_nodes), m_node_count * sizeof(Node)));
+        sink.write(std::string_view(reinterpret_cast<const char*>(m_colors), m_color_count * sizeof(Color)));
+        sink.write(std::string_view(m_text, m_text_size));
+        return !sink.failed();
+    }
+
+    bool ChatTree::render_ansi(Sink& sink, bool escape, AnsiRenderer::ColorDepth depth) const
+    {
+        return AnsiRenderer(escape, depth).render(*this, sink);
+    }
+
+    bool ChatTree::render_html(Sink& sink) const
+    {
+        return HtmlRenderer().render(*this, sink);
+    }
+
+    std::string ChatTree::to_ansi_string(bool escape, AnsiRenderer::ColorDepth depth) const
+    {
+        std::string buffer;
+        StringSink sink(buffer);
+        render_ansi(sink, escape, depth);
+        return buffer;
+    }
+
+    std::string ChatTree::to_html_string() const
+    {
+        std::string buffer;
+        StringSink sink(buffer);
+        render_html(sink);
+        return buffer;
+    }
+
+    bool ChatTree::render_legacy(Sink& sink, LegacyRenderer::HexColors hex_colors) const
+    {
+        return LegacyRenderer(hex_colors).render(*this, sink);
+    }
+
+    std::string ChatTree::to_legacy_string(LegacyRenderer::HexColors hex_colors) const
+    {
+        std::string buffer;
+        StringSink sink(buffer);
+        render_legacy(sink, hex_colors);
+        return buffer;
+    }
+
+    bool ChatTree::write_json(Sink& sink, JsonWriter::Mode mode) const
+    {
+        return JsonWriter(mode).render(*this, sink);
+    }
+
+    std::string ChatTree::to_json(JsonWriter::Mode mode) const
+    {
+        std::string buffer;
+        StringSink sink(buffer);
+        write_json(sink, mode);
+        return buffer;
+    }
+
+    bool ChatTree::write_nbt(Sink& sink) const
+    {
+        return NbtWriter().write(*this, sink);
+    }
+
+    std::string ChatTree::to_nbt() const
+    {
+        std::string buffer;
+        StringSink sink(buffer);
+        write_nbt(sink);
+        return buffer;
+    }
+}
@@ -0,0 +1,204 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include "result.h"
+#include "ChatComponent.h"
+#include "Color.h"
+#include "InlineStack.h"
+#include "JsonWriter.h"
+#include "LegacyRenderer.h"
+#include "Limits.h"
+#include "RenderNode.h"
+#include "Sink.h"
+#include "Style.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace LibSoprano
+{
+    // A chat component tree flattened into a single block of memory: every
+    // node, then the color table, then the text pool. Nodes are stored in
+    // pre-order, so the descendants of a node are the nodes that directly
+    // follow it, up until its end. The whole tree is one allocation.
+    //
+    // Everything in it is an index or an offset, never a pointer, so a tree
+    // can be saved as a snapshot and later used in place, straight from the
+    // file's bytes (say, mapped into memory), without any parsing at all.
+    class ChatTree
+    {
+        friend class ChatTreeBuilder;
+
+    public:
+        using Error = ChatComponent::Error;
+
+        static constexpr uint16_t no_color = 0xFFFF;
+
+        struct Node
+        {
+            uint32_t text_offset = 0;
+            uint32_t text_length = 0;
+            // One past the index of this node's last descendant.
+            uint32_t end = 0;
+            uint16_t color = no_color;
+            Style style;
+        };
+
+        class Children
+        {
+        public:
+            class Iterator
+            {
+            public:
+                Iterator(const Node* nodes, const Node* node) : m_nodes(nodes), m_node(node) {}
+
+                const Node& operator*() const { return *m_node; }
+                const Node* operator->() const { return m_node; }
+                Iterator& operator++()
+                {
+                    m_node = m_nodes + m_node->end;
+                    return *this;
+                }
+                bool operator==(const Iterator& other) const { return m_node == other.m_node; }
+
+            private:
+                const Node* m_nodes;
+                const Node* m_node;
+            };
+
+            Children(const Node* nodes, const Node& parent) : m_nodes(nodes), m_parent(parent) {}
+
+            Iterator begin() const { return {m_nodes, &m_parent + 1}; }
+            Iterator end() const { return {m_nodes, m_nodes + m_parent.end}; }
+
+        private:
+            const Node* m_nodes;
+            const Node& m_parent;
+        };
+
+        static Result<ChatTree, Error> parse(std::string_view raw_json);
+        // Never throws, nor allocates for a failure (see ChatComponent::try_parse).
+        static Result<ChatTree, ParseError> try_parse(std::string_view raw_json, const Limits& = {}) noexcept;
+        // Reads network NBT (see ChatComponent::try_parse_nbt).
+        static Result<ChatTree, Error> parse_nbt(std::string_view nbt);
+        static Result<ChatTree, ParseError> try_parse_nbt(std::string_view nbt, const Limits& = {},
+                                                          std::size_t* size = nullptr) noexcept;
+        // Reads legacy text (see ChatComponent::try_parse_legacy).
+        static Result<ChatTree, Error> parse_legacy(std::string_view text);
+        static Result<ChatTree, ParseError> try_parse_legacy(std::string_view text, const Limits& = {}) noexcept;
+        // Fails if the component has translation, score or selector components,
+        // which a tree can't hold, or more different colors than it can hold.
+        static Result<ChatTree, Error> from_component(const ChatComponent&);
+        // Checks over a snapshot written by write_snapshot, and returns a tree
+        // that borrows it without copying anything. The bytes must be aligned
+        // to 4 bytes, and outlive the tree (and none of its copies).
+        static Result<ChatTree, Error> view_snapshot(std::string_view bytes);
+
+        ChatTree() = default;
+        ChatTree(const ChatTree&);
+        ChatTree(ChatTree&&) noexcept;
+        ChatTree& operator=(ChatTree);
+
+        std::size_t size() const { return m_node_count; }
+        bool empty() const { return m_node_count == 0; }
+        // Every node in pre-order, starting with the root.
+        std::span<const Node> nodes() const { return {m_nodes, m_node_count}; }
+        const Node& root() const { return m_nodes[0]; }
+        Children children(const Node& node) const { return {m_nodes, node}; }
+        std::string_view text(const Node& node) const { return {m_text + node.text_offset, node.text_length}; }
+        const Color* color(const Node& node) const { return node.color == no_color ? nullptr : &m_colors[node.color]; }
+
+        // These return false if the sink failed part way through.
+        bool render_ansi(Sink&, bool escape = false, AnsiRenderer::ColorDepth = AnsiRenderer::ColorDepth::TrueColor) const;
+        bool render_html(Sink&) const;
+        std::string to_ansi_string(bool escape = false, AnsiRenderer::ColorDepth = AnsiRenderer::ColorDepth::TrueColor) const;
+        std::string to_html_string() const;
+        bool render_legacy(Sink&, LegacyRenderer::HexColors = LegacyRenderer::HexColors::Sequence) const;
+        std::string to_legacy_string(LegacyRenderer::HexColors = LegacyRenderer::HexColors::Sequence) const;
+        // Writes the component back out as JSON (see JsonWriter.h).
+        bool write_json(Sink&, JsonWriter::Mode = JsonWriter::Mode::Minified) const;
+        std::string to_json(JsonWriter::Mode = JsonWriter::Mode::Minified) const;
+        // Writes the tree as network NBT (see NbtWriter.h).
+        bool write_nbt(Sink&) const;
+        std::string to_nbt() const;
+
+        // Snapshots are versioned, and only read on machines of the same byte order.
+        bool write_snapshot(Sink&) const;
+
+        // Visits every node in document order (see RenderNode.h). Returns
+        // false if the visitor stopped early.
+        template<typename Visitor>
+        bool walk(Visitor& visitor) const
+        {
+            return empty() || walk(visitor, root());
+        }
+
+        // Visits a node and its descendants. Being in pre-order, that's just a
+        // run of the node array, with a stack of who still needs leaving.
+        template<typename Visitor>
+        bool walk(Visitor& visitor, const Node& node) const
+        {
+            auto first = static_cast<uint32_t>(&node - m_nodes);
+            InlineStack<uint32_t> open;
+            for(auto i = first; i < node.end; i++)
+            {
+                while(!open.empty() && m_nodes[open.top()].end <= i)
+                {
+                    visitor.leave(render_node(m_nodes[open.top()]));
+                    open.pop();
+                }
+
+                if(!visitor.enter(render_node(m_nodes[i])))
+                    return false;
+
+                if(m_nodes[i].end == i + 1)
+                    visitor.leave(render_node(m_nodes[i]));
+                else
+                    open.push(i);
+            }
+
+            while(!open.empty())
+            {
+                visitor.leave(render_node(m_nodes[open.top()]));
+                open.pop();
+            }
+
+            return true;
+        }
+
+    private:
+        RenderNode render_node(const Node& node) const
+        {
+            auto node_color = color(node);
+            return {text(node), node_color ? std::optional(*node_color) : std::nullopt, node.style};
+        }
+
+        ChatTree(std::size_t node_count, std::size_t color_count, std::size_t text_size);
+        void swap(ChatTree&) noexcept;
+
+        std::unique_ptr<std::byte[]> m_storage;
+        Node* m_nodes = nullptr;
+        Color* m_colors = nullptr;
+        char* m_text = nullptr;
+        uint32_t m_node_count = 0;
+        uint32_t m_color_count = 0;
+        uint32_t m_text_size = 0;
+    };
+}
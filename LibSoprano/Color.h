@@ -15,14 +15,33 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #pragma once
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <span>
 #include <string>
+#include <string_view>
 
 namespace LibSoprano
 {
+    // A trivially copyable, 4 byte color. The low 24 bits are the RGB
+    // foreground, and the high 8 bits identify which named color this is (if
+    // any), which is where the background, name and ANSI color come from.
     class Color
     {
     public:
-        Color(unsigned int foreground);
+        struct Named
+        {
+            unsigned int foreground;
+            unsigned int background;
+            std::string_view name;
+            // The legacy formatting code, as in §a.
+            char code;
+            uint8_t ansi_code;
+        };
+
+        // Only the low 24 bits (RGB) of the foreground are kept.
+        constexpr Color(unsigned int foreground) : m_value(foreground & rgb_mask) {}
 
         static const Color BLACK;
         static const Color DARK_BLUE;
@@ -41,22 +60,105 @@ namespace LibSoprano
         static const Color YELLOW;
         static const Color WHITE;
 
-        unsigned int foreground() const { return m_foreground; }
-        unsigned int background() const { return m_background; }
-        const char* ansi_color() const { return m_ansi_color; }
-        const std::string& name() const { return m_name; }
-        static const Color* from_name(const char*);
+        // Every named color, in the order of their formatting codes.
+        static constexpr std::span<const Named> named_colors() { return s_named; }
+        static constexpr Color named_color(uint8_t index) { return {s_named[index].foreground, index}; }
+
+        constexpr unsigned int foreground() const { return m_value & rgb_mask; }
+        constexpr unsigned int background() const { return is_named() ? named()->background : 0; }
+        // The SGR foreground parameter of a named color, or 0 if it isn't one.
+        constexpr uint8_t ansi_code() const { return is_named() ? named()->ansi_code : 0; }
+        // The legacy formatting code of a named color, or 0 if it isn't one.
+        constexpr char code() const { return is_named() ? named()->code : 0; }
+        // The name of a named color, or the hexadecimal foreground otherwise. This
+        // is formatted on demand, so avoid it in hot paths.
+        std::string name() const;
+        constexpr bool is_named() const { return (m_value >> 24) != 0; }
+        static constexpr std::optional<Color> from_name(std::string_view);
+
+        constexpr bool operator==(const Color&) const = default;
 
-        static const char* m_ansi_reset;
         static const char* m_ansi_escape;
         static const char* m_ansi_escape_escaped;
 
     private:
-        Color(unsigned int foreground, unsigned int background, const char* name, const char* ansi_color)
-            : m_foreground(foreground), m_background(background), m_name(name), m_ansi_color(ansi_color) {}
-        unsigned int m_foreground = 0;
-        unsigned int m_background = 0;
-        std::string m_name;
-        const char* m_ansi_color = nullptr;
+        static constexpr uint32_t rgb_mask = 0xFFFFFF;
+
+        // TOOD: Should the alpha be set to 0xFF?
+        static constexpr Named s_named[] =
+        {
+            {0,         0,          "black",        '0', 30},
+            {0xAA,      0x2A,       "dark_blue",    '1', 34},
+            {0xAA00,    0x2A00,     "dark_green",   '2', 32},
+            {0xAAAA,    0x2A2A,     "dark_aqua",    '3', 36},
+            {0xAA0000,  0x2A0000,   "dark_red",     '4', 31},
+            {0xAA00AA,  0x2A002A,   "dark_purple",  '5', 35},
+            {0xFFAA00,  0x2A2A00,   "gold",         '6', 33},
+            {0xAAAAAA,  0x2A2A2A,   "gray",         '7', 37},
+            {0x555555,  0x151515,   "dark_gray",    '8', 90},
+            {0x5555FF,  0x15153F,   "blue",         '9', 94},
+            {0x55FF55,  0x153F15,   "green",        'a', 92},
+            {0x55FFFF,  0x153F3F,   "aqua",         'b', 96},
+            {0xFF5555,  0x3F1515,   "red",          'c', 91},
+            {0xFF55FF,  0x3F153F,   "light_purple", 'd', 95},
+            {0xFFFF55,  0x3F3F15,   "yellow",       'e', 93},
+            {0xFFFFFF,  0x3F3F3F,   "white",        'f', 97},
+        };
+
+        // A perfect hash of the names above, checked when the table is built.
+        static constexpr std::size_t name_hash(std::string_view name) { return (name.size() * 2 + name.back()) & 31; }
+        // The index of the named color with each hash, plus one.
+        static const std::array<uint8_t, 32> s_name_table;
+
+        constexpr Color(unsigned int foreground, uint8_t named_index)
+            : m_value((foreground & rgb_mask) | (static_cast<uint32_t>(named_index + 1) << 24)) {}
+        constexpr const Named* named() const { return &s_named[(m_value >> 24) - 1]; }
+
+        uint32_t m_value;
     };
+
+    inline constexpr Color Color::BLACK = named_color(0);
+    inline constexpr Color Color::DARK_BLUE = named_color(1);
+    inline constexpr Color Color::DARK_GREEN = named_color(2);
+    inline constexpr Color Color::DARK_AQUA = named_color(3);
+    inline constexpr Color Color::DARK_RED = named_color(4);
+    inline constexpr Color Color::DARK_PURPLE = named_color(5);
+    inline constexpr Color Color::GOLD = named_color(6);
+    inline constexpr Color Color::GRAY = named_color(7);
+    inline constexpr Color Color::DARK_GRAY = named_color(8);
+    inline constexpr Color Color::BLUE = named_color(9);
+    inline constexpr Color Color::GREEN = named_color(10);
+    inline constexpr Color Color::AQUA = named_color(11);
+    inline constexpr Color Color::RED = named_color(12);
+    inline constexpr Color Color::LIGHT_PURPLE = named_color(13);
+    inline constexpr Color Color::YELLOW = named_color(14);
+    inline constexpr Color Color::WHITE = named_color(15);
+
+    inline constexpr std::array<uint8_t, 32> Color::s_name_table = []()
+    {
+        std::array<uint8_t, 32> table{};
+        for(uint8_t i = 0; i < std::size(s_named); i++)
+        {
+            auto& slot = table[name_hash(s_named[i].name)];
+            // Two names with the same hash would make this fail to compile.
+            if(slot != 0)
+                throw "Color name hash collision";
+            slot = i + 1;
+        }
+        return table;
+    }();
+
+    constexpr std::optional<Color> Color::from_name(std::string_view name)
+    {
+        if(name.empty())
+            return {};
+
+        auto index = s_name_table[name_hash(name)];
+        if(index == 0 || s_named[index - 1].name != name)
+            return {};
+        return named_color(index - 1);
+    }
+
+    static_assert(Color::from_name("light_purple") == Color::LIGHT_PURPLE);
+    static_assert(!Color::from_name("purple"));
 }
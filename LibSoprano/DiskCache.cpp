@@ -0,0 +1,424 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "DiskCache.h"
+#include "Hash.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fmt/format.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace LibSoprano
+{
+    // "SPRCACHE" on little-endian machines, so a file from a machine of the other kind is rejected.
+    static constexpr uint64_t s_magic = 0x45484341'43525053;
+    static constexpr uint32_t s_version = 2;
+    // The table has a slot for about every this many bytes of log.
+    static constexpr uint64_t s_bytes_per_slot = 256;
+    // Probing gets slow once the table is fuller than this.
+    static constexpr uint64_t s_max_load_percent = 75;
+
+    struct Header
+    {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t reserved;
+        uint64_t slot_count;
+        uint64_t capacity;
+        // Where the next record goes, from the start of the file.
+        uint64_t log_end;
+        uint64_t entries;
+    };
+
+    struct Slot
+    {
+        uint64_t hash;
+        // Of the record, from the start of the file, or 0 if the slot is empty.
+        uint64_t offset;
+    };
+
+    // Followed by the JSON and then the output, padded to 8 bytes.
+    struct Record
+    {
+        uint64_t hash;
+        uint64_t language;
+        uint32_t options;
+        // In minutes since the epoch, which compaction goes by.
+        uint32_t last_used;
+        uint32_t json_size;
+        uint32_t output_size;
+
+        std::string_view json() const { return {reinterpret_cast<const char*>(this + 1), json_size}; }
+        std::string_view output() const { return {reinterpret_cast<const char*>(this + 1) + json_size, output_size}; }
+    };
+
+    struct Layout
+    {
+        uint64_t slot_count;
+        uint64_t log_start;
+        uint64_t file_size;
+    };
+
+    static Layout layout(uint64_t capacity)
+    {
+        // A power of two, so that a hash can be masked into a slot.
+        uint64_t slot_count = 1024;
+        while(slot_count * s_bytes_per_slot < capacity)
+            slot_count *= 2;
+
+        auto log_start = sizeof(Header) + slot_count * sizeof(Slot);
+        return {slot_count, log_start, log_start + capacity};
+    }
+
+    static uint64_t record_size(const Record& record)
+    {
+        return (sizeof(Record) + record.json_size + record.output_size + 7) & ~uint64_t(7);
+    }
+
+    static uint32_t now_in_minutes()
+    {
+        auto now = std::chrono::system_clock::now().time_since_epoch();
+        return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::minutes>(now).count());
+    }
+
+    static std::string system_error(std::string_view what, const std::string& path)
+    {
+        return fmt::format("{} {}: {}", what, path, strerror(errno));
+    }
+
+    Result<std::unique_ptr<DiskCache>, DiskCache::Error> DiskCache::open(const std::string& path, std::size_t capacity)
+    {
+        std::unique_ptr<DiskCache> cache(new DiskCache(path));
+        Error error;
+        if(!cache->map(capacity, error))
+            return Err(error);
+        return Ok(std::move(cache));
+    }
+
+    DiskCache::~DiskCache()
+    {
+        m_old_maps.emplace_back(m_map.load(), m_map_size);
+        for(auto [map, size] : m_old_maps)
+        {
+            if(map)
+                munmap(map, size);
+        }
+
+        if(m_fd != -1)
+            close(m_fd);
+    }
+
+    bool DiskCache::map(std::size_t capacity, Error& error)
+    {
+        auto writable = true;
+        auto fd = ::open(m_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if(fd == -1 && (errno == EACCES || errno == EROFS))
+        {
+            writable = false;
+            fd = ::open(m_path.c_str(), O_RDONLY | O_CLOEXEC);
+        }
+
+        if(fd == -1)
+        {
+            error = system_error("Couldn't open", m_path);
+            return false;
+        }
+
+        auto fail = [&](std::string message)
+        {
+            error = std::move(message);
+            close(fd);
+            return false;
+        };
+
+        // Nobody else may be creating the file while we look at it.
+        if(flock(fd, writable ? LOCK_EX : LOCK_SH) != 0)
+            return fail(system_error("Couldn't lock", m_path));
+
+        struct stat info;
+        if(fstat(fd, &info) != 0)
+            return fail(system_error("Couldn't open", m_path));
+
+        auto is_new = info.st_size == 0;
+        auto size = static_cast<std::size_t>(info.st_size);
+        if(is_new)
+        {
+            if(!writable)
+                return fail(fmt::format("Couldn't open {}: It's empty and can't be written to", m_path));
+
+            // The file is sparse, so the log only takes up space on disk as it fills.
+            size = layout(capacity).file_size;
+            if(ftruncate(fd, static_cast<off_t>(size)) != 0)
+                return fail(system_error("Couldn't create", m_path));
+        }
+        else if(size < sizeof(Header))
+        {
+            return fail(fmt::format("{} isn't a render cache", m_path));
+        }
+
+        auto map = mmap(nullptr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+        if(map == MAP_FAILED)
+            return fail(system_error("Couldn't map", m_path));
+
+        auto& header = *reinterpret_cast<Header*>(map);
+        if(is_new)
+        {
+            auto file_layout = layout(capacity);
+            header.version = s_version;
+            header.slot_count = file_layout.slot_count;
+            header.capacity = capacity;
+            header.log_end = file_layout.log_start;
+            header.entries = 0;
+            // Last of all, so that a file that was never finished is never mistaken for a cache.
+            header.magic = s_magic;
+        }
+        else if(header.magic != s_magic || header.version != s_version
+                || layout(header.capacity).file_size != size || layout(header.capacity).slot_count != header.slot_count)
+        {
+            munmap(map, size);
+            return fail(fmt::format("{} isn't a render cache, or is from another version of Soprano", m_path));
+        }
+
+        flock(fd, LOCK_UN);
+
+        if(m_fd != -1)
+        {
+            m_old_maps.emplace_back(m_map.load(), m_map_size);
+            close(m_fd);
+        }
+
+        m_fd = fd;
+        m_map_size = size;
+        m_writable = writable;
+        m_map.store(static_cast<std::byte*>(map), std::memory_order_release);
+        return true;
+    }
+
+    bool DiskCache::lock_file()
+    {
+        while(true)
+        {
+            if(flock(m_fd, LOCK_EX) != 0)
+                return false;
+
+            // Compaction renames a new file into place while holding the lock
+            // on the old one, so once we have the lock, we know which is current.
+            struct stat mapped;
+            struct stat current;
+            if(fstat(m_fd, &mapped) != 0 || stat(m_path.c_str(), &current) != 0
+               || (mapped.st_dev == current.st_dev && mapped.st_ino == current.st_ino))
+                return true;
+
+            flock(m_fd, LOCK_UN);
+            Error error;
+            if(!map(0, error) || !m_writable)
+                return false;
+        }
+    }
+
+    static Record* lookup(std::byte* map, uint64_t hash, std::string_view json, uint32_t options, uint64_t language)
+    {
+        auto& header = *reinterpret_cast<Header*>(map);
+        auto slots = reinterpret_cast<Slot*>(map + sizeof(Header));
+        auto file_size = layout(header.capacity).file_size;
+        auto mask = header.slot_count - 1;
+
+        // The table never fills, but a damaged file might have.
+        for(uint64_t probe = 0; probe < header.slot_count; probe++)
+        {
+            auto& slot = slots[(hash + probe) & mask];
+            auto offset = std::atomic_ref(slot.offset).load(std::memory_order_acquire);
+            if(offset == 0)
+                return nullptr;
+            if(slot.hash != hash)
+                continue;
+
+            // Nor should a damaged file take us out of bounds.
+            auto record = reinterpret_cast<Record*>(map + offset);
+            if(offset + sizeof(Record) > file_size || offset + record_size(*record) > file_size)
+                return nullptr;
+
+            if(record->options == options && record->language == language && record->json() == json)
+                return record;
+        }
+
+        return nullptr;
+    }
+
+    std::optional<std::string_view> DiskCache::find(std::string_view json, uint32_t options, uint64_t language) const
+    {
+        auto record = lookup(m_map.load(std::memory_order_acquire), hash_bytes(json, options ^ language), json, options,
+                             language);
+        if(!record)
+            return {};
+
+        // Only when it's changed, so that hits don't dirty pages for nothing.
+        std::atomic_ref last_used(record->last_used);
+        auto now = now_in_minutes();
+        if(m_writable && last_used.load(std::memory_order_relaxed) != now)
+            last_used.store(now, std::memory_order_relaxed);
+
+        return record->output();
+    }
+
+    // Adds a record, with the file locked. Returns false if it's full.
+    static bool append(std::byte* map, const DiskCache::Item& item, uint64_t hash, uint32_t last_used)
+    {
+        auto& header = *reinterpret_cast<Header*>(map);
+        std::atomic_ref entries(header.entries);
+        std::atomic_ref log_end(header.log_end);
+        if((entries.load() + 1) * 100 > header.slot_count * s_max_load_percent)
+            return false;
+
+        Record record{hash, item.language, item.options, last_used, static_cast<uint32_t>(item.json.size()),
+                      static_cast<uint32_t>(item.output.size())};
+        auto offset = log_end.load();
+        if(offset + record_size(record) > layout(header.capacity).file_size)
+            return false;
+
+        // The record is written in full before anything points to it, so readers never see half of one.
+        auto destination = reinterpret_cast<char*>(map + offset);
+        memcpy(destination, &record, sizeof(Record));
+        memcpy(destination + sizeof(Record), item.json.data(), item.json.size());
+        memcpy(destination + sizeof(Record) + item.json.size(), item.output.data(), item.output.size());
+        log_end.store(offset + record_size(record), std::memory_order_release);
+
+        auto slots = reinterpret_cast<Slot*>(map + sizeof(Header));
+        auto mask = header.slot_count - 1;
+        for(auto index = hash & mask;; index = (index + 1) & mask)
+        {
+            std::atomic_ref slot_offset(slots[index].offset);
+            if(slot_offset.load(std::memory_order_relaxed) != 0)
+                continue;
+
+            slots[index].hash = hash;
+            slot_offset.store(offset, std::memory_order_release);
+            break;
+        }
+
+        entries.store(entries.load() + 1);
+        return true;
+    }
+
+    void DiskCache::insert(std::span<const Item> items)
+    {
+        std::lock_guard lock(m_write_mutex);
+        if(!m_writable || !lock_file())
+            return;
+
+        auto map = m_map.load();
+        auto now = now_in_minutes();
+        for(auto& item : items)
+        {
+            if(item.json.size() > UINT32_MAX || item.output.size() > UINT32_MAX)
+                continue;
+
+            auto hash = hash_bytes(item.json, item.options ^ item.language);
+            if(!lookup(map, hash, item.json, item.options, item.language) && !append(map, item, hash, now))
+                break;
+        }
+
+        flock(m_fd, LOCK_UN);
+    }
+
+    DiskCache::Stats DiskCache::stats() const
+    {
+        auto& header = *reinterpret_cast<Header*>(m_map.load(std::memory_order_acquire));
+        Stats stats;
+        stats.entries = std::atomic_ref(header.entries).load();
+        stats.used_bytes = std::atomic_ref(header.log_end).load() - layout(header.capacity).log_start;
+        stats.capacity = header.capacity;
+        return stats;
+    }
+
+    Result<DiskCache::Stats, DiskCache::Error> DiskCache::compact(const std::string& path, std::size_t capacity)
+    {
+        struct stat info;
+        if(stat(path.c_str(), &info) != 0)
+            return Err(system_error("Couldn't open", path));
+
+        auto source_result = open(path, 0);
+        if(source_result.isErr())
+            return Err(source_result.storage().get<Error>());
+        auto& source = *source_result.storage().get<std::unique_ptr<DiskCache>>();
+
+        // Writers wait on the lock until the new file is in place.
+        std::lock_guard lock(source.m_write_mutex);
+        if(!source.m_writable || !source.lock_file())
+            return Err(system_error("Couldn't lock", path));
+
+        auto map = source.m_map.load();
+        auto& header = *reinterpret_cast<Header*>(map);
+        auto slots = reinterpret_cast<Slot*>(map + sizeof(Header));
+        std::vector<Record*> records;
+        for(uint64_t i = 0; i < header.slot_count; i++)
+        {
+            if(auto offset = slots[i].offset)
+            {
+                auto record = reinterpret_cast<Record*>(map + offset);
+                if(lookup(map, record->hash, record->json(), record->options, record->language) == record)
+                    records.push_back(record);
+            }
+        }
+
+        std::sort(records.begin(), records.end(),
+                  [](const Record* a, const Record* b) { return a->last_used > b->last_used; });
+
+        // Build the new file next to the old one, so that renaming it into place is atomic.
+        auto temporary_path = path + ".compacting";
+        unlink(temporary_path.c_str());
+        auto target_result = open(temporary_path, capacity);
+        if(target_result.isErr())
+        {
+            flock(source.m_fd, LOCK_UN);
+            return Err(target_result.storage().get<Error>());
+        }
+        auto& target = *target_result.storage().get<std::unique_ptr<DiskCache>>();
+
+        // Leave room for what comes next.
+        auto budget = capacity / 4 * 3;
+        std::size_t used = 0;
+        for(auto record : records)
+        {
+            auto size = record_size(*record);
+            if(used + size > budget)
+                continue;
+            if(!append(target.m_map.load(), {record->json(), record->options, record->language, record->output()},
+                       record->hash, record->last_used))
+                break;
+            used += size;
+        }
+
+        auto stats = target.stats();
+        if(fchmod(target.m_fd, info.st_mode & 07777) != 0 || fsync(target.m_fd) != 0
+           || rename(temporary_path.c_str(), path.c_str()) != 0)
+        {
+            auto error = system_error("Couldn't replace", path);
+            unlink(temporary_path.c_str());
+            flock(source.m_fd, LOCK_UN);
+            return Err(error);
+        }
+
+        flock(source.m_fd, LOCK_UN);
+        return Ok(stats);
+    }
+}
@@ -0,0 +1,112 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include "result.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace LibSoprano
+{
+    // A render cache kept in a memory-mapped file, so that what's been
+    // rendered once is there for every later run, and for other processes
+    // running at the same time. Like RenderCache, entries are keyed by the
+    // raw JSON, a number standing for the render options and the hash of the
+    // language table, if any.
+    //
+    // The file is a fixed-size hash table of record offsets in front of an
+    // append-only log of records. Records are only ever added, and a slot
+    // is only filled in once its record has been written, so readers never
+    // lock at all: whatever they find is complete. Writers take an exclusive
+    // flock on the file (and a mutex, for other threads of the same process).
+    //
+    // Once the log is full, new entries are dropped until the file is
+    // compacted, which writes the most recently used records to a new file
+    // and renames it over the old one. Anyone with the old file mapped keeps
+    // reading it until they next write, when they switch to the new one.
+    class DiskCache
+    {
+    public:
+        using Error = std::string;
+
+        struct Item
+        {
+            std::string_view json;
+            uint32_t options;
+            uint64_t language;
+            std::string_view output;
+        };
+
+        struct Stats
+        {
+            std::size_t entries = 0;
+            // Of the log, which is all that entries take up.
+            std::size_t used_bytes = 0;
+            std::size_t capacity = 0;
+        };
+
+        // Opens the cache at path, creating it with room for about capacity
+        // bytes if it doesn't exist. An existing cache keeps its own size. If
+        // the file can't be written to, the cache is only read from.
+        static Result<std::unique_ptr<DiskCache>, Error> open(const std::string& path, std::size_t capacity);
+        // Rewrites the cache at path into capacity bytes, keeping the most
+        // recently used entries that fit in three quarters of it.
+        static Result<Stats, Error> compact(const std::string& path, std::size_t capacity);
+
+        DiskCache(const DiskCache&) = delete;
+        DiskCache& operator=(const DiskCache&) = delete;
+        ~DiskCache();
+
+        // The output cached for json rendered with options and language. Stays
+        // valid as long as the cache is open, even across writes.
+        std::optional<std::string_view> find(std::string_view json, uint32_t options, uint64_t language) const;
+        // Adds all of items under a single lock. Items that are already
+        // cached, or don't fit, are skipped.
+        void insert(std::span<const Item> items);
+
+        Stats stats() const;
+        bool writable() const { return m_writable; }
+
+    private:
+        explicit DiskCache(std::string path) : m_path(std::move(path)) {}
+
+        // Opens and maps the file at m_path, creating it with room for
+        // capacity bytes if it doesn't exist.
+        bool map(std::size_t capacity, Error&);
+        // Takes the file lock, switching to a new file first if compaction
+        // replaced the one that's mapped.
+        bool lock_file();
+
+        std::string m_path;
+        int m_fd = -1;
+        // Read without any lock by finds, while a write might be switching files.
+        std::atomic<std::byte*> m_map = nullptr;
+        std::size_t m_map_size = 0;
+        bool m_writable = false;
+        // Files replaced by compaction stay mapped, as finds may still point into them.
+        std::vector<std::pair<std::byte*, std::size_t>> m_old_maps;
+        std::mutex m_write_mutex;
+    };
+}
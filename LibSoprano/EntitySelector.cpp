@@ -0,0 +1,609 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "EntitySelector.h"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <limits>
+#include <span>
+#include <utility>
+#include <fmt/format.h>
+
+namespace LibSoprano
+{
+    namespace
+    {
+        constexpr double infinity = std::numeric_limits<double>::infinity();
+
+        void skip_whitespace(std::string_view& rest)
+        {
+            while(!rest.empty() && (rest.front() == ' ' || rest.front() == '\t'))
+                rest.remove_prefix(1);
+        }
+
+        // Strings are quoted with either kind of quote, with backslashes
+        // escaping quotes and themselves, or run up to the next space, comma
+        // or bracket.
+        std::optional<std::string> read_string(std::string_view& rest)
+        {
+            std::string string;
+            if(!rest.empty() && (rest.front() == '"' || rest.front() == '\''))
+            {
+                auto quote = rest.front();
+                rest.remove_prefix(1);
+                while(!rest.empty() && rest.front() != quote)
+                {
+                    if(rest.front() == '\\')
+                    {
+                        rest.remove_prefix(1);
+                        if(rest.empty() || (rest.front() != '\\' && rest.front() != quote))
+                            return std::nullopt;
+                    }
+                    string += rest.front();
+                    rest.remove_prefix(1);
+                }
+                if(rest.empty())
+                    return std::nullopt;
+                rest.remove_prefix(1);
+                return string;
+            }
+
+            auto end = rest.find_first_of(" \t,]");
+            string = rest.substr(0, end);
+            rest.remove_prefix(string.size());
+            return string;
+        }
+
+        std::optional<double> to_double(std::string_view text)
+        {
+            double value = 0;
+            auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+            if(text.empty() || error != std::errc() || end != text.data() + text.size() || !std::isfinite(value))
+                return std::nullopt;
+            return value;
+        }
+
+        uint64_t split_mix(uint64_t& state)
+        {
+            auto z = (state += 0x9E3779B97F4A7C15);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+            return z ^ (z >> 31);
+        }
+    }
+
+    Result<EntitySelector, EntitySelector::Error> EntitySelector::compile(std::string_view selector)
+    {
+        EntitySelector compiled;
+        if(selector.empty())
+            return Err(std::string("A selector can't be empty"));
+
+        // Anything that isn't a selector is a player's name.
+        if(selector.front() != '@')
+        {
+            if(selector.find_first_of(" \t") != std::string_view::npos)
+                return Err(fmt::format("\"{}\" isn't a selector or a player's name", selector));
+            compiled.m_players_only = true;
+            compiled.m_limit = 1;
+            compiled.add(Test::Name, false, std::string(selector));
+            return Ok(std::move(compiled));
+        }
+
+        if(selector.size() < 2)
+            return Err(std::string("Expected a selector type after '@'"));
+        switch(selector[1])
+        {
+            case 'p':
+                compiled.m_players_only = true;
+                compiled.m_sort = Sort::Nearest;
+                compiled.m_limit = 1;
+                break;
+            case 'a':
+                compiled.m_players_only = true;
+                break;
+            case 'r':
+                compiled.m_players_only = true;
+                compiled.m_sort = Sort::Random;
+                compiled.m_limit = 1;
+                break;
+            case 's':
+                compiled.m_self = true;
+                compiled.m_limit = 1;
+                break;
+            case 'e':
+                break;
+            case 'n':
+                compiled.m_sort = Sort::Nearest;
+                compiled.m_limit = 1;
+                break;
+            default:
+                return Err(fmt::format("Unknown selector type '@{}'", selector[1]));
+        }
+
+        auto rest = selector.substr(2);
+        if(!rest.empty() && rest.front() == '[')
+        {
+            rest.remove_prefix(1);
+            if(auto error = compiled.parse_options(rest))
+                return Err(std::move(*error));
+        }
+
+        skip_whitespace(rest);
+        if(!rest.empty())
+            return Err(fmt::format("Unexpected \"{}\" after the selector", rest));
+
+        // Names are the most likely to rule an entity out, and types next.
+        std::stable_sort(compiled.m_program.begin(), compiled.m_program.end(),
+                         [](const Instruction& a, const Instruction& b) { return a.test < b.test; });
+        return Ok(std::move(compiled));
+    }
+
+    std::optional<EntitySelector::Error> EntitySelector::parse_options(std::string_view& rest)
+    {
+        // Options that can only be given once, and whether their value was.
+        bool has_name = false;
+        bool has_type = false;
+        bool has_team = false;
+        bool has_sort = false;
+        bool has_limit = false;
+
+        skip_whitespace(rest);
+        if(!rest.empty() && rest.front() == ']')
+        {
+            rest.remove_prefix(1);
+            return std::nullopt;
+        }
+
+        while(true)
+        {
+            skip_whitespace(rest);
+            auto equals = rest.find('=');
+            if(equals == std::string_view::npos)
+                return "Expected an option, like distance=..10";
+            auto key = rest.substr(0, equals);
+            while(!key.empty() && (key.back() == ' ' || key.back() == '\t'))
+                key.remove_suffix(1);
+            rest.remove_prefix(equals + 1);
+            skip_whitespace(rest);
+
+            auto not_applicable = [&key]() { return fmt::format("Option '{}' isn't applicable here", key); };
+            auto negated = false;
+            if(key == "name" || key == "type" || key == "team" || key == "tag")
+            {
+                negated = !rest.empty() && rest.front() == '!';
+                if(negated)
+                {
+                    rest.remove_prefix(1);
+                    skip_whitespace(rest);
+                }
+            }
+
+            auto read = read_string(rest);
+            if(!read)
+                return fmt::format("Unterminated string in option '{}'", key);
+            auto& value = *read;
+            auto invalid = [&key, &value]() { return fmt::format("Invalid value \"{}\" for option '{}'", value, key); };
+
+            if(key == "x" || key == "y" || key == "z" || key == "dx" || key == "dy" || key == "dz")
+            {
+                auto& option = key == "x" ? m_x : key == "y" ? m_y : key == "z" ? m_z
+                             : key == "dx" ? m_dx : key == "dy" ? m_dy : m_dz;
+                if(option)
+                    return not_applicable();
+                option = to_double(value);
+                if(!option)
+                    return invalid();
+            }
+            else if(key == "distance")
+            {
+                if(m_distance)
+                    return not_applicable();
+                Range range{0, infinity};
+                auto dots = value.find("..");
+                std::optional<double> min, max;
+                if(dots == std::string::npos)
+                {
+                    min = max = to_double(value);
+                    if(!min)
+                        return invalid();
+                }
+                else
+                {
+                    auto min_text = std::string_view(value).substr(0, dots);
+                    auto max_text = std::string_view(value).substr(dots + 2);
+                    if(min_text.empty() && max_text.empty())
+                        return invalid();
+                    if(!min_text.empty() && !(min = to_double(min_text)))
+                        return invalid();
+                    if(!max_text.empty() && !(max = to_double(max_text)))
+                        return invalid();
+                }
+                if(min)
+                    range.min = *min;
+                if(max)
+                    range.max = *max;
+                if(range.min < 0 || range.max < 0)
+                    return std::string("Distance can't be negative");
+                if(range.min > range.max)
+                    return invalid();
+                m_distance = range;
+            }
+            else if(key == "limit")
+            {
+                if(m_self || has_limit)
+                    return not_applicable();
+                int64_t limit = 0;
+                auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), limit);
+                if(value.empty() || error != std::errc() || end != value.data() + value.size())
+                    return invalid();
+                if(limit < 1)
+                    return std::string("Limit must be at least 1");
+                m_limit = static_cast<uint32_t>(std::min<int64_t>(limit, UINT32_MAX));
+                has_limit = true;
+            }
+            else if(key == "sort")
+            {
+                if(m_self || has_sort)
+                    return not_applicable();
+                if(value == "nearest")
+                    m_sort = Sort::Nearest;
+                else if(value == "furthest")
+                    m_sort = Sort::Furthest;
+                else if(value == "random")
+                    m_sort = Sort::Random;
+                else if(value == "arbitrary")
+                    m_sort = Sort::Arbitrary;
+                else
+                    return invalid();
+                has_sort = true;
+            }
+            else if(key == "name")
+            {
+                // Any number of names it isn't, but only one that it is.
+                if(has_name)
+                    return not_applicable();
+                has_name = !negated;
+                add(Test::Name, negated, std::move(value));
+            }
+            else if(key == "type")
+            {
+                if(m_players_only || has_type)
+                    return not_applicable();
+                if(value.empty())
+                    return invalid();
+                has_type = !negated;
+                add(Test::Type, negated, EntitySnapshot::namespaced(value));
+            }
+            else if(key == "team")
+            {
+                if(has_team)
+                    return not_applicable();
+                has_team = !negated;
+                add(Test::Team, negated, std::move(value));
+            }
+            else if(key == "tag")
+            {
+                // tag= is for entities without any, and tag=! for those with some.
+                if(value.empty())
+                    add(Test::HasTags, !negated, {});
+                else
+                    add(Test::Tag, negated, std::move(value));
+            }
+            else
+            {
+                return fmt::format("Unknown or unsupported option '{}'", key);
+            }
+
+            skip_whitespace(rest);
+            if(rest.empty())
+                return std::string("Expected ',' or ']' after an option");
+            auto separator = rest.front();
+            rest.remove_prefix(1);
+            if(separator == ']')
+                return std::nullopt;
+            if(separator != ',')
+                return fmt::format("Expected ',' or ']' after an option, not '{}'", separator);
+        }
+    }
+
+    void EntitySelector::add(Test test, bool negated, std::string operand)
+    {
+        m_program.push_back({test, negated, static_cast<uint32_t>(m_operands.size())});
+        m_operands.push_back(std::move(operand));
+    }
+
+    void EntitySelector::select(const EntitySnapshot& snapshot, const SelectorOrigin& origin,
+                                std::vector<uint32_t>& selected) const
+    {
+        selected.clear();
+
+        // The program, with its strings swapped for the snapshot's ids. A
+        // test for something no entity has is either always true, or never.
+        struct Bound
+        {
+            Test test;
+            bool negated;
+            uint32_t id;
+        };
+        std::vector<Bound> program;
+        program.reserve(m_program.size());
+        for(auto& instruction : m_program)
+        {
+            auto& operand = m_operands[instruction.operand];
+            auto id = 0u;
+            if(instruction.test == Test::Team && operand.empty())
+                id = EntitySnapshot::no_id;
+            else if(instruction.test != Test::HasTags)
+                id = snapshot.id(operand);
+
+            if(id == EntitySnapshot::missing_id)
+            {
+                if(!instruction.negated)
+                    return;
+                continue;
+            }
+            program.push_back({instruction.test, instruction.negated, id});
+        }
+
+        double position[3] = {m_x.value_or(origin.x), m_y.value_or(origin.y), m_z.value_or(origin.z)};
+        auto distance_squared = [&snapshot, &position](uint32_t entity)
+        {
+            auto x = snapshot.m_x[entity] - position[0];
+            auto y = snapshot.m_y[entity] - position[1];
+            auto z = snapshot.m_z[entity] - position[2];
+            return x * x + y * y + z * z;
+        };
+
+        // The blocks from the position to the one at the offset, both included.
+        double volume_low[3] = {-infinity, -infinity, -infinity};
+        double volume_high[3] = {infinity, infinity, infinity};
+        auto has_volume = m_dx || m_dy || m_dz;
+        if(has_volume)
+        {
+            const std::optional<double>* offsets[3] = {&m_dx, &m_dy, &m_dz};
+            for(int axis = 0; axis < 3; axis++)
+            {
+                auto offset = offsets[axis]->value_or(0);
+                volume_low[axis] = position[axis] + std::min(offset, 0.0);
+                volume_high[axis] = position[axis] + std::max(offset, 0.0) + 1;
+            }
+        }
+        auto min_squared = m_distance ? m_distance->min * m_distance->min : 0;
+        auto max_squared = m_distance ? m_distance->max * m_distance->max : infinity;
+
+        // What an entity has to be inside of, which the grid narrows the
+        // candidates down to.
+        double low[3] = {volume_low[0], volume_low[1], volume_low[2]};
+        double high[3] = {volume_high[0], volume_high[1], volume_high[2]};
+        if(m_distance && m_distance->max != infinity)
+        {
+            for(int axis = 0; axis < 3; axis++)
+            {
+                low[axis] = std::max(low[axis], position[axis] - m_distance->max);
+                high[axis] = std::min(high[axis], position[axis] + m_distance->max);
+            }
+        }
+
+        // Candidates are filtered a block at a time, and each block a test
+        // at a time, so that every test is a tight loop over one column.
+        // Without a sort, the first entities to match are the ones selected,
+        // and there's no need to look any further once there's enough.
+        constexpr std::size_t block_size = 256;
+        auto stop_early = m_sort == Sort::Arbitrary;
+        auto filter = [&](std::span<const uint32_t> block, bool players)
+        {
+            auto first = selected.size();
+            selected.insert(selected.end(), block.begin(), block.end());
+            auto keep = [&](auto&& passes)
+            {
+                auto kept = selected.begin() + static_cast<std::ptrdiff_t>(first);
+                for(auto it = kept; it != selected.end(); ++it)
+                {
+                    if(passes(*it))
+                        *kept++ = *it;
+                }
+                selected.erase(kept, selected.end());
+            };
+
+            if(m_players_only && !players)
+                keep([&](uint32_t entity) { return snapshot.is_player(entity); });
+            if(has_volume)
+            {
+                keep([&](uint32_t entity)
+                {
+                    return snapshot.m_x[entity] >= volume_low[0] && snapshot.m_x[entity] < volume_high[0]
+                        && snapshot.m_y[entity] >= volume_low[1] && snapshot.m_y[entity] < volume_high[1]
+                        && snapshot.m_z[entity] >= volume_low[2] && snapshot.m_z[entity] < volume_high[2];
+                });
+            }
+            if(m_distance)
+            {
+                keep([&](uint32_t entity)
+                {
+                    auto distance = distance_squared(entity);
+                    return distance >= min_squared && distance <= max_squared;
+                });
+            }
+
+            for(auto& instruction : program)
+            {
+                auto id = instruction.id;
+                auto negated = instruction.negated;
+                switch(instruction.test)
+                {
+                    case Test::Name:
+                        keep([&](uint32_t entity) { return (snapshot.m_name_ids[entity] == id) != negated; });
+                        break;
+                    case Test::Type:
+                        keep([&](uint32_t entity) { return (snapshot.m_type_ids[entity] == id) != negated; });
+                        break;
+                    case Test::Team:
+                        keep([&](uint32_t entity) { return (snapshot.m_team_ids[entity] == id) != negated; });
+                        break;
+                    case Test::Tag:
+                        keep([&](uint32_t entity)
+                        {
+                            auto begin = snapshot.m_tag_ids.begin() + snapshot.m_tag_offsets[entity];
+                            auto end = snapshot.m_tag_ids.begin() + snapshot.m_tag_offsets[entity + 1];
+                            return (std::find(begin, end, id) != end) != negated;
+                        });
+                        break;
+                    case Test::HasTags:
+                        keep([&](uint32_t entity)
+                        {
+                            return (snapshot.m_tag_offsets[entity + 1] != snapshot.m_tag_offsets[entity]) != negated;
+                        });
+                        break;
+                }
+            }
+            return !(stop_early && selected.size() >= m_limit);
+        };
+        auto filter_all = [&](std::span<const uint32_t> candidates, bool players)
+        {
+            for(std::size_t i = 0; i < candidates.size(); i += block_size)
+            {
+                if(!filter(candidates.subspan(i, std::min(block_size, candidates.size() - i)), players))
+                    break;
+            }
+        };
+
+        if(m_self)
+        {
+            if(origin.entity && *origin.entity < snapshot.size())
+                filter(std::span(&*origin.entity, 1), false);
+        }
+        else
+        {
+            // Each row of cells along Z is one lookup, which only pays off
+            // while there are fewer of them than entities to look at instead.
+            auto scanned = m_players_only ? snapshot.m_players.size() : snapshot.size();
+            int64_t cell_low[3] = {0, 0, 0};
+            int64_t cell_high[3] = {-1, -1, -1};
+            auto rows = 0.0;
+            auto bounded = std::isfinite(low[0]) && std::isfinite(low[1]) && std::isfinite(low[2]);
+            if(bounded)
+            {
+                for(int axis = 0; axis < 3; axis++)
+                {
+                    auto limit = axis == 1 ? EntitySnapshot::cell_limit_y : EntitySnapshot::cell_limit_xz;
+                    cell_low[axis] = EntitySnapshot::cell(low[axis], limit);
+                    cell_high[axis] = EntitySnapshot::cell(high[axis], limit);
+                }
+                rows = static_cast<double>(cell_high[0] - cell_low[0] + 1) * static_cast<double>(cell_high[1] - cell_low[1] + 1);
+                bounded = rows * 4 < static_cast<double>(scanned);
+            }
+
+            // The entities with a name or tag that has to match, when there
+            // are fewer of them than there'd be to look at otherwise.
+            std::optional<std::span<const uint32_t>> posted;
+            for(auto& instruction : program)
+            {
+                if(instruction.negated || (instruction.test != Test::Name && instruction.test != Test::Tag))
+                    continue;
+                auto& postings = instruction.test == Test::Name ? snapshot.m_by_name : snapshot.m_by_tag;
+                auto entities = postings.of(instruction.id);
+                if(!posted || entities.size() < posted->size())
+                    posted = entities;
+            }
+            if(posted && static_cast<double>(posted->size()) >= (bounded ? rows * 4 : static_cast<double>(scanned)))
+                posted.reset();
+
+            if(posted)
+            {
+                filter_all(*posted, false);
+            }
+            else if(bounded)
+            {
+                std::vector<uint32_t> candidates;
+                auto& cells = snapshot.m_cells;
+                for(auto x = cell_low[0]; x <= cell_high[0]; x++)
+                {
+                    for(auto y = cell_low[1]; y <= cell_high[1]; y++)
+                    {
+                        auto first = EntitySnapshot::cell_key(x, y, cell_low[2]);
+                        auto last = EntitySnapshot::cell_key(x, y, cell_high[2]);
+                        auto cell = std::lower_bound(cells.begin(), cells.end(), first,
+                                                     [](const EntitySnapshot::Cell& cell, uint64_t key) { return cell.key < key; });
+                        for(; cell != cells.end() && cell->key <= last; ++cell)
+                        {
+                            candidates.insert(candidates.end(), snapshot.m_cell_entities.begin() + cell->begin,
+                                              snapshot.m_cell_entities.begin() + cell->end);
+                        }
+                    }
+                }
+
+                // Back in the order of the snapshot, like every other way of selecting.
+                std::sort(candidates.begin(), candidates.end());
+                filter_all(candidates, false);
+            }
+            else if(m_players_only)
+            {
+                filter_all(snapshot.m_players, true);
+            }
+            else
+            {
+                uint32_t block[block_size];
+                for(uint32_t begin = 0; begin < snapshot.size(); begin += block_size)
+                {
+                    auto end = static_cast<uint32_t>(std::min<std::size_t>(begin + block_size, snapshot.size()));
+                    for(auto entity = begin; entity < end; entity++)
+                        block[entity - begin] = entity;
+                    if(!filter(std::span(block, end - begin), false))
+                        break;
+                }
+            }
+        }
+
+        auto count = std::min<std::size_t>(selected.size(), m_limit);
+        if(m_sort == Sort::Nearest || m_sort == Sort::Furthest)
+        {
+            // Only as many as the limit are put in order, and ties stay in
+            // the order of the snapshot.
+            std::vector<std::pair<double, uint32_t>> keyed;
+            keyed.reserve(selected.size());
+            for(auto entity : selected)
+                keyed.push_back({m_sort == Sort::Nearest ? distance_squared(entity) : -distance_squared(entity), entity});
+            std::partial_sort(keyed.begin(), keyed.begin() + static_cast<std::ptrdiff_t>(count), keyed.end());
+            for(std::size_t i = 0; i < count; i++)
+                selected[i] = keyed[i].second;
+        }
+        else if(m_sort == Sort::Random)
+        {
+            auto state = origin.seed;
+            for(std::size_t i = 0; i < count; i++)
+            {
+                auto j = i + split_mix(state) % (selected.size() - i);
+                std::swap(selected[i], selected[j]);
+            }
+        }
+        selected.resize(count);
+    }
+
+    const EntitySelector* SelectorCache::get(std::string_view selector)
+    {
+        auto it = m_selectors.find(selector);
+        if(it == m_selectors.end())
+        {
+            auto compiled = EntitySelector::compile(selector);
+            std::optional<EntitySelector> entry;
+            if(compiled.isOk())
+                entry = std::move(compiled.storage().get<EntitySelector>());
+            it = m_selectors.emplace(std::string(selector), std::move(entry)).first;
+        }
+        return it->second ? &*it->second : nullptr;
+    }
+}
@@ -0,0 +1,128 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include "EntitySnapshot.h"
+#include "result.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace LibSoprano
+{
+    // A selector, like @a[distance=..10,team=red], or a player's name,
+    // compiled once so that it can be run against any number of snapshots.
+    //
+    // @a, @e, @p, @r, @s and @n are understood, along with the x, y, z,
+    // distance, dx, dy, dz, limit, sort, name, type, team and tag options,
+    // with the same defaults and restrictions as the game. Entities are
+    // taken to be points, rather than boxes, for volumes. Anything else
+    // (scores, nbt, gamemode and the like, which a snapshot doesn't have)
+    // doesn't compile.
+    //
+    // What's left once the position, bounds, sort and limit are taken out is
+    // a program of tests on names, types, teams and tags, which is bound to
+    // the ids of a snapshot's strings each time it's run.
+    class EntitySelector
+    {
+    public:
+        using Error = std::string;
+
+        static Result<EntitySelector, Error> compile(std::string_view selector);
+
+        // Sets selected to the entities the selector selects, in the order
+        // it sorts them.
+        void select(const EntitySnapshot&, const SelectorOrigin&, std::vector<uint32_t>& selected) const;
+
+    private:
+        enum class Sort : uint8_t
+        {
+            Arbitrary,
+            Nearest,
+            Furthest,
+            Random
+        };
+
+        enum class Test : uint8_t
+        {
+            Name,
+            Type,
+            Team,
+            Tag,
+            // tag= and tag=!, which don't name a tag.
+            HasTags
+        };
+
+        struct Instruction
+        {
+            Test test;
+            bool negated;
+            // Into m_operands.
+            uint32_t operand;
+        };
+
+        struct Range
+        {
+            double min;
+            double max;
+        };
+
+        // Parses the options between the brackets.
+        std::optional<Error> parse_options(std::string_view& rest);
+        void add(Test, bool negated, std::string operand);
+
+        bool m_players_only = false;
+        bool m_self = false;
+        Sort m_sort = Sort::Arbitrary;
+        uint32_t m_limit = UINT32_MAX;
+        std::optional<double> m_x;
+        std::optional<double> m_y;
+        std::optional<double> m_z;
+        std::optional<double> m_dx;
+        std::optional<double> m_dy;
+        std::optional<double> m_dz;
+        std::optional<Range> m_distance;
+        std::vector<Instruction> m_program;
+        std::vector<std::string> m_operands;
+    };
+
+    // Selectors compiled once each, for resolving the same ones over and
+    // over. It grows with every different selector it's asked for, until
+    // it's cleared.
+    class SelectorCache
+    {
+    public:
+        // Null if the selector doesn't compile.
+        const EntitySelector* get(std::string_view selector);
+
+        std::size_t size() const { return m_selectors.size(); }
+        void clear() { m_selectors.clear(); }
+
+    private:
+        struct StringHash
+        {
+            using is_transparent = void;
+            std::size_t operator()(std::string_view string) const { return hash_bytes(string); }
+        };
+
+        std::unordered_map<std::string, std::optional<EntitySelector>, StringHash, std::equal_to<>> m_selectors;
+    };
+}
@@ -0,0 +1,209 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "EntitySnapshot.h"
+#include "ChatComponent.h"
+#include "EntitySelector.h"
+#include "InlineStack.h"
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <utility>
+
+namespace LibSoprano
+{
+    EntitySnapshot::EntitySnapshot(std::span<const Entity> entities)
+    {
+        auto count = entities.size();
+        m_x.reserve(count);
+        m_y.reserve(count);
+        m_z.reserve(count);
+        m_name_ids.reserve(count);
+        m_type_ids.reserve(count);
+        m_team_ids.reserve(count);
+        m_tag_offsets.reserve(count + 1);
+        m_tag_offsets.push_back(0);
+
+        for(auto& entity : entities)
+        {
+            m_x.push_back(entity.x);
+            m_y.push_back(entity.y);
+            m_z.push_back(entity.z);
+            m_name_ids.push_back(intern(entity.name));
+            m_type_ids.push_back(intern(namespaced(entity.type)));
+            m_team_ids.push_back(entity.team.empty() ? no_id : intern(entity.team));
+            auto first_tag = m_tag_ids.size();
+            for(auto& tag : entity.tags)
+            {
+                auto tag_id = intern(tag);
+                if(std::find(m_tag_ids.begin() + static_cast<std::ptrdiff_t>(first_tag), m_tag_ids.end(), tag_id) == m_tag_ids.end())
+                    m_tag_ids.push_back(tag_id);
+            }
+            m_tag_offsets.push_back(static_cast<uint32_t>(m_tag_ids.size()));
+        }
+
+        m_player_type = id("minecraft:player");
+        for(uint32_t i = 0; i < count; i++)
+        {
+            if(is_player(i))
+                m_players.push_back(i);
+        }
+
+        m_by_name = index([this](uint32_t entity) { return std::span(&m_name_ids[entity], 1); });
+        m_by_tag = index([this](uint32_t entity)
+        {
+            return std::span(m_tag_ids).subspan(m_tag_offsets[entity], m_tag_offsets[entity + 1] - m_tag_offsets[entity]);
+        });
+
+        std::vector<std::pair<uint64_t, uint32_t>> keyed(count);
+        for(uint32_t i = 0; i < count; i++)
+            keyed[i] = {cell_key(cell(m_x[i], cell_limit_xz), cell(m_y[i], cell_limit_y), cell(m_z[i], cell_limit_xz)), i};
+        std::sort(keyed.begin(), keyed.end());
+
+        m_cell_entities.reserve(count);
+        for(uint32_t i = 0; i < count; i++)
+        {
+            auto [key, entity] = keyed[i];
+            if(m_cells.empty() || m_cells.back().key != key)
+                m_cells.push_back({key, i, i});
+            m_cells.back().end = i + 1;
+            m_cell_entities.push_back(entity);
+        }
+    }
+
+    template<typename Ids>
+    EntitySnapshot::Postings EntitySnapshot::index(Ids ids_of) const
+    {
+        // Counted first, so that every run is written in place.
+        Postings postings;
+        postings.offsets.assign(m_strings.size() + 1, 0);
+        for(uint32_t entity = 0; entity < size(); entity++)
+        {
+            for(auto id : ids_of(entity))
+                postings.offsets[id + 1]++;
+        }
+        for(std::size_t i = 1; i < postings.offsets.size(); i++)
+            postings.offsets[i] += postings.offsets[i - 1];
+
+        postings.entities.resize(postings.offsets.back());
+        auto next = postings.offsets;
+        for(uint32_t entity = 0; entity < size(); entity++)
+        {
+            for(auto id : ids_of(entity))
+                postings.entities[next[id]++] = entity;
+        }
+        return postings;
+    }
+
+    std::string EntitySnapshot::namespaced(std::string_view type)
+    {
+        if(type.find(':') != std::string_view::npos)
+            return std::string(type);
+        return "minecraft:" + std::string(type);
+    }
+
+    uint32_t EntitySnapshot::intern(std::string_view string)
+    {
+        if(auto it = m_ids.find(string); it != m_ids.end())
+            return it->second;
+
+        auto id = static_cast<uint32_t>(m_strings.size());
+        auto [it, inserted] = m_ids.emplace(std::string(string), id);
+        m_strings.push_back(it->first);
+        return id;
+    }
+
+    uint32_t EntitySnapshot::id(std::string_view string) const
+    {
+        auto it = m_ids.find(string);
+        return it == m_ids.end() ? missing_id : it->second;
+    }
+
+    int64_t EntitySnapshot::cell(double coordinate, int64_t limit)
+    {
+        auto cell = std::floor(coordinate / cell_size);
+        if(!(cell > static_cast<double>(-limit)))
+            return -limit;
+        if(cell > static_cast<double>(limit))
+            return limit;
+        return static_cast<int64_t>(cell);
+    }
+
+    uint64_t EntitySnapshot::cell_key(int64_t x, int64_t y, int64_t z)
+    {
+        return static_cast<uint64_t>(x + cell_limit_xz + 1) << 40 | static_cast<uint64_t>(y + cell_limit_y + 1) << 24
+             | static_cast<uint64_t>(z + cell_limit_xz + 1);
+    }
+
+    std::size_t EntitySnapshot::resolve(std::span<ChatComponent> components, const SelectorOrigin& origin,
+                                        SelectorCache& cache) const
+    {
+        std::size_t resolved = 0;
+        std::vector<uint32_t> selected;
+
+        // Children and arguments alike, without recursing.
+        InlineStack<ChatComponent*> pending;
+        for(auto& component : components)
+            pending.push(&component);
+        while(!pending.empty())
+        {
+            auto component = pending.top();
+            pending.pop();
+
+            // The names go before the children, which aren't looked at again.
+            std::size_t first_child = 0;
+            if(component->m_type == ChatComponent::Type::Selector)
+            {
+                if(auto selector = cache.get(component->text()))
+                {
+                    selector->select(*this, origin, selected);
+
+                    std::vector<ChatComponent> children;
+                    children.reserve(selected.size() * 2 + component->m_children.size());
+                    for(std::size_t i = 0; i < selected.size(); i++)
+                    {
+                        if(i > 0)
+                        {
+                            auto& separator = children.emplace_back();
+                            separator.m_text = Text::borrowed(", ");
+                            separator.m_color = Color::GRAY;
+                        }
+                        children.emplace_back().m_text = Text::owned(name(selected[i]));
+                    }
+                    first_child = children.size();
+                    std::move(component->m_children.begin(), component->m_children.end(), std::back_inserter(children));
+
+                    component->m_children = std::move(children);
+                    component->m_text = {};
+                    component->m_type = ChatComponent::Type::String;
+                    resolved++;
+                }
+            }
+
+            for(auto i = first_child; i < component->m_children.size(); i++)
+                pending.push(&component->m_children[i]);
+            for(auto& argument : component->m_arguments)
+                pending.push(&argument);
+        }
+
+        return resolved;
+    }
+
+    std::size_t EntitySnapshot::resolve(ChatComponent& component, const SelectorOrigin& origin, SelectorCache& cache) const
+    {
+        return resolve(std::span<ChatComponent>(&component, 1), origin, cache);
+    }
+}
@@ -0,0 +1,173 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include "Hash.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace LibSoprano
+{
+    class ChatComponent;
+    class SelectorCache;
+
+    // Where selectors are resolved from: whoever sent the message, or ran
+    // the command that sent it.
+    struct SelectorOrigin
+    {
+        double x = 0;
+        double y = 0;
+        double z = 0;
+        // Its index in the snapshot, which is what @s selects, if it's an
+        // entity at all.
+        std::optional<uint32_t> entity;
+        // Picks the order of sort=random (and @r).
+        uint64_t seed = 0;
+    };
+
+    // A snapshot of the entities in a world, taken by whoever has one, for
+    // resolving selector components against (see EntitySelector.h).
+    //
+    // Entities are kept a column per property, with their names, types,
+    // teams and tags as ids into one table of strings, so that selecting
+    // compares numbers rather than strings. They're also put in a uniform
+    // grid of 16 block cells, sorted so that each row of cells along the Z
+    // axis is in one run, which distance and volume filters take their
+    // candidates from rather than looking at every entity. Players are
+    // listed by themselves too, for @a, @p and @r, as are the entities with
+    // each name and each tag, for selecting a player by name or the few
+    // entities with a tag.
+    //
+    // Nothing changes once a snapshot is taken, so one can be shared between
+    // any number of threads.
+    class EntitySnapshot
+    {
+    public:
+        struct Entity
+        {
+            std::string name;
+            // With or without its namespace, like "minecraft:player" or "player".
+            std::string type;
+            // Empty without one.
+            std::string team;
+            std::vector<std::string> tags;
+            double x = 0;
+            double y = 0;
+            double z = 0;
+        };
+
+        EntitySnapshot() = default;
+        explicit EntitySnapshot(std::span<const Entity>);
+        // Strings are looked up by views of themselves.
+        EntitySnapshot(const EntitySnapshot&) = delete;
+        EntitySnapshot& operator=(const EntitySnapshot&) = delete;
+        EntitySnapshot(EntitySnapshot&&) noexcept = default;
+        EntitySnapshot& operator=(EntitySnapshot&&) noexcept = default;
+
+        std::size_t size() const { return m_x.size(); }
+        std::string_view name(uint32_t entity) const { return m_strings[m_name_ids[entity]]; }
+
+        // Turns every selector component in the components (and their
+        // children and arguments) into the names of the entities it selects
+        // from origin, with a gray ", " between them, followed by its
+        // children, like the server does before sending them. Selectors are
+        // compiled once into the cache, and are left as they are if they
+        // don't compile. Returns how many were resolved.
+        std::size_t resolve(std::span<ChatComponent> components, const SelectorOrigin&, SelectorCache&) const;
+        std::size_t resolve(ChatComponent& component, const SelectorOrigin&, SelectorCache&) const;
+
+    private:
+        friend class EntitySelector;
+
+        // The team of entities without one.
+        static constexpr uint32_t no_id = UINT32_MAX;
+        // A string that no entity has.
+        static constexpr uint32_t missing_id = UINT32_MAX - 1;
+        static constexpr double cell_size = 16;
+
+        // The entities with each string, in order, a run per id.
+        struct Postings
+        {
+            std::vector<uint32_t> offsets;
+            std::vector<uint32_t> entities;
+
+            std::span<const uint32_t> of(uint32_t id) const
+            {
+                return std::span(entities).subspan(offsets[id], offsets[id + 1] - offsets[id]);
+            }
+        };
+
+        // A run of m_cell_entities, all in one cell.
+        struct Cell
+        {
+            uint64_t key;
+            uint32_t begin;
+            uint32_t end;
+        };
+
+        struct StringHash
+        {
+            using is_transparent = void;
+            std::size_t operator()(std::string_view string) const { return hash_bytes(string); }
+        };
+
+        // Types without a namespace are in minecraft.
+        static std::string namespaced(std::string_view type);
+        uint32_t intern(std::string_view);
+        // The id of a string, or missing_id.
+        uint32_t id(std::string_view) const;
+        bool is_player(uint32_t entity) const { return m_type_ids[entity] == m_player_type; }
+        // ids_of(entity) gives the ids an entity has.
+        template<typename Ids>
+        Postings index(Ids ids_of) const;
+
+        // Cells are numbered from the corner of the world, so that keys sort
+        // by X, then Y, then Z.
+        static int64_t cell(double coordinate, int64_t limit);
+        static uint64_t cell_key(int64_t x, int64_t y, int64_t z);
+        static constexpr int64_t cell_limit_xz = (1 << 23) - 1;
+        static constexpr int64_t cell_limit_y = (1 << 15) - 1;
+
+        std::vector<double> m_x;
+        std::vector<double> m_y;
+        std::vector<double> m_z;
+        std::vector<uint32_t> m_name_ids;
+        std::vector<uint32_t> m_type_ids;
+        std::vector<uint32_t> m_team_ids;
+        // The tags of entity i are from m_tag_offsets[i] up to m_tag_offsets[i + 1].
+        std::vector<uint32_t> m_tag_offsets;
+        std::vector<uint32_t> m_tag_ids;
+        std::vector<uint32_t> m_players;
+        uint32_t m_player_type = missing_id;
+        Postings m_by_name;
+        Postings m_by_tag;
+
+        std::unordered_map<std::string, uint32_t, StringHash, std::equal_to<>> m_ids;
+        // Views of the keys of m_ids, which never move.
+        std::vector<std::string_view> m_strings;
+
+        // Sorted by key, as are the entities in each cell.
+        std::vector<Cell> m_cells;
+        std::vector<uint32_t> m_cell_entities;
+    };
+}
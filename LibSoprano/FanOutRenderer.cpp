@@ -0,0 +1,332 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "FanOutRenderer.h"
+#include "AnsiRenderer.h"
+#include "ChatComponent.h"
+#include "HtmlRenderer.h"
+#include "LegacyRenderer.h"
+#include <algorithm>
+
+namespace LibSoprano
+{
+    template<typename Renderer>
+    bool FanOutRenderer<Renderer>::render(const ChatComponent& component, std::span<const LanguageTable* const> languages,
+                                          std::span<Sink* const> sinks)
+    {
+        m_languages = languages;
+        m_output.clear();
+        m_lanes.clear();
+        m_free_lanes.clear();
+        m_active = no_lane;
+        m_pieces.resize(languages.size());
+        for(auto& pieces : m_pieces)
+            pieces.clear();
+        if(languages.empty())
+            return true;
+
+        // Every language starts out in the same lane.
+        m_lanes.push_back({m_prototype, {}});
+        m_lanes[0].renderer.begin(m_sink);
+        for(uint32_t i = 0; i < languages.size(); i++)
+            m_lanes[0].languages.push_back(i);
+        m_root_lanes.assign(1, 0);
+
+        push(component, m_root_lanes);
+        while(m_depth > 0)
+        {
+            auto& level = m_levels[m_depth - 1];
+            auto& current = *level.component;
+            if(level.next_branch < level.branch_count)
+            {
+                if(level.next_segment != level.end_segment)
+                {
+                    auto& segment = *level.next_segment++;
+                    auto& branch = level.branches[level.next_branch];
+                    if(segment.is_argument())
+                    {
+                        push(current.arguments()[segment.argument()], branch.lanes);
+                    }
+                    else
+                    {
+                        // Literal text inherits everything from the translation.
+                        RenderNode literal{branch.language->text(segment), std::nullopt, {}};
+                        enter(branch.lanes, literal);
+                        leave(branch.lanes, literal);
+                    }
+                }
+                else if(++level.next_branch < level.branch_count)
+                {
+                    begin_branch(level);
+                }
+                else
+                {
+                    join(level);
+                }
+            }
+            else if(level.next_child < current.children().size())
+            {
+                push(current.children()[level.next_child++], level.lanes);
+            }
+            else
+            {
+                pop();
+            }
+        }
+
+        for(auto lane : m_levels[0].lanes)
+        {
+            activate(lane);
+            m_lanes[lane].renderer.finish();
+        }
+        deactivate();
+
+        bool succeeded = true;
+        for(std::size_t i = 0; i < sinks.size() && i < m_pieces.size(); i++)
+        {
+            for(auto& piece : m_pieces[i])
+                sinks[i]->write(std::string_view(m_output).substr(piece.offset, piece.length));
+            succeeded &= !sinks[i]->failed();
+        }
+        return succeeded;
+    }
+
+    template<typename Renderer>
+    void FanOutRenderer<Renderer>::push(const ChatComponent& component, std::vector<uint32_t>& lanes)
+    {
+        if(m_depth == m_levels.size())
+            m_levels.emplace_back();
+
+        auto& level = m_levels[m_depth++];
+        level.component = &component;
+        level.lanes.swap(lanes);
+        level.branch_count = 0;
+        level.next_branch = 0;
+        level.next_segment = nullptr;
+        level.end_segment = nullptr;
+        level.next_child = 0;
+
+        if(component.type() == ChatComponent::Type::Translation)
+        {
+            split(level);
+            begin_branch(level);
+        }
+        else
+        {
+            enter(level.lanes, {component.text(), component.color(), component.style()});
+        }
+    }
+
+    template<typename Renderer>
+    void FanOutRenderer<Renderer>::pop()
+    {
+        auto& level = m_levels[m_depth - 1];
+        auto& component = *level.component;
+        leave(level.lanes, {component.text(), component.color(), component.style()});
+
+        // The lanes go back to whatever the component was inside of, split
+        // up or not.
+        if(--m_depth == 0)
+            return;
+        auto& parent = m_levels[m_depth - 1];
+        auto& lanes = parent.next_branch < parent.branch_count ? parent.branches[parent.next_branch].lanes : parent.lanes;
+        lanes.swap(level.lanes);
+    }
+
+    template<typename Renderer>
+    void FanOutRenderer<Renderer>::split(Level& level)
+    {
+        auto& component = *level.component;
+        auto argument_count = component.arguments().size();
+        deactivate();
+
+        for(auto lane : level.lanes)
+        {
+            // Like ChatComponent::walk, a key is shown as it is without a
+            // translation, and a format without enough arguments for it.
+            m_branch_of.clear();
+            for(auto index : m_lanes[lane].languages)
+            {
+                Branch resolved{nullptr, component.text(), nullptr, 0, {}};
+                auto language = m_languages[index];
+                if(auto translation = language ? language->find(component.text()) : std::nullopt)
+                {
+                    resolved.text = translation->format;
+                    if(translation->argument_count <= argument_count)
+                    {
+                        resolved.language = language;
+                        resolved.segments = translation->segments;
+                        resolved.segment_count = translation->segment_count;
+                    }
+                }
+
+                std::size_t branch = 0;
+                while(branch < level.branch_count && !level.branches[branch].same_as(resolved))
+                    branch++;
+                if(branch == level.branch_count)
+                {
+                    if(level.branch_count == level.branches.size())
+                        level.branches.emplace_back();
+                    auto& added = level.branches[level.branch_count++];
+                    resolved.lanes.swap(added.lanes);
+                    added = std::move(resolved);
+                    added.lanes.clear();
+                }
+                m_branch_of.push_back(static_cast<uint32_t>(branch));
+            }
+
+            // Most of the time the whole lane goes the same way.
+            auto first = m_branch_of[0];
+            if(std::all_of(m_branch_of.begin(), m_branch_of.end(), [first](uint32_t branch) { return branch == first; }))
+            {
+                level.branches[first].lanes.push_back(lane);
+                continue;
+            }
+
+            // Otherwise the lane stays with the branch of its first language,
+            // and copies of it go with the others.
+            m_lane_of.assign(level.branch_count, no_lane);
+            m_lane_of[first] = lane;
+            level.branches[first].lanes.push_back(lane);
+            auto languages = std::move(m_lanes[lane].languages);
+            m_lanes[lane].languages.clear();
+            for(std::size_t i = 0; i < languages.size(); i++)
+            {
+                auto branch = m_branch_of[i];
+                if(m_lane_of[branch] == no_lane)
+                {
+                    m_lane_of[branch] = new_lane(lane);
+                    level.branches[branch].lanes.push_back(m_lane_of[branch]);
+                }
+                m_lanes[m_lane_of[branch]].languages.push_back(languages[i]);
+            }
+        }
+
+        level.lanes.clear();
+    }
+
+    template<typename Renderer>
+    void FanOutRenderer<Renderer>::begin_branch(Level& level)
+    {
+        auto& component = *level.component;
+        auto& branch = level.branches[level.next_branch];
+        // A format's pieces come after the translation, which has no text of its own.
+        RenderNode node{branch.language ? std::string_view() : branch.text, component.color(), component.style()};
+        enter(branch.lanes, node);
+        level.next_segment = branch.segments;
+        level.end_segment = branch.segments + branch.segment_count;
+    }
+
+    template<typename Renderer>
+    void FanOutRenderer<Renderer>::join(Level& level)
+    {
+        deactivate();
+        for(std::size_t i = 0; i < level.branch_count; i++)
+            level.lanes.insert(level.lanes.end(), level.branches[i].lanes.begin(), level.branches[i].lanes.end());
+        level.branch_count = 0;
+        level.next_branch = 0;
+
+        // Lanes whose renderers ended up in the same state render the same
+        // from here on.
+        for(std::size_t i = 0; i < level.lanes.size(); i++)
+        {
+            for(std::size_t j = i + 1; j < level.lanes.size();)
+            {
+                auto& kept = m_lanes[level.lanes[i]];
+                auto& merged = m_lanes[level.lanes[j]];
+                if(!kept.renderer.same_state(merged.renderer))
+                {
+                    j++;
+                    continue;
+                }
+
+                kept.languages.insert(kept.languages.end(), merged.languages.begin(), merged.languages.end());
+                merged.languages.clear();
+                m_free_lanes.push_back(level.lanes[j]);
+                level.lanes.erase(level.lanes.begin() + static_cast<std::ptrdiff_t>(j));
+            }
+        }
+    }
+
+    template<typename Renderer>
+    void FanOutRenderer<Renderer>::enter(const std::vector<uint32_t>& lanes, const RenderNode& node)
+    {
+        for(auto lane : lanes)
+        {
+            activate(lane);
+            m_lanes[lane].renderer.enter(node);
+        }
+    }
+
+    template<typename Renderer>
+    void FanOutRenderer<Renderer>::leave(const std::vector<uint32_t>& lanes, const RenderNode& node)
+    {
+        for(auto lane : lanes)
+        {
+            activate(lane);
+            m_lanes[lane].renderer.leave(node);
+        }
+    }
+
+    template<typename Renderer>
+    uint32_t FanOutRenderer<Renderer>::new_lane(uint32_t copy_of)
+    {
+        if(!m_free_lanes.empty())
+        {
+            auto lane = m_free_lanes.back();
+            m_free_lanes.pop_back();
+            m_lanes[lane].renderer = m_lanes[copy_of].renderer;
+            return lane;
+        }
+
+        Lane lane{m_lanes[copy_of].renderer, {}};
+        m_lanes.push_back(std::move(lane));
+        return static_cast<uint32_t>(m_lanes.size() - 1);
+    }
+
+    template<typename Renderer>
+    void FanOutRenderer<Renderer>::activate(uint32_t lane)
+    {
+        if(lane == m_active)
+            return;
+        deactivate();
+        m_active = lane;
+        m_active_start = m_output.size();
+    }
+
+    template<typename Renderer>
+    void FanOutRenderer<Renderer>::deactivate()
+    {
+        if(m_active != no_lane && m_output.size() > m_active_start)
+        {
+            Piece piece{m_active_start, m_output.size() - m_active_start};
+            for(auto language : m_lanes[m_active].languages)
+            {
+                // Runs that follow on from each other are one piece.
+                auto& pieces = m_pieces[language];
+                if(!pieces.empty() && pieces.back().offset + pieces.back().length == piece.offset)
+                    pieces.back().length += piece.length;
+                else
+                    pieces.push_back(piece);
+            }
+        }
+        m_active = no_lane;
+    }
+
+    template class FanOutRenderer<AnsiRenderer>;
+    template class FanOutRenderer<HtmlRenderer>;
+    template class FanOutRenderer<LegacyRenderer>;
+}
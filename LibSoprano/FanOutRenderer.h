@@ -0,0 +1,144 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include "LanguageTable.h"
+#include "RenderNode.h"
+#include "Sink.h"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace LibSoprano
+{
+    class ChatComponent;
+
+    // Renders one component in any number of languages at once, for when the
+    // same message goes out to players who each have their own.
+    //
+    // The component is walked once, and everything outside of translations
+    // is rendered once, with the output shared between every language. A
+    // translation is looked up in each language, and rendering splits into a
+    // lane for each different format it comes out to (often far fewer than
+    // the languages, since most leave formats like "<%s> %s" alone). Lanes
+    // join back up after the translation as soon as their renderers are in
+    // the same state, so what it costs goes with the number of translations,
+    // rather than the size of the component times the number of languages.
+    //
+    // Renderer is AnsiRenderer, HtmlRenderer or LegacyRenderer; each lane
+    // renders with a copy of the one given. A renderer can be reused across
+    // many components, which keeps its scratch memory around.
+    template<typename Renderer>
+    class FanOutRenderer
+    {
+    public:
+        explicit FanOutRenderer(Renderer renderer = Renderer()) : m_prototype(std::move(renderer)), m_sink(m_output) {}
+        // Lanes write to a sink that points at the renderer's own output.
+        FanOutRenderer(const FanOutRenderer&) = delete;
+        FanOutRenderer& operator=(const FanOutRenderer&) = delete;
+
+        // Renders the component in each of the languages to the sink at the
+        // same index; translations are shown as their key with a null
+        // language. Returns false if any of the sinks failed.
+        bool render(const ChatComponent&, std::span<const LanguageTable* const> languages, std::span<Sink* const> sinks);
+
+    private:
+        static constexpr uint32_t no_lane = UINT32_MAX;
+
+        // A run of the output, which languages share.
+        struct Piece
+        {
+            std::size_t offset;
+            std::size_t length;
+        };
+
+        // A renderer, and the languages whose output it's rendering so far.
+        struct Lane
+        {
+            Renderer renderer;
+            std::vector<uint32_t> languages;
+        };
+
+        // What a translation comes out to, in the languages of some lanes:
+        // the pieces of a format, or text shown as it is (its key, or a
+        // format with too few arguments).
+        struct Branch
+        {
+            const LanguageTable* language;
+            // The format, for telling branches apart, or the text.
+            std::string_view text;
+            const LanguageTable::Segment* segments;
+            uint32_t segment_count;
+            std::vector<uint32_t> lanes;
+
+            bool same_as(const Branch& other) const { return (language == nullptr) == (other.language == nullptr) && text == other.text; }
+        };
+
+        // A component being rendered, and the lanes it's being rendered in.
+        // These are kept around between components, along with their vectors.
+        struct Level
+        {
+            const ChatComponent* component;
+            std::vector<uint32_t> lanes;
+            // A translation renders each of its branches in turn, before its
+            // lanes join back up for its children.
+            std::vector<Branch> branches;
+            std::size_t branch_count;
+            std::size_t next_branch;
+            const LanguageTable::Segment* next_segment;
+            const LanguageTable::Segment* end_segment;
+            std::size_t next_child;
+        };
+
+        // The component takes over the lanes until it's done.
+        void push(const ChatComponent&, std::vector<uint32_t>& lanes);
+        void pop();
+        void split(Level&);
+        void begin_branch(Level&);
+        void join(Level&);
+
+        void enter(const std::vector<uint32_t>& lanes, const RenderNode&);
+        void leave(const std::vector<uint32_t>& lanes, const RenderNode&);
+        uint32_t new_lane(uint32_t copy_of);
+
+        // Output is attributed to the languages of a lane when another lane
+        // starts writing, so that a run of it is a single piece.
+        void activate(uint32_t lane);
+        void deactivate();
+
+        Renderer m_prototype;
+        std::string m_output;
+        StringSink m_sink;
+        std::vector<Lane> m_lanes;
+        std::vector<uint32_t> m_free_lanes;
+        uint32_t m_active = no_lane;
+        std::size_t m_active_start = 0;
+        // The pieces of each language's output, in order.
+        std::vector<std::vector<Piece>> m_pieces;
+        // Levels don't move when more are added, so references to them stay good.
+        std::deque<Level> m_levels;
+        std::size_t m_depth = 0;
+        std::vector<uint32_t> m_root_lanes;
+        std::span<const LanguageTable* const> m_languages;
+        // Which branch each language of a lane being split goes to, and which
+        // lane each branch gets.
+        std::vector<uint32_t> m_branch_of;
+        std::vector<uint32_t> m_lane_of;
+    };
+}
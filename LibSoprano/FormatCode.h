@@ -0,0 +1,92 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include "Color.h"
+#include "Style.h"
+#include <array>
+#include <cstdint>
+#include <optional>
+
+namespace LibSoprano
+{
+    // A legacy formatting code: the character following a § (as in §a or §l),
+    // which either sets a named color, enables a style flag, or resets both.
+    // Codes are case-insensitive.
+    class FormatCode
+    {
+    public:
+        enum class Kind : uint8_t
+        {
+            None,
+            Color,
+            Style,
+            Reset
+        };
+
+        static constexpr FormatCode from_char(char);
+
+        constexpr Kind kind() const { return m_kind; }
+        constexpr LibSoprano::Color color() const { return LibSoprano::Color::named_color(m_index); }
+        constexpr Style::Flag flag() const { return static_cast<Style::Flag>(m_index); }
+        // The code for a color or flag, in lowercase.
+        static constexpr char to_char(LibSoprano::Color color) { return color.code(); }
+        static constexpr char to_char(Style::Flag flag) { return s_flag_codes[static_cast<uint8_t>(flag)]; }
+
+        static constexpr char reset_char = 'r';
+
+    private:
+        constexpr FormatCode() = default;
+        constexpr FormatCode(Kind kind, uint8_t index) : m_kind(kind), m_index(index) {}
+
+        static constexpr char s_flag_codes[Style::flag_count] = {'l', 'o', 'n', 'm', 'k'};
+        static const std::array<FormatCode, 128> s_table;
+
+        Kind m_kind = Kind::None;
+        // The named color or style flag.
+        uint8_t m_index = 0;
+    };
+
+    // Colors and flags both go through the same table, with the colors coming
+    // straight from the named color table.
+    inline constexpr std::array<FormatCode, 128> FormatCode::s_table = []()
+    {
+        std::array<FormatCode, 128> table{};
+        auto add = [&table](char code, FormatCode format_code)
+        {
+            table[static_cast<uint8_t>(code)] = format_code;
+            if(code >= 'a' && code <= 'z')
+                table[static_cast<uint8_t>(code - 'a' + 'A')] = format_code;
+        };
+
+        auto named = Color::named_colors();
+        for(uint8_t i = 0; i < named.size(); i++)
+            add(named[i].code, {Kind::Color, i});
+        for(uint8_t i = 0; i < Style::flag_count; i++)
+            add(s_flag_codes[i], {Kind::Style, i});
+        add(reset_char, {Kind::Reset, 0});
+        return table;
+    }();
+
+    constexpr FormatCode FormatCode::from_char(char c)
+    {
+        auto index = static_cast<unsigned char>(c);
+        return index < s_table.size() ? s_table[index] : FormatCode();
+    }
+
+    static_assert(FormatCode::from_char('A').color() == Color::GREEN);
+    static_assert(FormatCode::from_char('l').flag() == Style::Flag::Bold);
+}
@@ -0,0 +1,83 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace LibSoprano
+{
+    // A fast, non-cryptographic 64-bit hash of some bytes, which mixes in a
+    // word at a time and finishes with MurmurHash3's avalanche. It's only
+    // ever used to find things, never to tell them apart, so the quality
+    // needed is that similar inputs (like chat messages that differ by a
+    // name) spread out.
+    inline uint64_t hash_bytes(std::string_view data, uint64_t seed = 0)
+    {
+        constexpr uint64_t multiplier = 0x9E3779B97F4A7C15;
+        auto mix = [](uint64_t hash, uint64_t word)
+        {
+            hash = (hash ^ word) * multiplier;
+            return hash ^ (hash >> 29);
+        };
+
+        auto hash = seed ^ (data.size() * multiplier);
+        auto bytes = data.data();
+        auto size = data.size();
+
+        // Longer inputs go through four independent lanes, so that the
+        // multiplies don't have to wait on each other.
+        if(size >= 32)
+        {
+            // Kept as separate variables, which stops the compiler turning
+            // them into vectors without a 64-bit multiply.
+            auto lane0 = hash, lane1 = hash + 1, lane2 = hash + 2, lane3 = hash + 3;
+            for(; size >= 32; bytes += 32, size -= 32)
+            {
+                uint64_t words[4];
+                memcpy(words, bytes, 32);
+                lane0 = mix(lane0, words[0]);
+                lane1 = mix(lane1, words[1]);
+                lane2 = mix(lane2, words[2]);
+                lane3 = mix(lane3, words[3]);
+            }
+
+            hash = mix(mix(mix(mix(hash, lane0), lane1), lane2), lane3);
+        }
+
+        for(; size >= 8; bytes += 8, size -= 8)
+        {
+            uint64_t word;
+            memcpy(&word, bytes, 8);
+            hash = mix(hash, word);
+        }
+
+        if(size > 0)
+        {
+            uint64_t word = 0;
+            memcpy(&word, bytes, size);
+            hash = mix(hash, word);
+        }
+
+        hash ^= hash >> 33;
+        hash *= 0xFF51AFD7ED558CCD;
+        hash ^= hash >> 33;
+        hash *= 0xC4CEB9FE1A85EC53;
+        hash ^= hash >> 33;
+        return hash;
+    }
+}
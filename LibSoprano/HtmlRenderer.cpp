@@ -0,0 +1,81 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "HtmlRenderer.h"
+#include "ChatArchive.h"
+#include "ChatComponent.h"
+#include "ChatTree.h"
+#include <charconv>
+
+namespace LibSoprano
+{
+    bool HtmlRenderer::render(const ChatComponent& component, Sink& sink)
+    {
+        m_sink = &sink;
+        component.walk(*this, m_language);
+        return !sink.failed();
+    }
+
+    bool HtmlRenderer::render(const ChatTree& tree, Sink& sink)
+    {
+        m_sink = &sink;
+        tree.walk(*this);
+        return !sink.failed();
+    }
+
+    bool HtmlRenderer::render(const ArchivedMessage& message, Sink& sink)
+    {
+        m_sink = &sink;
+        message.walk(*this);
+        return !sink.failed();
+    }
+
+    bool HtmlRenderer::enter(const RenderNode& node)
+    {
+        if(m_sink->failed())
+            return false;
+
+        m_sink->write("<span style=\"");
+
+        if(node.color)
+        {
+            // Same as formatting with "{:x}", but without parsing a format string for every span.
+            char hex[8];
+            auto end = std::to_chars(hex, hex + sizeof(hex), node.color->foreground(), 16).ptr;
+            m_sink->write("color: #");
+            m_sink->write(std::string_view(hex, end - hex));
+            m_sink->write(';');
+        }
+
+        if(auto bold = node.style.bold())
+            m_sink->write(*bold ? "font-weight: bold;" : "font-weight: normal;");
+
+        if(auto italic = node.style.italic())
+            m_sink->write(*italic ? "font-style: italic;" : "font-style: normal;");
+
+        if(auto underlined = node.style.underlined())
+            m_sink->write(*underlined ? "text-decoration-line: underline;" : "text-decoration-line: inherit;");
+
+        m_sink->write("\">");
+        m_sink->write(node.text);
+        return true;
+    }
+
+    void HtmlRenderer::leave(const RenderNode&)
+    {
+        m_sink->write("</span>");
+    }
+}
@@ -0,0 +1,52 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include "RenderNode.h"
+#include "Sink.h"
+
+namespace LibSoprano
+{
+    class ArchivedMessage;
+    class ChatComponent;
+    class ChatTree;
+    class LanguageTable;
+
+    // Renders components as nested, inline-styled HTML spans.
+    class HtmlRenderer
+    {
+    public:
+        // Returns false if the sink failed, leaving the output cut short.
+        bool render(const ChatComponent&, Sink&);
+        bool render(const ChatTree&, Sink&);
+        bool render(const ArchivedMessage&, Sink&);
+        // See AnsiRenderer::set_language.
+        void set_language(const LanguageTable* language) { m_language = language; }
+
+        bool enter(const RenderNode&);
+        void leave(const RenderNode&);
+
+        // See AnsiRenderer::begin. Spans carry no state from one to the
+        // next, so nothing needs finishing, and every state is the same.
+        void begin(Sink& sink) { m_sink = &sink; }
+        void finish() {}
+        bool same_state(const HtmlRenderer&) const { return true; }
+
+    private:
+        Sink* m_sink = nullptr;
+        const LanguageTable* m_language = nullptr;
+    };
+}
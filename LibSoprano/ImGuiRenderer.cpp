@@ -0,0 +1,80 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "ImGuiRenderer.h"
+#include "ChatComponent.h"
+#include "ChatTree.h"
+#include <imgui/imgui_internal.h>
+
+namespace LibSoprano
+{
+    ImFont* ImGuiRenderer::FontOptions::font_for(bool bold, bool italic) const
+    {
+        if(bold && italic)
+            return bold_italic;
+        if(bold)
+            return this->bold;
+        if(italic)
+            return this->italic;
+        return regular;
+    }
+
+    void ImGuiRenderer::render(const ChatComponent& component)
+    {
+        m_first = true;
+        component.walk(*this, m_language);
+    }
+
+    void ImGuiRenderer::render(const ChatTree& tree)
+    {
+        m_first = true;
+        tree.walk(*this);
+    }
+
+    bool ImGuiRenderer::enter(const RenderNode& node)
+    {
+        if(node.color)
+        {
+            // ImGui wants ABGR, our colors are RGB.
+            auto rgb = node.color->foreground();
+            ImGui::PushStyleColor(ImGuiCol_Text, ((rgb & 0xFF) << 16) | (rgb & 0xFF00) | ((rgb >> 16) & 0xFF) | 0xFF000000);
+        }
+
+        // ImGui falls back to its default font for null, which keeps pushes and pops paired.
+        ImFont* font = nullptr;
+        if(m_font_opts)
+            font = m_font_opts->font_for(node.style.bold().value_or(false), node.style.italic().value_or(false));
+        ImGui::PushFont(font);
+
+        // FIXME: Each time we call TextWrapped, it stores the location at which
+        // it wants to wrap back to, which is under the starting character. We
+        // actually want it under the starting character of the FIRST call to this,
+        // so it wraps under the initial parent, and not under it's own start.
+        if(!m_first)
+            ImGui::SameLine(0.0f, 0.0f);
+        m_first = false;
+        ImGui::TextWrapped("%.*s", static_cast<int>(node.text.size()), node.text.data());
+        return true;
+    }
+
+    void ImGuiRenderer::leave(const RenderNode& node)
+    {
+        if(node.color)
+            ImGui::PopStyleColor();
+
+        ImGui::PopFont();
+    }
+}
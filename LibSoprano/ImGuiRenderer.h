@@ -0,0 +1,60 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include "RenderNode.h"
+
+struct ImFont;
+
+namespace LibSoprano
+{
+    class ChatComponent;
+    class ChatTree;
+    class LanguageTable;
+
+    // Draws components into the current ImGui window. This is the only part
+    // of LibSoprano that depends on ImGui, and lives in its own library
+    // (LibSopranoImGui), so that the core never links it.
+    class ImGuiRenderer
+    {
+    public:
+        struct FontOptions
+        {
+            ImFont* regular = nullptr;
+            ImFont* bold = nullptr;
+            ImFont* italic = nullptr;
+            ImFont* bold_italic = nullptr;
+
+            ImFont* font_for(bool bold, bool italic) const;
+        };
+
+        // Without any fonts, everything is drawn in ImGui's default font.
+        explicit ImGuiRenderer(FontOptions* font_opts = nullptr) : m_font_opts(font_opts) {}
+
+        void render(const ChatComponent&);
+        void render(const ChatTree&);
+        // See AnsiRenderer::set_language.
+        void set_language(const LanguageTable* language) { m_language = language; }
+
+        bool enter(const RenderNode&);
+        void leave(const RenderNode&);
+
+    private:
+        FontOptions* m_font_opts;
+        const LanguageTable* m_language = nullptr;
+        bool m_first = true;
+    };
+}
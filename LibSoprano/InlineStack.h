@@ -0,0 +1,59 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+namespace LibSoprano
+{
+    // An explicit stack for walking trees without recursion. The first N
+    // elements are kept inline, so that ordinary messages never allocate,
+    // and anything deeper spills onto the heap.
+    template<typename T, std::size_t N = 32>
+    class InlineStack
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+
+    public:
+        bool empty() const { return m_size == 0; }
+        std::size_t size() const { return m_size; }
+
+        T& top() { return m_size <= N ? m_inline[m_size - 1] : m_spill.back(); }
+
+        void push(const T& value)
+        {
+            if(m_size < N)
+                m_inline[m_size] = value;
+            else
+                m_spill.push_back(value);
+            m_size++;
+        }
+
+        void pop()
+        {
+            if(m_size > N)
+                m_spill.pop_back();
+            m_size--;
+        }
+
+    private:
+        T m_inline[N];
+        std::vector<T> m_spill;
+        std::size_t m_size = 0;
+    };
+}
@@ -0,0 +1,363 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "JsonReader.h"
+
+namespace LibSoprano
+{
+    const char* JsonReader::error_string(Error error)
+    {
+        switch(error)
+        {
+            case Error::None:
+                return "No error";
+            case Error::UnexpectedEnd:
+                return "Unexpected end of input";
+            case Error::UnexpectedCharacter:
+                return "Unexpected character";
+            case Error::InvalidLiteral:
+                return "Invalid literal";
+            case Error::InvalidNumber:
+                return "Invalid number";
+            case Error::InvalidEscape:
+                return "Invalid escape sequence";
+            case Error::InvalidUnicodeEscape:
+                return "Invalid unicode escape sequence";
+            case Error::InvalidUtf8:
+                return "Invalid UTF-8";
+            case Error::ControlCharacterInString:
+                return "Control characters must be escaped";
+            case Error::TrailingCharacters:
+                return "Unexpected characters after the end of the value";
+        }
+
+        return "Unknown error";
+    }
+
+    void JsonReader::push(bool is_object)
+    {
+        constexpr auto inline_depth = sizeof(m_stack) * 8;
+        if(m_depth < inline_depth)
+        {
+            auto& word = m_stack[m_depth / 64];
+            auto bit = uint64_t(1) << (m_depth % 64);
+            word = is_object ? (word | bit) : (word & ~bit);
+        }
+        else
+        {
+            m_deep_stack.resize(m_depth - inline_depth + 1);
+            m_deep_stack.back() = is_object;
+        }
+
+        m_depth++;
+    }
+
+    bool JsonReader::in_object() const
+    {
+        constexpr auto inline_depth = sizeof(m_stack) * 8;
+        auto top = m_depth - 1;
+        if(top < inline_depth)
+            return m_stack[top / 64] & (uint64_t(1) << (top % 64));
+        return m_deep_stack[top - inline_depth];
+    }
+
+    void JsonReader::skip_whitespace()
+    {
+        while(!at_end())
+        {
+            auto c = m_input[m_position];
+            if(c != ' ' && c != '\t' && c != '\n' && c != '\r')
+                return;
+            m_position++;
+        }
+    }
+
+    bool JsonReader::read_literal(std::string_view literal)
+    {
+        if(m_input.substr(m_position, literal.size()) != literal)
+            return fail(Error::InvalidLiteral);
+        m_position += literal.size();
+        return true;
+    }
+
+    bool JsonReader::read_number(std::string_view& number)
+    {
+        auto start = m_position;
+        auto is_digit = [this]()
+        {
+            return !at_end() && m_input[m_position] >= '0' && m_input[m_position] <= '9';
+        };
+
+        if(m_input[m_position] == '-')
+            m_position++;
+
+        if(!is_digit())
+            return fail(Error::InvalidNumber);
+
+        // No leading zeroes are allowed.
+        if(m_input[m_position++] != '0')
+        {
+            while(is_digit())
+                m_position++;
+        }
+
+        if(!at_end() && m_input[m_position] == '.')
+        {
+            m_position++;
+            if(!is_digit())
+                return fail(Error::InvalidNumber);
+            while(is_digit())
+                m_position++;
+        }
+
+        if(!at_end() && (m_input[m_position] == 'e' || m_input[m_position] == 'E'))
+        {
+            m_position++;
+            if(!at_end() && (m_input[m_position] == '+' || m_input[m_position] == '-'))
+                m_position++;
+            if(!is_digit())
+                return fail(Error::InvalidNumber);
+            while(is_digit())
+                m_position++;
+        }
+
+        number = m_input.substr(start, m_position - start);
+        return true;
+    }
+
+    // Validates the multi-byte UTF-8 sequence at the current position (as per
+    // RFC 3629), appending it to out if given.
+    bool JsonReader::read_utf8_sequence(std::string* out)
+    {
+        auto byte = [this](std::size_t offset) -> unsigned char
+        {
+            if(m_position + offset >= m_input.size())
+                return 0;
+            return m_input[m_position + offset];
+        };
+
+        auto lead = byte(0);
+        unsigned char second_min = 0x80;
+        unsigned char second_max = 0xBF;
+        std::size_t length;
+
+        if(lead >= 0xC2 && lead <= 0xDF)
+            length = 2;
+        else if(lead >= 0xE0 && lead <= 0xEF)
+        {
+            length = 3;
+            if(lead == 0xE0)
+                second_min = 0xA0;
+            else if(lead == 0xED)
+                second_max = 0x9F;
+        }
+        else if(lead >= 0xF0 && lead <= 0xF4)
+        {
+            length = 4;
+            if(lead == 0xF0)
+                second_min = 0x90;
+            else if(lead == 0xF4)
+                second_max = 0x8F;
+        }
+        else
+            return fail(Error::InvalidUtf8);
+
+        if(byte(1) < second_min || byte(1) > second_max)
+            return fail(Error::InvalidUtf8);
+
+        for(std::size_t i = 2; i < length; i++)
+        {
+            if(byte(i) < 0x80 || byte(i) > 0xBF)
+                return fail(Error::InvalidUtf8);
+        }
+
+        if(out)
+            out->append(m_input.data() + m_position, length);
+        m_position += length;
+        return true;
+    }
+
+    bool JsonReader::read_string(std::string_view& string, bool& borrowed)
+    {
+        // Skip the opening quote.
+        auto start = ++m_position;
+
+        // Most strings have no escapes at all, so we can hand out a view of the input.
+        while(!at_end())
+        {
+            auto c = static_cast<unsigned char>(m_input[m_position]);
+            if(c == '"')
+            {
+                string = m_input.substr(start, m_position - start);
+                borrowed = true;
+                m_position++;
+                return true;
+            }
+
+            if(c == '\\')
+                break;
+
+            if(c < 0x20)
+                return fail(Error::ControlCharacterInString);
+
+            if(c >= 0x80)
+            {
+                if(!read_utf8_sequence(nullptr))
+                    return false;
+                continue;
+            }
+
+            m_position++;
+        }
+
+        m_scratch.assign(m_input.data() + start, m_position - start);
+
+        auto read_hex = [this](uint32_t& code_unit)
+        {
+            if(m_position + 4 > m_input.size())
+                return fail(Error::InvalidUnicodeEscape);
+
+            code_unit = 0;
+            for(int i = 0; i < 4; i++)
+            {
+                auto c = m_input[m_position++];
+                code_unit <<= 4;
+                if(c >= '0' && c <= '9')
+                    code_unit |= c - '0';
+                else if(c >= 'a' && c <= 'f')
+                    code_unit |= c - 'a' + 10;
+                else if(c >= 'A' && c <= 'F')
+                    code_unit |= c - 'A' + 10;
+                else
+                    return fail(Error::InvalidUnicodeEscape);
+            }
+            return true;
+        };
+
+        while(!at_end())
+        {
+            auto c = static_cast<unsigned char>(m_input[m_position]);
+            if(c == '"')
+            {
+                string = m_scratch;
+                borrowed = false;
+                m_position++;
+                return true;
+            }
+
+            if(c < 0x20)
+                return fail(Error::ControlCharacterInString);
+
+            if(c >= 0x80)
+            {
+                if(!read_utf8_sequence(&m_scratch))
+                    return false;
+                continue;
+            }
+
+            m_position++;
+            if(c != '\\')
+            {
+                m_scratch += static_cast<char>(c);
+                continue;
+            }
+
+            if(at_end())
+                return fail(Error::UnexpectedEnd);
+
+            switch(m_input[m_position++])
+            {
+                case '"':
+                    m_scratch += '"';
+                    break;
+                case '\\':
+                    m_scratch += '\\';
+                    break;
+                case '/':
+                    m_scratch += '/';
+                    break;
+                case 'b':
+                    m_scratch += '\b';
+                    break;
+                case 'f':
+                    m_scratch += '\f';
+                    break;
+                case 'n':
+                    m_scratch += '\n';
+                    break;
+                case 'r':
+                    m_scratch += '\r';
+                    break;
+                case 't':
+                    m_scratch += '\t';
+                    break;
+                case 'u':
+                {
+                    uint32_t code_point;
+                    if(!read_hex(code_point))
+                        return false;
+
+                    // Code points outside of the BMP are escaped as a surrogate pair.
+                    if(code_point >= 0xD800 && code_point <= 0xDBFF)
+                    {
+                        uint32_t low;
+                        if(m_input.substr(m_position, 2) != "\\u")
+                            return fail(Error::InvalidUnicodeEscape);
+                        m_position += 2;
+                        if(!read_hex(low))
+                            return false;
+                        if(low < 0xDC00 || low > 0xDFFF)
+                            return fail(Error::InvalidUnicodeEscape);
+                        code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    else if(code_point >= 0xDC00 && code_point <= 0xDFFF)
+                    {
+                        return fail(Error::InvalidUnicodeEscape);
+                    }
+
+                    if(code_point < 0x80)
+                    {
+                        m_scratch += static_cast<char>(code_point);
+                    }
+                    else if(code_point < 0x800)
+                    {
+                        m_scratch += static_cast<char>(0xC0 | (code_point >> 6));
+                        m_scratch += static_cast<char>(0x80 | (code_point & 0x3F));
+                    }
+                    else if(code_point < 0x10000)
+                    {
+                        m_scratch += static_cast<char>(0xE0 | (code_point >> 12));
+                        m_scratch += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+                        m_scratch += static_cast<char>(0x80 | (code_point & 0x3F));
+                    }
+                    else
+                    {
+                        m_scratch += static_cast<char>(0xF0 | (code_point >> 18));
+                        m_scratch += static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+                        m_scratch += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+                        m_scratch += static_cast<char>(0x80 | (code_point & 0x3F));
+                    }
+                    break;
+                }
+                default:
+                    m_position--;
+                    return fail(Error::InvalidEscape);
+            }
+        }
+
+        return fail(Error::UnexpectedEnd);
+    }
+}
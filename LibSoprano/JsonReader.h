@@ -0,0 +1,242 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace LibSoprano
+{
+    // A strict (RFC 8259) JSON reader that reports SAX events to a handler,
+    // much like nlohmann::json::sax_parse. Unlike nlohmann, a string without
+    // escape sequences is never copied: the handler gets a view straight into
+    // the input, and is told so by the "borrowed" argument.
+    //
+    // The handler must provide:
+    //     bool null();
+    //     bool boolean(bool);
+    //     bool number(std::string_view);
+    //     bool string(std::string_view, bool borrowed);
+    //     bool key(std::string_view);
+    //     bool start_object();
+    //     bool end_object();
+    //     bool start_array();
+    //     bool end_array();
+    // Returning false from any of them stops the parse, leaving error() as None.
+    class JsonReader
+    {
+    public:
+        enum class Error : uint8_t
+        {
+            None,
+            UnexpectedEnd,
+            UnexpectedCharacter,
+            InvalidLiteral,
+            InvalidNumber,
+            InvalidEscape,
+            InvalidUnicodeEscape,
+            InvalidUtf8,
+            ControlCharacterInString,
+            TrailingCharacters
+        };
+
+        static const char* error_string(Error);
+
+        explicit JsonReader(std::string_view input) : m_input(input) {}
+
+        template<typename Handler>
+        bool parse(Handler&);
+
+        Error error() const { return m_error; }
+        // Where reading stopped, which is the location of the error if there was one.
+        std::size_t offset() const { return m_position; }
+        // Where the value that was last reported to the handler starts.
+        std::size_t value_offset() const { return m_value_offset; }
+
+    private:
+        bool at_end() const { return m_position >= m_input.size(); }
+        bool fail(Error error)
+        {
+            m_error = error;
+            return false;
+        }
+
+        void skip_whitespace();
+        bool read_string(std::string_view&, bool& borrowed);
+        bool read_number(std::string_view&);
+        bool read_literal(std::string_view);
+        bool read_utf8_sequence(std::string* out);
+
+        // Whether each open container is an object (true) or an array (false),
+        // kept inline so that ordinary messages don't allocate.
+        void push(bool is_object);
+        void pop() { m_depth--; }
+        bool in_object() const;
+
+        std::string_view m_input;
+        std::size_t m_position = 0;
+        std::size_t m_value_offset = 0;
+        Error m_error = Error::None;
+        std::string m_scratch;
+        std::size_t m_depth = 0;
+        uint64_t m_stack[4] = {};
+        std::vector<bool> m_deep_stack;
+    };
+
+    template<typename Handler>
+    bool JsonReader::parse(Handler& handler)
+    {
+        // Like nlohmann, tolerate a byte order mark.
+        if(m_input.substr(0, 3) == "\xEF\xBB\xBF")
+            m_position = 3;
+
+        // Expects a string key, then the colon following it.
+        auto read_key = [this, &handler]()
+        {
+            skip_whitespace();
+            if(at_end())
+                return fail(Error::UnexpectedEnd);
+            if(m_input[m_position] != '"')
+                return fail(Error::UnexpectedCharacter);
+
+            std::string_view key;
+            bool borrowed;
+            if(!read_string(key, borrowed))
+                return false;
+
+            skip_whitespace();
+            if(at_end())
+                return fail(Error::UnexpectedEnd);
+            if(m_input[m_position] != ':')
+                return fail(Error::UnexpectedCharacter);
+            m_position++;
+
+            return handler.key(key);
+        };
+
+        for(;;)
+        {
+            // We're expecting a value.
+            skip_whitespace();
+            if(at_end())
+                return fail(Error::UnexpectedEnd);
+
+            m_value_offset = m_position;
+            switch(m_input[m_position])
+            {
+                case '{':
+                    m_position++;
+                    if(!handler.start_object())
+                        return false;
+                    skip_whitespace();
+                    if(!at_end() && m_input[m_position] == '}')
+                    {
+                        m_position++;
+                        if(!handler.end_object())
+                            return false;
+                        break;
+                    }
+                    push(true);
+                    if(!read_key())
+                        return false;
+                    continue;
+                case '[':
+                    m_position++;
+                    if(!handler.start_array())
+                        return false;
+                    skip_whitespace();
+                    if(!at_end() && m_input[m_position] == ']')
+                    {
+                        m_position++;
+                        if(!handler.end_array())
+                            return false;
+                        break;
+                    }
+                    push(false);
+                    continue;
+                case '"':
+                {
+                    std::string_view string;
+                    bool borrowed;
+                    if(!read_string(string, borrowed) || !handler.string(string, borrowed))
+                        return false;
+                    break;
+                }
+                case 't':
+                    if(!read_literal("true") || !handler.boolean(true))
+                        return false;
+                    break;
+                case 'f':
+                    if(!read_literal("false") || !handler.boolean(false))
+                        return false;
+                    break;
+                case 'n':
+                    if(!read_literal("null") || !handler.null())
+                        return false;
+                    break;
+                case '-':
+                case '0': case '1': case '2': case '3': case '4':
+                case '5': case '6': case '7': case '8': case '9':
+                {
+                    std::string_view number;
+                    if(!read_number(number) || !handler.number(number))
+                        return false;
+                    break;
+                }
+                default:
+                    return fail(Error::UnexpectedCharacter);
+            }
+
+            // We've just finished a value, so close any containers it completes.
+            for(;;)
+            {
+                skip_whitespace();
+                if(m_depth == 0)
+                {
+                    if(!at_end())
+                        return fail(Error::TrailingCharacters);
+                    return true;
+                }
+
+                if(at_end())
+                    return fail(Error::UnexpectedEnd);
+
+                auto c = m_input[m_position];
+                if(c == ',')
+                {
+                    m_position++;
+                    if(in_object() && !read_key())
+                        return false;
+                    break;
+                }
+
+                if(c == (in_object() ? '}' : ']'))
+                {
+                    m_position++;
+                    auto was_object = in_object();
+                    pop();
+                    if(!(was_object ? handler.end_object() : handler.end_array()))
+                        return false;
+                    continue;
+                }
+
+                return fail(Error::UnexpectedCharacter);
+            }
+        }
+    }
+}
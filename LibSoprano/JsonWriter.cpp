@@ -0,0 +1,201 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "JsonWriter.h"
+#include "ChatArchive.h"
+#include "ChatComponent.h"
+#include "ChatTree.h"
+#include <array>
+
+namespace LibSoprano
+{
+    namespace
+    {
+        // What each byte is written as inside a string: 0 for itself, 'u'
+        // for a \u escape, or the letter of its short escape.
+        constexpr std::array<char, 256> s_escapes = []()
+        {
+            std::array<char, 256> escapes{};
+            for(int c = 0; c < 0x20; c++)
+                escapes[c] = 'u';
+            escapes['\b'] = 'b';
+            escapes['\f'] = 'f';
+            escapes['\n'] = 'n';
+            escapes['\r'] = 'r';
+            escapes['\t'] = 't';
+            escapes['"'] = '"';
+            escapes['\\'] = '\\';
+            return escapes;
+        }();
+
+        constexpr const char* s_flag_keys[Style::flag_count] =
+        {
+            ",\"bold\":",
+            ",\"italic\":",
+            ",\"underlined\":",
+            ",\"strikethrough\":",
+            ",\"obfuscated\":"
+        };
+    }
+
+    bool JsonWriter::render(const ChatComponent& component, Sink& sink)
+    {
+        m_sink = &sink;
+        m_frames.clear();
+        component.walk(*this);
+        return !sink.failed();
+    }
+
+    bool JsonWriter::render(const ChatTree& tree, Sink& sink)
+    {
+        m_sink = &sink;
+        m_frames.clear();
+        tree.walk(*this);
+        return !sink.failed();
+    }
+
+    bool JsonWriter::render(const ArchivedMessage& message, Sink& sink)
+    {
+        m_sink = &sink;
+        m_frames.clear();
+        message.walk(*this);
+        return !sink.failed();
+    }
+
+    void JsonWriter::write_string(Sink& sink, std::string_view string)
+    {
+        static constexpr char hex[] = "0123456789abcdef";
+
+        sink.write('"');
+        // Runs of bytes that don't need escaping are written all at once.
+        std::size_t run = 0;
+        for(std::size_t i = 0; i < string.size(); i++)
+        {
+            auto escape = s_escapes[static_cast<unsigned char>(string[i])];
+            if(!escape)
+                continue;
+
+            sink.write(string.substr(run, i - run));
+            run = i + 1;
+
+            if(escape == 'u')
+            {
+                auto c = static_cast<unsigned char>(string[i]);
+                char sequence[] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF]};
+                sink.write(std::string_view(sequence, sizeof(sequence)));
+            }
+            else
+            {
+                char sequence[] = {'\\', escape};
+                sink.write(std::string_view(sequence, sizeof(sequence)));
+            }
+        }
+        sink.write(string.substr(run));
+        sink.write('"');
+    }
+
+    bool JsonWriter::enter(const RenderNode& node)
+    {
+        if(m_sink->failed())
+            return false;
+
+        // Roots inherit nothing, which is the same as every flag being false.
+        Frame inherited{};
+        if(!m_frames.empty())
+        {
+            // A translation's arguments all come before its children.
+            auto& parent = m_frames.back();
+            if(node.is_argument)
+            {
+                m_sink->write(parent.has_arguments ? "," : ",\"with\":[");
+                parent.has_arguments = true;
+            }
+            else
+            {
+                if(parent.has_arguments && !parent.has_children)
+                    m_sink->write("]");
+                m_sink->write(parent.has_children ? "," : ",\"extra\":[");
+                parent.has_children = true;
+            }
+            inherited = parent;
+        }
+
+        auto canonical = m_mode == Mode::Canonical;
+        if(node.score)
+        {
+            m_sink->write("{\"score\":{\"name\":");
+            write_string(*m_sink, node.score->name);
+            m_sink->write(",\"objective\":");
+            write_string(*m_sink, node.score->objective);
+            if(!node.text.empty())
+            {
+                m_sink->write(",\"value\":");
+                write_string(*m_sink, node.text);
+            }
+            m_sink->write('}');
+        }
+        else
+        {
+            m_sink->write(node.is_translation ? "{\"translate\":" : node.is_selector ? "{\"selector\":" : "{\"text\":");
+            write_string(*m_sink, node.text);
+        }
+
+        if(node.color && !(canonical && node.color == inherited.color))
+        {
+            m_sink->write(",\"color\":");
+            if(node.color->is_named())
+            {
+                auto code = node.color->code();
+                auto index = code <= '9' ? code - '0' : code - 'a' + 10;
+                m_sink->write('"');
+                m_sink->write(Color::named_colors()[index].name);
+                m_sink->write('"');
+            }
+            else
+            {
+                static constexpr char hex[] = "0123456789abcdef";
+                auto foreground = node.color->foreground();
+                char color[9] = {'"', '#'};
+                for(int i = 0; i < 6; i++)
+                    color[2 + i] = hex[(foreground >> (20 - i * 4)) & 0xF];
+                color[8] = '"';
+                m_sink->write(std::string_view(color, sizeof(color)));
+            }
+        }
+
+        auto style = node.style.inherit(inherited.style);
+        for(int i = 0; i < Style::flag_count; i++)
+        {
+            auto flag = static_cast<Style::Flag>(i);
+            auto value = node.style.get(flag);
+            if(!value || (canonical && *value == inherited.style.is_enabled(flag)))
+                continue;
+
+            m_sink->write(s_flag_keys[i]);
+            m_sink->write(*value ? "true" : "false");
+        }
+
+        m_frames.push_back({node.color ? node.color : inherited.color, style, false, false});
+        return true;
+    }
+
+    void JsonWriter::leave(const RenderNode&)
+    {
+        auto& frame = m_frames.back();
+        m_sink->write(frame.has_arguments || frame.has_children ? "]}" : "}");
+        m_frames.pop_back();
+    }
+}
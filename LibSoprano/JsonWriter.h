@@ -0,0 +1,81 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include "RenderNode.h"
+#include "Sink.h"
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace LibSoprano
+{
+    class ArchivedMessage;
+    class ChatComponent;
+    class ChatTree;
+
+    // Writes components back out as JSON, straight into a sink, without
+    // building a DOM. Keys always come in the same order (text, translate,
+    // score or selector, color, bold, italic, underlined, strikethrough,
+    // obfuscated, with, extra), without any whitespace, and strings only
+    // escape what JSON requires them to. Translations and selectors are
+    // written as they are, not resolved, and scores with what they show as
+    // their "value", if anything.
+    class JsonWriter
+    {
+    public:
+        enum class Mode : uint8_t
+        {
+            // Everything the component has, as it has it.
+            Minified,
+            // Also leaves out colors and flags that are the same as what would
+            // be inherited anyway, so that components which only differ in
+            // those write the same bytes. Meant for cache and dedup keys.
+            Canonical
+        };
+
+        explicit JsonWriter(Mode mode = Mode::Minified) : m_mode(mode) {}
+
+        // Returns false if the sink failed, leaving the output cut short.
+        bool render(const ChatComponent&, Sink&);
+        bool render(const ChatTree&, Sink&);
+        bool render(const ArchivedMessage&, Sink&);
+
+        // Tells ChatComponent::walk to leave translations as they are.
+        static constexpr bool keeps_translations = true;
+        bool enter(const RenderNode&);
+        void leave(const RenderNode&);
+
+        // Writes a JSON string, quotes included.
+        static void write_string(Sink&, std::string_view);
+
+    private:
+        // What a component ends up with after inheritance, and whether its
+        // "with" and "extra" arrays have been opened yet.
+        struct Frame
+        {
+            std::optional<Color> color;
+            Style style;
+            bool has_arguments;
+            bool has_children;
+        };
+
+        Mode m_mode;
+        Sink* m_sink = nullptr;
+        // The component that we're inside of, innermost last.
+        std::vector<Frame> m_frames;
+    };
+}
@@ -0,0 +1,406 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "LanguageTable.h"
+#include "Hash.h"
+#include "JsonReader.h"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <unordered_map>
+#include <fmt/format.h>
+
+namespace LibSoprano
+{
+    namespace
+    {
+        // Roughly how many keys share a seed, and how much room the slots
+        // leave: more of either and building the table takes longer.
+        constexpr uint32_t s_keys_per_seed = 4;
+        constexpr uint32_t s_extra_slots_per_key = 8;
+        // Tries this many seeds for a bucket before starting over with
+        // another hash, which only happens if two keys hash the same.
+        constexpr uint32_t s_max_seed = 1 << 20;
+
+        // Maps a 32-bit value onto [0, count) without a division.
+        uint32_t scale(uint64_t value, uint32_t count)
+        {
+            return static_cast<uint32_t>((value & 0xFFFFFFFF) * count >> 32);
+        }
+
+        uint32_t bucket_of(uint64_t hash, uint32_t bucket_count) { return scale(hash, bucket_count); }
+
+        uint32_t slot_of(uint64_t hash, uint32_t seed, uint32_t slot_count)
+        {
+            auto mixed = (hash ^ seed) * 0x9E3779B97F4A7C15;
+            return scale(mixed >> 32, slot_count);
+        }
+
+        bool is_digit(char c) { return c >= '0' && c <= '9'; }
+    }
+
+    // Reads the file's keys and formats, then splits the formats up.
+    struct LanguageTable::Builder
+    {
+        struct Pair
+        {
+            uint32_t key_offset;
+            uint32_t key_length;
+            uint32_t format_offset;
+            uint32_t format_length;
+        };
+
+        Builder(LanguageTable& table, std::string_view data) : table(table), data(data) {}
+
+        LanguageTable& table;
+        std::string_view data;
+        std::vector<Pair> pairs;
+        // The last key, already placed, as an unescaped key's view is only
+        // good until the next event.
+        uint32_t key_offset = 0;
+        uint32_t key_length = 0;
+        std::size_t depth = 0;
+        bool not_an_object = false;
+        bool not_a_string = false;
+
+        // Where a string is in the table, copying it if it isn't in the file.
+        uint32_t place(std::string_view string)
+        {
+            auto begin = data.data();
+            auto end = begin + data.size();
+            if(std::less_equal<const char*>()(begin, string.data()) && std::less_equal<const char*>()(string.data() + string.size(), end))
+                return static_cast<uint32_t>(string.data() - begin);
+
+            auto offset = static_cast<uint32_t>(data.size() + table.m_unescaped.size());
+            table.m_unescaped.append(string);
+            return offset;
+        }
+
+        bool value(bool is_container)
+        {
+            if(depth == 0)
+            {
+                not_an_object = true;
+                return false;
+            }
+            if(depth == 1)
+            {
+                not_a_string = true;
+                return false;
+            }
+            if(is_container)
+                depth++;
+            return true;
+        }
+
+        bool null() { return value(false); }
+        bool boolean(bool) { return value(false); }
+        bool number(std::string_view) { return value(false); }
+        bool string(std::string_view string, bool)
+        {
+            if(depth != 1)
+                return value(false);
+
+            pairs.push_back({key_offset, key_length, place(string), static_cast<uint32_t>(string.size())});
+            return true;
+        }
+        bool key(std::string_view key)
+        {
+            if(depth == 1)
+            {
+                key_offset = place(key);
+                key_length = static_cast<uint32_t>(key.size());
+            }
+            return true;
+        }
+        bool start_object()
+        {
+            if(depth == 0)
+            {
+                depth++;
+                return true;
+            }
+            return value(true);
+        }
+        bool end_object()
+        {
+            depth--;
+            return true;
+        }
+        bool start_array() { return value(true); }
+        bool end_array() { return end_object(); }
+
+        // Splits a format the way the client does: %s takes the next
+        // argument, %1$s a given one, and %% is a literal %. The language
+        // loader also turns %d and %f (with any precision) into %s first.
+        // Anything else makes the whole format literal.
+        void split(const Pair& pair, Entry& entry)
+        {
+            auto format = table.string(pair.format_offset, pair.format_length);
+            auto first_segment = table.m_segments.size();
+            uint32_t next_argument = 0;
+            uint32_t argument_count = 0;
+            std::size_t literal_start = 0;
+            auto valid = true;
+
+            auto add_literal = [&](std::size_t end)
+            {
+                if(end > literal_start)
+                {
+                    Segment segment;
+                    segment.m_offset = pair.format_offset + static_cast<uint32_t>(literal_start);
+                    segment.m_length = static_cast<uint32_t>(end - literal_start);
+                    table.m_segments.push_back(segment);
+                }
+            };
+
+            for(std::size_t i = 0; valid && i < format.size();)
+            {
+                if(format[i] != '%')
+                {
+                    i++;
+                    continue;
+                }
+
+                auto at = i + 1;
+                std::optional<uint32_t> index;
+                auto digits_end = at;
+                while(digits_end < format.size() && is_digit(format[digits_end]))
+                    digits_end++;
+                if(digits_end > at && digits_end < format.size() && format[digits_end] == '$')
+                {
+                    // Anything too large for an int is past the arguments anyway.
+                    if(digits_end - at > 9)
+                    {
+                        valid = false;
+                        break;
+                    }
+                    uint32_t number = 0;
+                    for(auto c : format.substr(at, digits_end - at))
+                        number = number * 10 + static_cast<uint32_t>(c - '0');
+                    index = number;
+                    at = digits_end + 1;
+                }
+
+                auto precision_end = at;
+                while(precision_end < format.size() && (is_digit(format[precision_end]) || format[precision_end] == '.'))
+                    precision_end++;
+
+                auto end = at;
+                char type = 0;
+                if(precision_end < format.size() && (format[precision_end] == 'd' || format[precision_end] == 'f'))
+                {
+                    type = 's';
+                    end = precision_end + 1;
+                }
+                else if(at < format.size())
+                {
+                    type = format[at];
+                    end = at + 1;
+                }
+
+                if(type == '%' && !index)
+                {
+                    // The first % stays in the literal, and the second is left out.
+                    add_literal(i + 1);
+                    literal_start = end;
+                }
+                else if(type == 's' && index != 0u)
+                {
+                    add_literal(i);
+                    auto argument = index ? *index - 1 : next_argument++;
+                    Segment segment;
+                    segment.m_offset = argument;
+                    segment.m_length = Segment::argument_length;
+                    table.m_segments.push_back(segment);
+                    argument_count = std::max(argument_count, argument + 1);
+                    literal_start = end;
+                }
+                else
+                {
+                    valid = false;
+                    break;
+                }
+                i = end;
+            }
+
+            if(valid)
+            {
+                add_literal(format.size());
+            }
+            else
+            {
+                table.m_segments.resize(first_segment);
+                literal_start = 0;
+                argument_count = 0;
+                add_literal(format.size());
+            }
+
+            entry.format_offset = pair.format_offset;
+            entry.format_length = pair.format_length;
+            entry.first_segment = static_cast<uint32_t>(first_segment);
+            entry.segment_count = static_cast<uint32_t>(table.m_segments.size() - first_segment);
+            entry.argument_count = argument_count;
+        }
+
+        // Finds a seed for every bucket of keys that puts each of them in a
+        // slot of its own, starting with the largest buckets, which are the
+        // hardest to place. Returns false if some bucket can't be placed.
+        bool place_keys(const std::vector<Pair>& unique, const std::vector<uint64_t>& hashes)
+        {
+            auto slot_count = static_cast<uint32_t>(unique.size() + unique.size() / s_extra_slots_per_key + 1);
+            auto bucket_count = static_cast<uint32_t>(unique.size() / s_keys_per_seed + 1);
+
+            // The keys of each bucket, with the buckets in order.
+            std::vector<uint32_t> bucket_starts(bucket_count + 1);
+            for(auto hash : hashes)
+                bucket_starts[bucket_of(hash, bucket_count) + 1]++;
+            for(uint32_t i = 0; i < bucket_count; i++)
+                bucket_starts[i + 1] += bucket_starts[i];
+            std::vector<uint32_t> bucket_keys(unique.size());
+            {
+                auto next = bucket_starts;
+                for(uint32_t i = 0; i < unique.size(); i++)
+                    bucket_keys[next[bucket_of(hashes[i], bucket_count)]++] = i;
+            }
+
+            std::vector<uint32_t> order(bucket_count);
+            for(uint32_t i = 0; i < bucket_count; i++)
+                order[i] = i;
+            std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+            {
+                return bucket_starts[a + 1] - bucket_starts[a] > bucket_starts[b + 1] - bucket_starts[b];
+            });
+
+            std::vector<bool> taken(slot_count);
+            std::vector<uint32_t> slots;
+            table.m_seeds.assign(bucket_count, 0);
+            for(auto bucket : order)
+            {
+                auto first = bucket_starts[bucket];
+                auto last = bucket_starts[bucket + 1];
+                if(first == last)
+                    break;
+
+                uint32_t seed = 0;
+                for(; seed < s_max_seed; seed++)
+                {
+                    slots.clear();
+                    auto fits = true;
+                    for(auto i = first; fits && i < last; i++)
+                    {
+                        auto slot = slot_of(hashes[bucket_keys[i]], seed, slot_count);
+                        fits = !taken[slot] && std::find(slots.begin(), slots.end(), slot) == slots.end();
+                        slots.push_back(slot);
+                    }
+                    if(fits)
+                        break;
+                }
+                if(seed == s_max_seed)
+                    return false;
+
+                table.m_seeds[bucket] = seed;
+                for(auto slot : slots)
+                    taken[slot] = true;
+            }
+
+            table.m_entries.assign(slot_count, Entry{0, UINT32_MAX, 0, 0, 0, 0, 0});
+            for(uint32_t i = 0; i < unique.size(); i++)
+            {
+                auto& entry = table.m_entries[table.slot(hashes[i])];
+                entry.key_offset = unique[i].key_offset;
+                entry.key_length = unique[i].key_length;
+                split(unique[i], entry);
+            }
+            return true;
+        }
+
+        void build()
+        {
+            // A key that's there more than once has its last translation.
+            std::unordered_map<std::string_view, uint32_t> indices;
+            std::vector<Pair> unique;
+            for(auto& pair : pairs)
+            {
+                auto [it, inserted] = indices.try_emplace(table.string(pair.key_offset, pair.key_length),
+                                                          static_cast<uint32_t>(unique.size()));
+                if(inserted)
+                    unique.push_back(pair);
+                else
+                    unique[it->second] = pair;
+            }
+
+            std::vector<uint64_t> hashes(unique.size());
+            for(;; table.m_hash_seed++)
+            {
+                for(std::size_t i = 0; i < unique.size(); i++)
+                    hashes[i] = hash_bytes(table.string(unique[i].key_offset, unique[i].key_length), table.m_hash_seed);
+                if(place_keys(unique, hashes))
+                    break;
+            }
+            table.m_size = unique.size();
+        }
+    };
+
+    Result<LanguageTable, LanguageTable::Error> LanguageTable::open(const std::string& path)
+    {
+        auto file = MappedFile::open(path);
+        if(file.isErr())
+            return Err(std::move(file.storage().get<std::string>()));
+
+        LanguageTable table(std::move(file.storage().get<MappedFile>()));
+        auto data = table.m_file.data();
+        // Unescaped strings go after the file, and are never longer than they were in it.
+        if(data.size() > UINT32_MAX / 2)
+            return Err(fmt::format("{} is too large to be a language file", path));
+
+        Builder builder(table, data);
+        JsonReader reader(data);
+        if(!reader.parse(builder))
+        {
+            if(builder.not_an_object)
+                return Err(fmt::format("{}: A language file must be an object", path));
+            if(builder.not_a_string)
+                return Err(fmt::format("{}: Translation of \"{}\" must be a string", path,
+                                       table.string(builder.key_offset, builder.key_length)));
+            return Err(fmt::format("{}: Syntax error at byte {}: {}", path, reader.offset(),
+                                   JsonReader::error_string(reader.error())));
+        }
+
+        builder.build();
+        table.m_hash = hash_bytes(data);
+        return Ok(std::move(table));
+    }
+
+    uint32_t LanguageTable::slot(uint64_t hash) const
+    {
+        auto bucket = bucket_of(hash, static_cast<uint32_t>(m_seeds.size()));
+        return slot_of(hash, m_seeds[bucket], static_cast<uint32_t>(m_entries.size()));
+    }
+
+    std::optional<LanguageTable::Translation> LanguageTable::find(std::string_view key) const
+    {
+        if(m_size == 0)
+            return std::nullopt;
+
+        auto& entry = m_entries[slot(hash_bytes(key, m_hash_seed))];
+        if(entry.key_length != key.size() || string(entry.key_offset, entry.key_length) != key)
+            return std::nullopt;
+
+        return Translation{string(entry.format_offset, entry.format_length), m_segments.data() + entry.first_segment,
+                           entry.segment_count, entry.argument_count};
+    }
+}
@@ -0,0 +1,126 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include "MappedFile.h"
+#include "result.h"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace LibSoprano
+{
+    // The translations of one language, read from a language file like
+    // en_us.json: a single object of translation keys and their formats,
+    // such as "chat.type.text": "<%s> %s".
+    //
+    // The file is mapped into memory and stays that way, so keys and formats
+    // point straight into it, unless they had escapes to undo. Keys are found
+    // through a perfect hash, built when the file is opened: a seed for every
+    // few keys picks where each of them goes, so that no two share a slot,
+    // and a lookup is one hash of the key and one comparison. Formats are
+    // split up front into literal text and the arguments that go between it,
+    // so resolving one never looks at the format again.
+    //
+    // Nothing changes once a table is open, so one can be shared between any
+    // number of threads.
+    class LanguageTable
+    {
+    public:
+        using Error = std::string;
+
+        // A piece of a format: either literal text, or which argument goes there.
+        class Segment
+        {
+        public:
+            bool is_argument() const { return m_length == argument_length; }
+            // Counting from 0.
+            uint32_t argument() const { return m_offset; }
+
+        private:
+            friend class LanguageTable;
+            static constexpr uint32_t argument_length = UINT32_MAX;
+
+            // Into the table's strings, or the argument.
+            uint32_t m_offset;
+            uint32_t m_length;
+        };
+
+        struct Translation
+        {
+            // The format as it is in the file.
+            std::string_view format;
+            const Segment* segments;
+            uint32_t segment_count;
+            // How many arguments a component needs for the format to be used.
+            // With any fewer, it's shown as it is, like a format with a %
+            // that isn't %s, %1$s or %% (which is a single literal segment).
+            uint32_t argument_count;
+        };
+
+        static Result<LanguageTable, Error> open(const std::string& path);
+
+        // The translation of a key, if there is one; otherwise the key itself
+        // is what's shown.
+        std::optional<Translation> find(std::string_view key) const;
+        std::string_view text(const Segment& segment) const { return string(segment.m_offset, segment.m_length); }
+
+        std::size_t size() const { return m_size; }
+        // Tells languages apart, for caching what they render.
+        uint64_t hash() const { return m_hash; }
+
+    private:
+        struct Entry
+        {
+            uint32_t key_offset;
+            uint32_t key_length;
+            uint32_t format_offset;
+            uint32_t format_length;
+            uint32_t first_segment;
+            uint32_t segment_count;
+            uint32_t argument_count;
+        };
+
+        struct Builder;
+
+        explicit LanguageTable(MappedFile file) : m_file(std::move(file)) {}
+
+        // Strings are at an offset into the file, or past its end into the
+        // strings that had escapes.
+        std::string_view string(uint32_t offset, uint32_t length) const
+        {
+            auto data = m_file.data();
+            if(offset < data.size())
+                return data.substr(offset, length);
+            return std::string_view(m_unescaped).substr(offset - data.size(), length);
+        }
+
+        uint32_t slot(uint64_t hash) const;
+
+        MappedFile m_file;
+        std::string m_unescaped;
+        std::vector<Segment> m_segments;
+        // Slots with no key in them have a key length of UINT32_MAX.
+        std::vector<Entry> m_entries;
+        std::vector<uint32_t> m_seeds;
+        std::size_t m_size = 0;
+        uint64_t m_hash_seed = 0;
+        uint64_t m_hash = 0;
+    };
+}
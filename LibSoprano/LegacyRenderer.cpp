@@ -0,0 +1,201 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "LegacyRenderer.h"
+#include "ChatArchive.h"
+#include "ChatComponent.h"
+#include "ChatTree.h"
+#include "FormatCode.h"
+#include "LegacyText.h"
+#include <limits>
+
+namespace LibSoprano
+{
+    namespace
+    {
+        // The codes written before a run of text, built up on the stack: at
+        // most a hex color (seven codes) and every flag.
+        class Codes
+        {
+        public:
+            void append(char code)
+            {
+                m_buffer[m_size++] = LegacyText::section_sign[0];
+                m_buffer[m_size++] = LegacyText::section_sign[1];
+                m_buffer[m_size++] = code;
+            }
+
+            void append_color(const Color& color)
+            {
+                if(color.is_named())
+                {
+                    append(FormatCode::to_char(color));
+                    return;
+                }
+
+                static constexpr char hex[] = "0123456789abcdef";
+                append('x');
+                for(int i = 0; i < 6; i++)
+                    append(hex[(color.foreground() >> (20 - i * 4)) & 0xF]);
+            }
+
+            std::string_view view() const { return {m_buffer, m_size}; }
+
+        private:
+            char m_buffer[3 * (7 + Style::flag_count)];
+            std::size_t m_size = 0;
+        };
+
+        Color nearest_named_color(const Color& color)
+        {
+            auto rgb = color.foreground();
+            int r = (rgb >> 16) & 0xFF;
+            int g = (rgb >> 8) & 0xFF;
+            int b = rgb & 0xFF;
+
+            auto named = Color::named_colors();
+            uint8_t best = 0;
+            auto best_distance = std::numeric_limits<int>::max();
+            for(uint8_t i = 0; i < named.size(); i++)
+            {
+                auto foreground = named[i].foreground;
+                auto dr = r - static_cast<int>(foreground >> 16);
+                auto dg = g - static_cast<int>((foreground >> 8) & 0xFF);
+                auto db = b - static_cast<int>(foreground & 0xFF);
+                auto distance = dr * dr + dg * dg + db * db;
+                if(distance < best_distance)
+                {
+                    best = i;
+                    best_distance = distance;
+                }
+            }
+            return Color::named_color(best);
+        }
+    }
+
+    bool LegacyRenderer::render(const ChatComponent& component, Sink& sink)
+    {
+        begin(sink);
+        component.walk(*this, m_language);
+        return !sink.failed();
+    }
+
+    bool LegacyRenderer::render(const ChatTree& tree, Sink& sink)
+    {
+        begin(sink);
+        tree.walk(*this);
+        return !sink.failed();
+    }
+
+    bool LegacyRenderer::render(const ArchivedMessage& message, Sink& sink)
+    {
+        begin(sink);
+        message.walk(*this);
+        return !sink.failed();
+    }
+
+    void LegacyRenderer::begin(Sink& sink)
+    {
+        m_sink = &sink;
+        m_current = {};
+        m_current_known = true;
+        m_states.clear();
+    }
+
+    void LegacyRenderer::transition_to(const State& target, bool any_color)
+    {
+        auto same_color = any_color || target.color == m_current.color;
+        auto adds_only = (m_current.style.bits() & ~target.style.bits()) == 0;
+        if(m_current_known && same_color && target.style == m_current.style)
+            return;
+
+        Codes codes;
+        if(m_current_known && same_color && adds_only)
+        {
+            // Flags can be turned on one by one...
+            for(int i = 0; i < Style::flag_count; i++)
+            {
+                auto flag = static_cast<Style::Flag>(i);
+                if(target.style.is_enabled(flag) && !m_current.style.is_enabled(flag))
+                    codes.append(FormatCode::to_char(flag));
+            }
+            m_current.style = target.style;
+        }
+        else
+        {
+            // ...but only turned off by starting over.
+            if(target.color)
+                codes.append_color(*target.color);
+            else
+                codes.append(FormatCode::reset_char);
+            for(int i = 0; i < Style::flag_count; i++)
+            {
+                auto flag = static_cast<Style::Flag>(i);
+                if(target.style.is_enabled(flag))
+                    codes.append(FormatCode::to_char(flag));
+            }
+            m_current = target;
+            m_current_known = true;
+        }
+
+        // Written all at once, since sinks are free to not be buffered.
+        m_sink->write(codes.view());
+    }
+
+    bool LegacyRenderer::enter(const RenderNode& node)
+    {
+        if(m_sink->failed())
+            return false;
+
+        State state;
+        if(m_states.empty())
+        {
+            state.color = node.color;
+            state.style = node.style;
+        }
+        else
+        {
+            auto& parent = m_states.back();
+            state.color = node.color ? node.color : parent.color;
+            state.style = node.style.inherit(parent.style);
+        }
+
+        // A flag explicitly set to false is the same as one that isn't there.
+        state.style = state.style.enabled();
+        if(state.color && !state.color->is_named() && m_hex_colors == HexColors::Nearest)
+            state.color = nearest_named_color(*state.color);
+
+        if(!node.text.empty())
+        {
+            // Nothing is drawn for a space, unless it's underlined or struck through.
+            auto any_color = !state.style.is_enabled(Style::Flag::Underlined)
+                          && !state.style.is_enabled(Style::Flag::Strikethrough)
+                          && node.text.find_first_not_of(' ') == std::string_view::npos;
+            transition_to(state, any_color);
+            m_sink->write(node.text);
+            if(LegacyText::find_section_sign(node.text) != std::string_view::npos)
+                m_current_known = false;
+        }
+
+        m_states.push_back(state);
+        return true;
+    }
+
+    void LegacyRenderer::leave(const RenderNode&)
+    {
+        m_states.pop_back();
+    }
+}
@@ -0,0 +1,98 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include "RenderNode.h"
+#include "Sink.h"
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace LibSoprano
+{
+    class ArchivedMessage;
+    class ChatComponent;
+    class ChatTree;
+    class LanguageTable;
+
+    // Renders components as legacy text, formatted with § codes (see
+    // LegacyText.h). Like AnsiRenderer, it keeps track of the color and
+    // flags the text so far ends with, and only writes codes before a run of
+    // text that needs different ones. A color code turns every flag off, and
+    // so is the only way (besides §r) to turn one off, after which the flags
+    // that stay on are written again. Runs of spaces that nothing is drawn
+    // over keep whatever color came before them.
+    //
+    // Text with a § of its own is written as it is, as clients read codes in
+    // the text of components too; whatever it sets is undone before the next
+    // run.
+    class LegacyRenderer
+    {
+    public:
+        enum class HexColors : uint8_t
+        {
+            // As §x and a code for each hex digit, which clients since 1.16
+            // understand, through BungeeCord or Spigot.
+            Sequence,
+            // As the nearest named color, which every client understands.
+            Nearest
+        };
+
+        explicit LegacyRenderer(HexColors hex_colors = HexColors::Sequence) : m_hex_colors(hex_colors) {}
+
+        // Returns false if the sink failed, in which case rendering stopped
+        // at the component being written when it did.
+        bool render(const ChatComponent&, Sink&);
+        bool render(const ChatTree&, Sink&);
+        bool render(const ArchivedMessage&, Sink&);
+        // See AnsiRenderer::set_language.
+        void set_language(const LanguageTable* language) { m_language = language; }
+
+        bool enter(const RenderNode&);
+        void leave(const RenderNode&);
+
+        // See AnsiRenderer::begin. Nothing needs finishing.
+        void begin(Sink&);
+        void finish() {}
+        // See AnsiRenderer::same_state.
+        bool same_state(const LegacyRenderer& other) const
+        {
+            return m_current == other.m_current && m_current_known == other.m_current_known;
+        }
+
+    private:
+        // The color and flags a run of text is shown with, after inheritance.
+        // Every flag that isn't enabled is off.
+        struct State
+        {
+            std::optional<Color> color;
+            Style style;
+
+            bool operator==(const State&) const = default;
+        };
+
+        void transition_to(const State&, bool any_color);
+
+        HexColors m_hex_colors;
+        Sink* m_sink = nullptr;
+        const LanguageTable* m_language = nullptr;
+        // What the text written so far ends with, unless it had codes of its own.
+        State m_current;
+        bool m_current_known = true;
+        // The state of each component that we're inside of, innermost last.
+        std::vector<State> m_states;
+    };
+}
@@ -0,0 +1,238 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "LegacyText.h"
+#include "ChatComponentParser.h"
+#include "FormatCode.h"
+#include <algorithm>
+#include <bit>
+#include <optional>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SOPRANO_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define SOPRANO_NEON
+#endif
+
+namespace LibSoprano::LegacyText
+{
+    std::size_t find_section_sign(std::string_view text, std::size_t from)
+    {
+        auto data = reinterpret_cast<const unsigned char*>(text.data());
+        auto size = text.size();
+        auto i = from;
+
+        // Compares each block against both bytes of the §, the second one
+        // loaded a byte further on, so that a match is a whole §. Most text
+        // has no § at all, so four blocks are checked at once until one does.
+#if defined(SOPRANO_SSE2)
+        auto lead = _mm_set1_epi8(static_cast<char>(0xC2));
+        auto trail = _mm_set1_epi8(static_cast<char>(0xA7));
+        auto matches = [&](std::size_t at)
+        {
+            auto first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + at));
+            auto second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + at + 1));
+            return _mm_and_si128(_mm_cmpeq_epi8(first, lead), _mm_cmpeq_epi8(second, trail));
+        };
+
+        for(; i + 65 <= size; i += 64)
+        {
+            auto any = _mm_or_si128(_mm_or_si128(matches(i), matches(i + 16)), _mm_or_si128(matches(i + 32), matches(i + 48)));
+            if(_mm_movemask_epi8(any))
+                break;
+        }
+        for(; i + 17 <= size; i += 16)
+        {
+            auto mask = static_cast<unsigned>(_mm_movemask_epi8(matches(i)));
+            if(mask)
+                return i + std::countr_zero(mask);
+        }
+#elif defined(SOPRANO_NEON)
+        auto lead = vdupq_n_u8(0xC2);
+        auto trail = vdupq_n_u8(0xA7);
+        auto matches = [&](std::size_t at)
+        {
+            return vandq_u8(vceqq_u8(vld1q_u8(data + at), lead), vceqq_u8(vld1q_u8(data + at + 1), trail));
+        };
+
+        for(; i + 65 <= size; i += 64)
+        {
+            auto any = vorrq_u8(vorrq_u8(matches(i), matches(i + 16)), vorrq_u8(matches(i + 32), matches(i + 48)));
+            if(vmaxvq_u8(any))
+                break;
+        }
+        for(; i + 17 <= size; i += 16)
+        {
+            // Narrowed to four bits a byte, as NEON has no movemask.
+            auto nibbles = vshrn_n_u16(vreinterpretq_u16_u8(matches(i)), 4);
+            auto mask = vget_lane_u64(vreinterpret_u64_u8(nibbles), 0);
+            if(mask)
+                return i + std::countr_zero(mask) / 4;
+        }
+#endif
+
+        for(; i + 1 < size; i++)
+        {
+            if(data[i] == 0xC2 && data[i + 1] == 0xA7)
+                return i;
+        }
+        return std::string_view::npos;
+    }
+
+    namespace
+    {
+        int hex_digit(char c)
+        {
+            if(c >= '0' && c <= '9')
+                return c - '0';
+            if(c >= 'a' && c <= 'f')
+                return c - 'a' + 10;
+            if(c >= 'A' && c <= 'F')
+                return c - 'A' + 10;
+            return -1;
+        }
+
+        // The RGB color of a §x sequence, whose §x starts at the given offset.
+        std::optional<Color> read_hex_color(std::string_view text, std::size_t at)
+        {
+            constexpr std::size_t code_size = 3;
+            if(text.size() - at < code_size * 7)
+                return std::nullopt;
+
+            unsigned int rgb = 0;
+            for(std::size_t i = 1; i < 7; i++)
+            {
+                auto code = text.substr(at + i * code_size, code_size);
+                auto digit = hex_digit(code[2]);
+                if(code.substr(0, 2) != section_sign || digit < 0)
+                    return std::nullopt;
+                rgb = rgb << 4 | static_cast<unsigned int>(digit);
+            }
+            return Color(rgb);
+        }
+
+        // How many bytes the UTF-8 character starting with this byte takes.
+        std::size_t character_size(unsigned char lead)
+        {
+            if(lead >= 0xF0)
+                return 4;
+            if(lead >= 0xE0)
+                return 3;
+            if(lead >= 0xC0)
+                return 2;
+            return 1;
+        }
+    }
+
+    template<typename Builder>
+    ParseError read(Builder& builder, std::string_view text, const Limits& limits, bool borrow_text)
+    {
+        auto root = builder.begin_root();
+        std::size_t node_count = 1;
+        std::size_t text_bytes = 0;
+
+        std::optional<Color> color;
+        Style style;
+
+        // Gives the text from start to end to whatever the current style applies to.
+        auto add_run = [&](std::size_t start, std::size_t end) -> ParseError
+        {
+            if(start == end)
+                return {};
+
+            text_bytes += end - start;
+            if(text_bytes > limits.max_text_bytes)
+                return {ParseError::Code::TooMuchText, static_cast<uint32_t>(start)};
+
+            // Only text before any code at all is the root's.
+            auto run = text.substr(start, end - start);
+            if(start == 0)
+            {
+                builder.set_text(root, run, borrow_text);
+                return {};
+            }
+
+            if(++node_count > limits.max_nodes)
+                return {ParseError::Code::TooManyNodes, static_cast<uint32_t>(start)};
+
+            auto child = builder.begin_child(root);
+            builder.set_text(child, run, borrow_text);
+            if(color && !builder.set_color(child, color))
+                return {ParseError::Code::TooManyColors, static_cast<uint32_t>(start)};
+            for(int i = 0; i < Style::flag_count; i++)
+            {
+                auto flag = static_cast<Style::Flag>(i);
+                if(style.is_enabled(flag))
+                    builder.set_flag(child, flag, true);
+            }
+            builder.end(child);
+            return {};
+        };
+
+        std::size_t start = 0;
+        for(auto at = find_section_sign(text); at != std::string_view::npos; at = find_section_sign(text, start))
+        {
+            if(auto error = add_run(start, at))
+                return error;
+
+            auto code_at = at + section_sign.size();
+            if(code_at >= text.size())
+            {
+                start = text.size();
+                break;
+            }
+
+            auto code = FormatCode::from_char(text[code_at]);
+            start = code_at + character_size(static_cast<unsigned char>(text[code_at]));
+            switch(code.kind())
+            {
+                case FormatCode::Kind::Color:
+                    color = code.color();
+                    style = {};
+                    break;
+                case FormatCode::Kind::Style:
+                    style.set(code.flag(), true);
+                    break;
+                case FormatCode::Kind::Reset:
+                    color = std::nullopt;
+                    style = {};
+                    break;
+                case FormatCode::Kind::None:
+                    if(text[code_at] == 'x' || text[code_at] == 'X')
+                    {
+                        if(auto rgb = read_hex_color(text, at))
+                        {
+                            color = rgb;
+                            style = {};
+                            start = at + section_sign.size() * 7 + 7;
+                        }
+                    }
+                    break;
+            }
+        }
+
+        if(auto error = add_run(std::min(start, text.size()), text.size()))
+            return error;
+
+        builder.end(root);
+        return {};
+    }
+
+    template ParseError read(ChatComponentBuilder&, std::string_view, const Limits&, bool);
+    template ParseError read(ChatTreeBuilder&, std::string_view, const Limits&, bool);
+}
@@ -0,0 +1,45 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include "Limits.h"
+#include "ParseError.h"
+#include <cstddef>
+#include <string_view>
+
+namespace LibSoprano
+{
+    // Legacy text is formatted with § codes (see FormatCode.h) in UTF-8, as
+    // in "§6Gold §lbold gold". A color code resets the style flags, and §r
+    // resets everything. §x followed by six more codes, each a hex digit
+    // (§x§f§f§a§a§0§0), is an RGB color. A § followed by anything else, or
+    // nothing at all, is dropped along with what follows it.
+    namespace LegacyText
+    {
+        constexpr std::string_view section_sign = "\xC2\xA7";
+
+        // Where the next § is, from the given offset on, or npos. Scans 16
+        // bytes at a time on x86-64 and ARM64.
+        std::size_t find_section_sign(std::string_view text, std::size_t from = 0);
+
+        // Builds a component from legacy text with any Builder that
+        // ChatComponentParser takes (see ChatComponent::try_parse_legacy).
+        // Text before the first code is the root's, and every run of text
+        // after it is a child of the root with the color and flags in effect.
+        template<typename Builder>
+        ParseError read(Builder&, std::string_view text, const Limits&, bool borrow_text);
+    }
+}
@@ -0,0 +1,45 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+namespace LibSoprano
+{
+    // Bounds on how much work a single message may cause, so that a hostile
+    // one fails fast instead of stalling whoever is handling it. The defaults
+    // are far beyond anything the game itself sends.
+    struct Limits
+    {
+        // How deeply components may nest through "extra", counting the root.
+        uint32_t max_depth = 512;
+        // How many components there may be in total.
+        uint32_t max_nodes = 1 << 16;
+        // How many bytes of text there may be in total, once unescaped.
+        uint32_t max_text_bytes = 1 << 20;
+        // How many bytes rendering may produce. Renderers don't enforce this
+        // themselves, wrap the sink in a LimitedSink (see Sink.h).
+        std::size_t max_output_bytes = 1 << 24;
+
+        static constexpr Limits unlimited()
+        {
+            constexpr auto max = std::numeric_limits<uint32_t>::max();
+            return {max, max, max, std::numeric_limits<std::size_t>::max()};
+        }
+    };
+}
@@ -0,0 +1,130 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "MappedFile.h"
+#include <cerrno>
+#include <cstring>
+#include <utility>
+#include <fmt/format.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace LibSoprano
+{
+    Result<MappedFile, MappedFile::Error> MappedFile::open(const std::string& path)
+    {
+        MappedFile file;
+
+#ifdef _WIN32
+        auto handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL, nullptr);
+        if(handle == INVALID_HANDLE_VALUE)
+            return Err(fmt::format("Couldn't open {}: error {}", path, GetLastError()));
+
+        LARGE_INTEGER size;
+        if(!GetFileSizeEx(handle, &size))
+        {
+            auto error = GetLastError();
+            CloseHandle(handle);
+            return Err(fmt::format("Couldn't open {}: error {}", path, error));
+        }
+
+        // An empty file can't be mapped, but then there's nothing to map.
+        if(size.QuadPart > 0)
+        {
+            auto mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            auto view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+            auto error = GetLastError();
+            if(mapping)
+                CloseHandle(mapping);
+            if(!view)
+            {
+                CloseHandle(handle);
+                return Err(fmt::format("Couldn't map {}: error {}", path, error));
+            }
+
+            file.m_data = static_cast<const char*>(view);
+            file.m_size = static_cast<std::size_t>(size.QuadPart);
+        }
+
+        CloseHandle(handle);
+#else
+        auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if(fd == -1)
+            return Err(fmt::format("Couldn't open {}: {}", path, strerror(errno)));
+
+        struct stat info;
+        if(fstat(fd, &info) != 0)
+        {
+            auto error = errno;
+            close(fd);
+            return Err(fmt::format("Couldn't open {}: {}", path, strerror(error)));
+        }
+
+        // An empty file can't be mapped, but then there's nothing to map.
+        if(info.st_size > 0)
+        {
+            auto map = mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+            if(map == MAP_FAILED)
+            {
+                auto error = errno;
+                close(fd);
+                return Err(fmt::format("Couldn't map {}: {}", path, strerror(error)));
+            }
+
+            file.m_data = static_cast<const char*>(map);
+            file.m_size = static_cast<std::size_t>(info.st_size);
+        }
+
+        // The mapping keeps the file open.
+        close(fd);
+#endif
+
+        return Ok(std::move(file));
+    }
+
+    MappedFile::MappedFile(MappedFile&& other) noexcept
+        : m_data(std::exchange(other.m_data, nullptr)), m_size(std::exchange(other.m_size, 0))
+    {
+    }
+
+    MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+    {
+        std::swap(m_data, other.m_data);
+        std::swap(m_size, other.m_size);
+        return *this;
+    }
+
+    MappedFile::~MappedFile()
+    {
+        if(!m_data)
+            return;
+
+#ifdef _WIN32
+        UnmapViewOfFile(m_data);
+#else
+        munmap(const_cast<char*>(m_data), m_size);
+#endif
+    }
+}
@@ -0,0 +1,47 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include "result.h"
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace LibSoprano
+{
+    // A whole file mapped read-only into memory, so that it's read in by the
+    // OS as it's used, rather than all up front. The mapping starts on a page
+    // boundary, so it's suitably aligned for anything.
+    class MappedFile
+    {
+    public:
+        using Error = std::string;
+
+        static Result<MappedFile, Error> open(const std::string& path);
+
+        MappedFile(MappedFile&&) noexcept;
+        MappedFile& operator=(MappedFile&&) noexcept;
+        ~MappedFile();
+
+        std::string_view data() const { return {m_data, m_size}; }
+
+    private:
+        MappedFile() = default;
+
+        const char* m_data = nullptr;
+        std::size_t m_size = 0;
+    };
+}
@@ -0,0 +1,420 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "NbtReader.h"
+#include <bit>
+#include <charconv>
+
+namespace LibSoprano
+{
+    const char* NbtReader::error_string(Error error)
+    {
+        switch(error)
+        {
+            case Error::None:
+                return "No error";
+            case Error::UnexpectedEnd:
+                return "Unexpected end of input";
+            case Error::InvalidTag:
+                return "Invalid tag type";
+            case Error::InvalidLength:
+                return "Invalid length";
+            case Error::InvalidUtf8:
+                return "Invalid modified UTF-8";
+        }
+
+        return "Unknown error";
+    }
+
+    bool NbtReader::read_u8(uint8_t& value)
+    {
+        if(m_position >= m_input.size())
+            return fail(Error::UnexpectedEnd);
+        value = static_cast<uint8_t>(m_input[m_position++]);
+        return true;
+    }
+
+    bool NbtReader::read_u16(uint16_t& value)
+    {
+        if(m_input.size() - m_position < 2)
+            return fail(Error::UnexpectedEnd);
+        auto bytes = reinterpret_cast<const unsigned char*>(m_input.data() + m_position);
+        value = static_cast<uint16_t>(bytes[0] << 8 | bytes[1]);
+        m_position += 2;
+        return true;
+    }
+
+    bool NbtReader::read_i32(int32_t& value)
+    {
+        if(m_input.size() - m_position < 4)
+            return fail(Error::UnexpectedEnd);
+        auto bytes = reinterpret_cast<const unsigned char*>(m_input.data() + m_position);
+        value = static_cast<int32_t>(uint32_t(bytes[0]) << 24 | uint32_t(bytes[1]) << 16 | uint32_t(bytes[2]) << 8 | bytes[3]);
+        m_position += 4;
+        return true;
+    }
+
+    bool NbtReader::read_number(uint8_t type, std::string_view& number)
+    {
+        auto size = type == Short ? 2 : type == Int || type == Float ? 4 : 8;
+        if(m_input.size() - m_position < static_cast<std::size_t>(size))
+            return fail(Error::UnexpectedEnd);
+        auto bytes = reinterpret_cast<const unsigned char*>(m_input.data() + m_position);
+        uint64_t bits = 0;
+        for(int i = 0; i < size; i++)
+            bits = bits << 8 | bytes[i];
+        m_position += size;
+
+        auto begin = m_number;
+        auto end = m_number + sizeof(m_number);
+        std::to_chars_result result;
+        switch(type)
+        {
+            case Short:
+                result = std::to_chars(begin, end, static_cast<int16_t>(bits));
+                break;
+            case Int:
+                result = std::to_chars(begin, end, static_cast<int32_t>(bits));
+                break;
+            case Long:
+                result = std::to_chars(begin, end, static_cast<int64_t>(bits));
+                break;
+            case Float:
+                result = std::to_chars(begin, end, std::bit_cast<float>(static_cast<uint32_t>(bits)));
+                break;
+            default:
+                result = std::to_chars(begin, end, std::bit_cast<double>(bits));
+                break;
+        }
+        number = std::string_view(begin, result.ptr - begin);
+        return true;
+    }
+
+    bool NbtReader::read_list_header(uint8_t& type, uint32_t& count)
+    {
+        int32_t length;
+        if(!read_u8(type) || !read_i32(length))
+            return false;
+        if(type > LongArray || (type == End && length > 0))
+            return fail(Error::InvalidTag);
+        if(length < 0)
+            return fail(Error::InvalidLength);
+        // Every element takes at least a byte, which stops a bogus length
+        // from keeping anyone busy.
+        if(static_cast<uint32_t>(length) > m_input.size() - m_position)
+            return fail(Error::UnexpectedEnd);
+        count = static_cast<uint32_t>(length);
+        return true;
+    }
+
+    bool NbtReader::read_name(std::string_view& name)
+    {
+        uint16_t length;
+        if(!read_u16(length))
+            return false;
+        if(m_input.size() - m_position < length)
+            return fail(Error::UnexpectedEnd);
+        name = m_input.substr(m_position, length);
+        m_position += length;
+        return true;
+    }
+
+    bool NbtReader::read_string(std::string_view& string, bool& borrowed)
+    {
+        std::string_view bytes;
+        if(!read_name(bytes))
+            return false;
+
+        // Most text is plain ASCII, which reads the same either way.
+        std::size_t i = 0;
+        while(i < bytes.size() && static_cast<unsigned char>(bytes[i]) < 0x80)
+            i++;
+        if(i == bytes.size())
+        {
+            string = bytes;
+            borrowed = true;
+            return true;
+        }
+
+        auto byte = [&bytes](std::size_t at) -> unsigned
+        {
+            return at < bytes.size() ? static_cast<unsigned char>(bytes[at]) : 0;
+        };
+        auto continuation = [&byte](std::size_t at)
+        {
+            return (byte(at) & 0xC0) == 0x80;
+        };
+        auto invalid = [this, &bytes, &i]()
+        {
+            m_position = bytes.data() - m_input.data() + i;
+            return fail(Error::InvalidUtf8);
+        };
+
+        m_scratch.assign(bytes.data(), i);
+        auto changed = false;
+        while(i < bytes.size())
+        {
+            auto c = byte(i);
+            if(c < 0x80)
+            {
+                m_scratch += static_cast<char>(c);
+                i++;
+            }
+            else if(c == 0xC0 && byte(i + 1) == 0x80)
+            {
+                // Java's two byte NUL.
+                m_scratch += '\0';
+                changed = true;
+                i += 2;
+            }
+            else if(c >= 0xC2 && c <= 0xDF && continuation(i + 1))
+            {
+                m_scratch.append(bytes.data() + i, 2);
+                i += 2;
+            }
+            else if(c >= 0xE0 && c <= 0xEF && continuation(i + 1) && continuation(i + 2))
+            {
+                auto second = byte(i + 1);
+                if(c == 0xE0 && second < 0xA0)
+                    return invalid();
+
+                if(c != 0xED || second < 0xA0)
+                {
+                    m_scratch.append(bytes.data() + i, 3);
+                    i += 3;
+                    continue;
+                }
+
+                // Characters past the BMP are a pair of surrogates, each
+                // encoded on its own. A lone half becomes U+FFFD.
+                changed = true;
+                if(second <= 0xAF && byte(i + 3) == 0xED && byte(i + 4) >= 0xB0 && byte(i + 4) <= 0xBF
+                   && continuation(i + 5))
+                {
+                    uint32_t high = (second & 0x0F) << 6 | (byte(i + 2) & 0x3F);
+                    uint32_t low = (byte(i + 4) & 0x0F) << 6 | (byte(i + 5) & 0x3F);
+                    auto code_point = 0x10000 + (high << 10 | low);
+                    m_scratch += static_cast<char>(0xF0 | code_point >> 18);
+                    m_scratch += static_cast<char>(0x80 | (code_point >> 12 & 0x3F));
+                    m_scratch += static_cast<char>(0x80 | (code_point >> 6 & 0x3F));
+                    m_scratch += static_cast<char>(0x80 | (code_point & 0x3F));
+                    i += 6;
+                }
+                else
+                {
+                    m_scratch += "\xEF\xBF\xBD";
+                    i += 3;
+                }
+            }
+            else if(c >= 0xF0 && c <= 0xF4 && continuation(i + 1) && continuation(i + 2) && continuation(i + 3))
+            {
+                // Not what Java writes, but plain UTF-8 means the same thing.
+                auto second = byte(i + 1);
+                if((c == 0xF0 && second < 0x90) || (c == 0xF4 && second >= 0x90))
+                    return invalid();
+                m_scratch.append(bytes.data() + i, 4);
+                i += 4;
+            }
+            else
+            {
+                return invalid();
+            }
+        }
+
+        if(changed)
+        {
+            string = m_scratch;
+            borrowed = false;
+        }
+        else
+        {
+            string = bytes;
+            borrowed = true;
+        }
+        return true;
+    }
+
+    bool NbtReader::skip_bytes(uint64_t count)
+    {
+        if(m_input.size() - m_position < count)
+            return fail(Error::UnexpectedEnd);
+        m_position += count;
+        return true;
+    }
+
+    bool NbtReader::skip(uint8_t type)
+    {
+        // Lists left to skip, with compounds as lists of End.
+        m_skip_stack.clear();
+        for(;;)
+        {
+            switch(type)
+            {
+                case Byte:
+                    if(!skip_bytes(1))
+                        return false;
+                    break;
+                case Short:
+                    if(!skip_bytes(2))
+                        return false;
+                    break;
+                case Int:
+                case Float:
+                    if(!skip_bytes(4))
+                        return false;
+                    break;
+                case Long:
+                case Double:
+                    if(!skip_bytes(8))
+                        return false;
+                    break;
+                case ByteArray:
+                case IntArray:
+                case LongArray:
+                {
+                    int32_t length;
+                    if(!read_i32(length))
+                        return false;
+                    if(length < 0)
+                        return fail(Error::InvalidLength);
+                    auto size = type == ByteArray ? 1 : type == IntArray ? 4 : 8;
+                    if(!skip_bytes(uint64_t(length) * size))
+                        return false;
+                    break;
+                }
+                case String:
+                {
+                    uint16_t length;
+                    if(!read_u16(length) || !skip_bytes(length))
+                        return false;
+                    break;
+                }
+                case List:
+                {
+                    Range list;
+                    if(!read_list_header(list.type, list.count))
+                        return false;
+                    if(list.count > 0)
+                        m_skip_stack.push_back(list);
+                    break;
+                }
+                case Compound:
+                    m_skip_stack.push_back({End, 0});
+                    break;
+                default:
+                    return fail(Error::InvalidTag);
+            }
+
+            // Find the next payload to skip, if there's any left.
+            for(;;)
+            {
+                if(m_skip_stack.empty())
+                    return true;
+
+                auto& top = m_skip_stack.back();
+                if(top.type == End)
+                {
+                    std::string_view name;
+                    if(!read_u8(type))
+                        return false;
+                    if(type == End)
+                    {
+                        m_skip_stack.pop_back();
+                        continue;
+                    }
+                    if(!read_name(name))
+                        return false;
+                    break;
+                }
+
+                if(top.count == 0)
+                {
+                    m_skip_stack.pop_back();
+                    continue;
+                }
+
+                top.count--;
+                type = top.type;
+                break;
+            }
+        }
+    }
+
+    bool NbtReader::read_wrapper_end()
+    {
+        uint8_t type;
+        if(!read_u8(type))
+            return false;
+        if(type != End)
+            return fail(Error::InvalidTag);
+        return true;
+    }
+
+    bool NbtReader::close_wrappers(std::size_t from)
+    {
+        while(m_ranges.size() > from && m_ranges.back().type == End)
+        {
+            m_ranges.pop_back();
+            if(!read_wrapper_end())
+                return false;
+        }
+        return true;
+    }
+
+    bool NbtReader::drop_ranges(std::size_t from)
+    {
+        while(m_ranges.size() > from)
+        {
+            auto range = m_ranges.back();
+            m_ranges.pop_back();
+            if(range.type == End)
+            {
+                if(!read_wrapper_end())
+                    return false;
+                continue;
+            }
+
+            for(uint32_t i = 0; i < range.count; i++)
+            {
+                if(!skip(range.type))
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    bool NbtReader::read_wrapper(uint8_t& type)
+    {
+        // Only the first key is looked at: checking that nothing follows the
+        // payload would mean skipping it, which wrappers inside wrappers
+        // would each do again. Anything that does is an error once the
+        // payload's been read (see read_wrapper_end).
+        auto start = m_position;
+        uint8_t first;
+        uint16_t name_length;
+        if(!read_u8(first))
+            return false;
+        if(first == End || first > LongArray || !read_u16(name_length) || name_length != 0)
+        {
+            m_position = start;
+            m_error = Error::None;
+            return false;
+        }
+
+        type = first;
+        return true;
+    }
+}
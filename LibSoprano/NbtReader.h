@@ -0,0 +1,464 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace LibSoprano
+{
+    // Reads a chat component in network NBT (as the protocol has carried them
+    // since 1.20.3: a root tag without a name), straight from the buffer, and
+    // passes it on as the same events a JsonReader would (see JsonReader.h).
+    // Bytes are booleans, other numbers are numbers (with the shortest text
+    // that reads back the same), arrays are numbers without any text,
+    // compounds are objects and lists are arrays.
+    //
+    // Where a component is expected (the root, and the elements of "extra"
+    // and "with"), the other forms NBT has for one are turned into the
+    // object they stand for, so that a handler only ever deals with objects:
+    //  * a string is the component {"text": string}
+    //  * a non-empty list is its first component, with the rest appended
+    //    to the end of its "extra"
+    //  * a compound whose first key is empty is whatever that holds, as
+    //    elements of lists with mixed types are wrapped; it mustn't have any
+    //    other keys
+    //
+    // Strings are converted from Java's modified UTF-8, and borrowed from the
+    // input unless that changes them. Nesting never costs native stack.
+    class NbtReader
+    {
+    public:
+        enum class Error : uint8_t
+        {
+            None,
+            UnexpectedEnd,
+            InvalidTag,
+            InvalidLength,
+            InvalidUtf8
+        };
+
+        enum Tag : uint8_t
+        {
+            End,
+            Byte,
+            Short,
+            Int,
+            Long,
+            Float,
+            Double,
+            ByteArray,
+            String,
+            List,
+            Compound,
+            IntArray,
+            LongArray
+        };
+
+        static const char* error_string(Error);
+
+        explicit NbtReader(std::string_view input) : m_input(input) {}
+
+        // Reads a single tag, leaving anything after it alone; offset() is
+        // then how many bytes it took.
+        template<typename Handler>
+        bool parse(Handler&);
+
+        Error error() const { return m_error; }
+        std::size_t offset() const { return m_position; }
+        // Where the payload of the value being read starts.
+        std::size_t value_offset() const { return m_value_offset; }
+        // How many lists and wrappers standing for a component the value
+        // being read is inside of, which never reach the handler as
+        // containers of their own, but are nesting all the same.
+        std::size_t unwrapped_depth() const { return m_ranges.size(); }
+
+    private:
+        // Siblings to append to a component, which follow on from wherever
+        // the reader is once the component before them is read. A range of
+        // End is the end of a compound that only wraps a component, which
+        // comes between siblings in the same order as the ranges do.
+        struct Range
+        {
+            uint8_t type;
+            uint32_t count;
+        };
+
+        struct Frame
+        {
+            enum class Kind : uint8_t
+            {
+                Compound,
+                List,
+                // The "extra" of a component with siblings appended to it:
+                // its own extra (if it had any), then every range of siblings.
+                Siblings
+            };
+
+            Kind kind;
+            // The element type of a list, or of the range being read.
+            uint8_t type = End;
+            // Whether this is a component (for compounds), or holds them.
+            bool components = false;
+            // For a component's "extra" that waits until its siblings are known.
+            bool has_extra = false;
+            bool extra_invalid = false;
+            bool in_extra = false;
+            uint8_t extra_type = End;
+            uint32_t remaining = 0;
+            uint32_t extra_count = 0;
+            // Ranges from here up are the siblings appended to this component.
+            std::size_t appended = 0;
+            std::size_t extra_offset = 0;
+            // Where to carry on reading siblings after a component's own extra.
+            std::size_t resume = 0;
+        };
+
+        bool fail(Error error)
+        {
+            m_error = error;
+            return false;
+        }
+
+        bool read_u8(uint8_t&);
+        bool read_u16(uint16_t&);
+        bool read_i32(int32_t&);
+        // Reads a Short, Int, Long, Float or Double into m_number.
+        bool read_number(uint8_t type, std::string_view&);
+        bool read_list_header(uint8_t& type, uint32_t& count);
+        bool read_name(std::string_view&);
+        bool read_string(std::string_view&, bool& borrowed);
+        bool skip_bytes(uint64_t);
+        // Skips over a payload of the given type, and all that's inside it.
+        bool skip(uint8_t type);
+        // Reads the end of a compound that only wraps a component.
+        bool read_wrapper_end();
+        // Reads the ends of wrappers at the top of the ranges, down to the given one.
+        bool close_wrappers(std::size_t from);
+        // Skips every sibling from the given range up, which were never read.
+        bool drop_ranges(std::size_t from);
+        // Whether the compound starting here starts with an empty key, in
+        // which case that key's type is returned and the reader is left at
+        // its payload. Otherwise, the reader is left where it was.
+        bool read_wrapper(uint8_t& type);
+
+        template<typename Handler>
+        bool value(Handler&, uint8_t type, bool component);
+
+        std::string_view m_input;
+        std::size_t m_position = 0;
+        std::size_t m_value_offset = 0;
+        Error m_error = Error::None;
+        std::string m_scratch;
+        char m_number[32];
+        std::vector<Frame> m_frames;
+        std::vector<Range> m_ranges;
+        std::vector<Range> m_skip_stack;
+    };
+
+    // Starts reading a value, which containers carry on with from their frame.
+    template<typename Handler>
+    bool NbtReader::value(Handler& handler, uint8_t type, bool component)
+    {
+        if(!component)
+        {
+            switch(type)
+            {
+                case Byte:
+                {
+                    uint8_t byte;
+                    if(!read_u8(byte))
+                        return false;
+                    return handler.boolean(byte != 0);
+                }
+                case Short:
+                case Int:
+                case Long:
+                case Float:
+                case Double:
+                {
+                    std::string_view number;
+                    if(!read_number(type, number))
+                        return false;
+                    return handler.number(number);
+                }
+                case ByteArray:
+                case IntArray:
+                case LongArray:
+                    if(!skip(type))
+                        return false;
+                    return handler.number({});
+                case String:
+                {
+                    std::string_view string;
+                    bool borrowed;
+                    if(!read_string(string, borrowed))
+                        return false;
+                    return handler.string(string, borrowed);
+                }
+                case List:
+                {
+                    Frame frame{Frame::Kind::List};
+                    if(!read_list_header(frame.type, frame.remaining))
+                        return false;
+                    m_frames.push_back(frame);
+                    return handler.start_array();
+                }
+                case Compound:
+                    m_frames.push_back({Frame::Kind::Compound});
+                    return handler.start_object();
+                default:
+                    return fail(Error::InvalidTag);
+            }
+        }
+
+        // Ranges from here up are appended to this component.
+        auto appended = m_ranges.size();
+        for(;;)
+        {
+            if(type == List)
+            {
+                uint8_t element_type;
+                uint32_t count;
+                if(!read_list_header(element_type, count))
+                    return false;
+
+                if(count == 0)
+                {
+                    if(!handler.start_array() || !handler.end_array())
+                        return false;
+                    return drop_ranges(appended);
+                }
+
+                // The first element is the component, and the rest come after its extra.
+                m_ranges.push_back({element_type, count - 1});
+                m_value_offset = m_position;
+                type = element_type;
+                continue;
+            }
+
+            if(type == Compound)
+            {
+                uint8_t wrapped;
+                if(!read_wrapper(wrapped))
+                {
+                    if(m_error != Error::None)
+                        return false;
+
+                    Frame frame{Frame::Kind::Compound};
+                    frame.components = true;
+                    frame.appended = appended;
+                    m_frames.push_back(frame);
+                    return handler.start_object();
+                }
+
+                m_ranges.push_back({End, 1});
+                m_value_offset = m_position;
+                type = wrapped;
+                continue;
+            }
+
+            break;
+        }
+
+        if(type != String)
+        {
+            // Not a component at all, which the handler finds out about.
+            if(!value(handler, type, false))
+                return false;
+            return drop_ranges(appended);
+        }
+
+        std::string_view string;
+        bool borrowed;
+        if(!read_string(string, borrowed))
+            return false;
+        if(!handler.start_object() || !handler.key("text") || !handler.string(string, borrowed))
+            return false;
+
+        if(!close_wrappers(appended))
+            return false;
+        if(m_ranges.size() == appended)
+            return handler.end_object();
+
+        Frame frame{Frame::Kind::Siblings};
+        frame.appended = appended;
+        m_frames.push_back(frame);
+        return handler.key("extra") && handler.start_array();
+    }
+
+    template<typename Handler>
+    bool NbtReader::parse(Handler& handler)
+    {
+        m_value_offset = m_position;
+        uint8_t root_type;
+        if(!read_u8(root_type))
+            return false;
+
+        m_value_offset = m_position;
+        if(!value(handler, root_type, true))
+            return false;
+
+        while(!m_frames.empty())
+        {
+            // Copied, as reading a value might push another frame.
+            auto frame = m_frames.back();
+            switch(frame.kind)
+            {
+                case Frame::Kind::Compound:
+                {
+                    uint8_t type;
+                    if(!read_u8(type))
+                        return false;
+
+                    if(type == End)
+                    {
+                        m_frames.pop_back();
+                        if(frame.components && !close_wrappers(frame.appended))
+                            return false;
+                        if(!frame.components || (m_ranges.size() == frame.appended && !frame.has_extra))
+                        {
+                            if(!handler.end_object())
+                                return false;
+                            break;
+                        }
+
+                        // An "extra" that isn't a list is an error either way,
+                        // which siblings mustn't hide by replacing it.
+                        if(frame.extra_invalid)
+                        {
+                            if(!handler.end_object() || !drop_ranges(frame.appended))
+                                return false;
+                            break;
+                        }
+
+                        frame.kind = Frame::Kind::Siblings;
+                        if(frame.has_extra)
+                        {
+                            frame.in_extra = true;
+                            frame.resume = m_position;
+                            frame.type = frame.extra_type;
+                            frame.remaining = frame.extra_count;
+                            m_position = frame.extra_offset;
+                        }
+                        m_frames.push_back(frame);
+                        if(!handler.key("extra") || !handler.start_array())
+                            return false;
+                        break;
+                    }
+
+                    std::string_view name;
+                    if(!read_name(name))
+                        return false;
+                    m_value_offset = m_position;
+
+                    if(frame.components && name == "extra")
+                    {
+                        auto& current = m_frames.back();
+                        current.extra_invalid = type != List;
+                        if(type == List && m_ranges.size() > frame.appended)
+                        {
+                            // Left until the siblings can be read after it.
+                            current.has_extra = true;
+                            if(!read_list_header(current.extra_type, current.extra_count))
+                                return false;
+                            current.extra_offset = m_position;
+                            for(uint32_t i = 0; i < current.extra_count; i++)
+                            {
+                                if(!skip(current.extra_type))
+                                    return false;
+                            }
+                            break;
+                        }
+
+                    }
+
+                    // A translation's arguments are components too, and never have siblings appended.
+                    if(frame.components && type == List && (name == "extra" || name == "with"))
+                    {
+                        Frame list{Frame::Kind::List};
+                        list.components = true;
+                        if(!read_list_header(list.type, list.remaining))
+                            return false;
+                        m_frames.push_back(list);
+                        if(!handler.key(name) || !handler.start_array())
+                            return false;
+                        break;
+                    }
+
+                    if(!handler.key(name) || !value(handler, type, false))
+                        return false;
+                    break;
+                }
+                case Frame::Kind::List:
+                    if(frame.remaining == 0)
+                    {
+                        m_frames.pop_back();
+                        if(!handler.end_array())
+                            return false;
+                        break;
+                    }
+
+                    m_frames.back().remaining--;
+                    m_value_offset = m_position;
+                    if(!value(handler, frame.type, frame.components))
+                        return false;
+                    break;
+                case Frame::Kind::Siblings:
+                    if(frame.remaining > 0)
+                    {
+                        m_frames.back().remaining--;
+                        m_value_offset = m_position;
+                        if(!value(handler, frame.type, true))
+                            return false;
+                        break;
+                    }
+
+                    if(frame.in_extra)
+                    {
+                        m_frames.back().in_extra = false;
+                        m_position = frame.resume;
+                    }
+
+                    if(m_ranges.size() > frame.appended)
+                    {
+                        auto range = m_ranges.back();
+                        m_ranges.pop_back();
+                        if(range.type == End)
+                        {
+                            if(!read_wrapper_end())
+                                return false;
+                            break;
+                        }
+
+                        auto& current = m_frames.back();
+                        current.type = range.type;
+                        current.remaining = range.count;
+                        break;
+                    }
+
+                    m_frames.pop_back();
+                    if(!handler.end_array() || !handler.end_object())
+                        return false;
+                    break;
+            }
+        }
+
+        return true;
+    }
+}
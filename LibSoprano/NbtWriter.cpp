@@ -0,0 +1,308 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "NbtWriter.h"
+#include "ChatComponent.h"
+#include "ChatTree.h"
+#include "InlineStack.h"
+#include "NbtReader.h"
+
+namespace LibSoprano
+{
+    namespace
+    {
+        // Walks a ChatComponent's children, or a translation's arguments.
+        struct ComponentAdapter
+        {
+            using Node = const ChatComponent*;
+
+            static const std::vector<ChatComponent>& list(Node node, bool arguments)
+            {
+                return arguments ? node->arguments() : node->children();
+            }
+
+            Node first(Node node, bool arguments) const
+            {
+                if(arguments && node->type() != ChatComponent::Type::Translation)
+                    return nullptr;
+                auto& children = list(node, arguments);
+                return children.empty() ? nullptr : children.data();
+            }
+            Node next(Node parent, Node child, bool arguments) const
+            {
+                auto& children = list(parent, arguments);
+                auto next = child + 1;
+                return next == children.data() + children.size() ? nullptr : next;
+            }
+
+            bool is_translation(Node node) const { return node->type() == ChatComponent::Type::Translation; }
+            bool is_selector(Node node) const { return node->type() == ChatComponent::Type::Selector; }
+            const ChatComponent::Score* score(Node node) const { return node->score(); }
+            std::string_view text(Node node) const { return node->text(); }
+            const Color* color(Node node) const { return node->color() ? &*node->color() : nullptr; }
+            Style style(Node node) const { return node->style(); }
+        };
+
+        // Walks a ChatTree's children, which follow their parent. Trees never
+        // have translations, so nothing has arguments.
+        struct TreeAdapter
+        {
+            using Node = const ChatTree::Node*;
+
+            const ChatTree& tree;
+
+            Node first(Node node, bool arguments) const
+            {
+                auto index = static_cast<uint32_t>(node - tree.nodes().data());
+                return !arguments && node->end > index + 1 ? node + 1 : nullptr;
+            }
+            Node next(Node parent, Node child, bool) const
+            {
+                auto next = tree.nodes().data() + child->end;
+                return next < tree.nodes().data() + parent->end ? next : nullptr;
+            }
+
+            bool is_translation(Node) const { return false; }
+            bool is_selector(Node) const { return false; }
+            const ChatComponent::Score* score(Node) const { return nullptr; }
+            std::string_view text(Node node) const { return tree.text(*node); }
+            const Color* color(Node node) const { return tree.color(*node); }
+            Style style(Node node) const { return node->style; }
+        };
+
+        constexpr std::string_view s_flag_names[Style::flag_count] = {"bold", "italic", "underlined", "strikethrough",
+                                                                      "obfuscated"};
+
+        void write_tag(Sink& sink, uint8_t type, std::string_view name)
+        {
+            char header[3] = {static_cast<char>(type), static_cast<char>(name.size() >> 8), static_cast<char>(name.size())};
+            sink.write(std::string_view(header, sizeof(header)));
+            sink.write(name);
+        }
+    }
+
+    bool NbtWriter::write(const ChatComponent& component, Sink& sink)
+    {
+        return write_tree(ComponentAdapter(), &component, sink);
+    }
+
+    bool NbtWriter::write(const ChatTree& tree, Sink& sink)
+    {
+        if(tree.empty())
+            return !sink.failed();
+        return write_tree(TreeAdapter{tree}, &tree.root(), sink);
+    }
+
+    bool NbtWriter::write_string(Sink& sink, std::string_view string)
+    {
+        // NUL takes two bytes, and characters past the BMP take six (as two
+        // surrogates) instead of four. Everything else is as it is in UTF-8.
+        std::size_t extra = 0;
+        for(auto c : string)
+        {
+            auto byte = static_cast<unsigned char>(c);
+            if(byte == 0)
+                extra++;
+            else if(byte >= 0xF0)
+                extra += 2;
+        }
+
+        if(string.size() + extra > 0xFFFF)
+            return false;
+
+        if(extra > 0)
+        {
+            m_scratch.clear();
+            for(std::size_t i = 0; i < string.size(); i++)
+            {
+                auto byte = static_cast<unsigned char>(string[i]);
+                if(byte == 0)
+                {
+                    m_scratch += "\xC0\x80";
+                }
+                else if(byte >= 0xF0 && i + 3 < string.size())
+                {
+                    uint32_t code_point = (byte & 0x07) << 18 | (string[i + 1] & 0x3F) << 12
+                                        | (string[i + 2] & 0x3F) << 6 | (string[i + 3] & 0x3F);
+                    for(uint32_t surrogate : {0xD800 + ((code_point - 0x10000) >> 10), 0xDC00 + ((code_point - 0x10000) & 0x3FF)})
+                    {
+                        m_scratch += static_cast<char>(0xE0 | surrogate >> 12);
+                        m_scratch += static_cast<char>(0x80 | (surrogate >> 6 & 0x3F));
+                        m_scratch += static_cast<char>(0x80 | (surrogate & 0x3F));
+                    }
+                    i += 3;
+                }
+                else
+                {
+                    m_scratch += static_cast<char>(byte);
+                }
+            }
+            string = m_scratch;
+        }
+
+        char length[2] = {static_cast<char>(string.size() >> 8), static_cast<char>(string.size())};
+        sink.write(std::string_view(length, sizeof(length)));
+        sink.write(string);
+        return true;
+    }
+
+    template<typename Adapter>
+    bool NbtWriter::write_tree(const Adapter& adapter, typename Adapter::Node root, Sink& sink)
+    {
+        using Node = typename Adapter::Node;
+
+        auto is_plain = [&adapter](Node node)
+        {
+            return !adapter.is_translation(node) && !adapter.is_selector(node) && !adapter.score(node) && !adapter.color(node)
+                && adapter.style(node).bits() == 0 && !adapter.first(node, false);
+        };
+
+        if(is_plain(root))
+        {
+            sink.write(static_cast<char>(NbtReader::String));
+            return write_string(sink, adapter.text(root)) && !sink.failed();
+        }
+
+        struct Frame
+        {
+            Node node;
+            Node next_child;
+            // Whether the list being written is the arguments ("with"), and
+            // whether it's a list of strings.
+            bool arguments;
+            bool strings;
+        };
+
+        InlineStack<Frame> frames;
+        // Writes the start of a list of arguments or children, if there are
+        // any, and returns the first of them.
+        auto begin_list = [&](Frame& frame)
+        {
+            auto first = adapter.first(frame.node, frame.arguments);
+            frame.strings = true;
+            uint32_t count = 0;
+            for(auto child = first; child; child = adapter.next(frame.node, child, frame.arguments))
+            {
+                frame.strings &= is_plain(child);
+                count++;
+            }
+
+            if(count > 0)
+            {
+                write_tag(sink, NbtReader::List, frame.arguments ? "with" : "extra");
+                char header[5] = {static_cast<char>(frame.strings ? NbtReader::String : NbtReader::Compound),
+                                  static_cast<char>(count >> 24), static_cast<char>(count >> 16),
+                                  static_cast<char>(count >> 8), static_cast<char>(count)};
+                sink.write(std::string_view(header, sizeof(header)));
+            }
+            frame.next_child = first;
+        };
+
+        // Writes every key of a compound but "with" and "extra", then the start of "with".
+        auto begin = [&](Node node)
+        {
+            if(auto score = adapter.score(node))
+            {
+                write_tag(sink, NbtReader::Compound, "score");
+                write_tag(sink, NbtReader::String, "name");
+                if(!write_string(sink, score->name.view()))
+                    return false;
+                write_tag(sink, NbtReader::String, "objective");
+                if(!write_string(sink, score->objective.view()))
+                    return false;
+                if(!adapter.text(node).empty())
+                {
+                    write_tag(sink, NbtReader::String, "value");
+                    if(!write_string(sink, adapter.text(node)))
+                        return false;
+                }
+                sink.write(static_cast<char>(NbtReader::End));
+            }
+            else
+            {
+                auto key = adapter.is_translation(node) ? "translate" : adapter.is_selector(node) ? "selector" : "text";
+                write_tag(sink, NbtReader::String, key);
+                if(!write_string(sink, adapter.text(node)))
+                    return false;
+            }
+
+            if(auto color = adapter.color(node))
+            {
+                write_tag(sink, NbtReader::String, "color");
+                if(color->is_named())
+                {
+                    auto code = color->code();
+                    write_string(sink, Color::named_colors()[code <= '9' ? code - '0' : code - 'a' + 10].name);
+                }
+                else
+                {
+                    static constexpr char hex[] = "0123456789abcdef";
+                    char name[7] = {'#'};
+                    for(int i = 0; i < 6; i++)
+                        name[1 + i] = hex[(color->foreground() >> (20 - i * 4)) & 0xF];
+                    write_string(sink, std::string_view(name, sizeof(name)));
+                }
+            }
+
+            auto style = adapter.style(node);
+            for(int i = 0; i < Style::flag_count; i++)
+            {
+                if(auto value = style.get(static_cast<Style::Flag>(i)))
+                {
+                    write_tag(sink, NbtReader::Byte, s_flag_names[i]);
+                    sink.write(static_cast<char>(*value));
+                }
+            }
+
+            Frame frame{node, nullptr, true, false};
+            begin_list(frame);
+            frames.push(frame);
+            return true;
+        };
+
+        sink.write(static_cast<char>(NbtReader::Compound));
+        if(!begin(root))
+            return false;
+
+        while(!frames.empty())
+        {
+            if(sink.failed())
+                return false;
+
+            auto& frame = frames.top();
+            if(!frame.next_child)
+            {
+                if(frame.arguments)
+                {
+                    frame.arguments = false;
+                    begin_list(frame);
+                    continue;
+                }
+
+                sink.write(static_cast<char>(NbtReader::End));
+                frames.pop();
+                continue;
+            }
+
+            auto child = frame.next_child;
+            frame.next_child = adapter.next(frame.node, child, frame.arguments);
+            if(!(frame.strings ? write_string(sink, adapter.text(child)) : begin(child)))
+                return false;
+        }
+
+        return !sink.failed();
+    }
+}
@@ -0,0 +1,50 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include "Sink.h"
+#include <string>
+#include <string_view>
+
+namespace LibSoprano
+{
+    class ChatComponent;
+    class ChatTree;
+
+    // Writes components as network NBT, which NbtReader reads back. A
+    // component with nothing but text is written as just its string, and so
+    // is a list of children that are all like that; anything else is a
+    // compound, with the same keys in the same order as JsonWriter writes.
+    // Strings are written in Java's modified UTF-8.
+    class NbtWriter
+    {
+    public:
+        // Returns false if the sink failed, or some text is too long for an
+        // NBT string (65535 bytes, once encoded), either of which leaves the
+        // output cut short.
+        bool write(const ChatComponent&, Sink&);
+        bool write(const ChatTree&, Sink&);
+
+        // Writes the payload of a string tag: its length, then its bytes.
+        bool write_string(Sink&, std::string_view);
+
+    private:
+        template<typename Adapter>
+        bool write_tree(const Adapter&, typename Adapter::Node root, Sink&);
+
+        std::string m_scratch;
+    };
+}
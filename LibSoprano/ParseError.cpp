@@ -0,0 +1,239 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "ParseError.h"
+#include <fmt/format.h>
+#include <vector>
+
+namespace LibSoprano
+{
+    namespace
+    {
+        // Ignores every event, stopping at the first one it's told to.
+        struct IgnoringHandler
+        {
+            bool null() { return true; }
+            bool boolean(bool) { return true; }
+            bool number(std::string_view) { return true; }
+            bool string(std::string_view, bool) { return true; }
+            bool key(std::string_view) { return true; }
+            bool start_object() { return true; }
+            bool end_object() { return true; }
+            bool start_array() { return true; }
+            bool end_array() { return true; }
+        };
+
+        // Reads back the (unescaped) string value starting at offset.
+        std::string string_at(std::string_view input, uint32_t offset)
+        {
+            struct Handler : IgnoringHandler
+            {
+                bool string(std::string_view value, bool)
+                {
+                    string_value = value;
+                    return false;
+                }
+
+                std::string string_value;
+            } handler;
+
+            JsonReader reader(input.substr(offset));
+            reader.parse(handler);
+            return std::move(handler.string_value);
+        }
+
+        // Keeps track of the path to the value being read, stopping at the
+        // value that starts at the given offset.
+        class PathFinder
+        {
+        public:
+            PathFinder(const JsonReader& reader, std::size_t offset) : m_reader(reader), m_offset(offset) {}
+
+            bool null() { return begin_value(); }
+            bool boolean(bool) { return begin_value(); }
+            bool number(std::string_view) { return begin_value(); }
+            bool string(std::string_view, bool) { return begin_value(); }
+
+            bool key(std::string_view key)
+            {
+                m_segments.back().key = key;
+                return true;
+            }
+
+            bool start_object()
+            {
+                if(!begin_value())
+                    return false;
+                m_segments.push_back({});
+                return true;
+            }
+
+            bool start_array()
+            {
+                if(!begin_value())
+                    return false;
+                m_segments.push_back({{}, true});
+                return true;
+            }
+
+            bool end_object()
+            {
+                m_segments.pop_back();
+                return true;
+            }
+
+            bool end_array() { return end_object(); }
+
+            std::string path() const
+            {
+                std::string path = "$";
+                for(auto& segment : m_segments)
+                {
+                    if(segment.is_array)
+                    {
+                        if(segment.count > 0)
+                            fmt::format_to(std::back_inserter(path), "[{}]", segment.count - 1);
+                    }
+                    else if(is_identifier(segment.key))
+                    {
+                        path += '.';
+                        path += segment.key;
+                    }
+                    else if(!segment.key.empty())
+                    {
+                        path += "[\"";
+                        for(auto c : segment.key)
+                        {
+                            if(c == '"' || c == '\\')
+                                path += '\\';
+                            path += c;
+                        }
+                        path += "\"]";
+                    }
+                }
+                return path;
+            }
+
+        private:
+            struct Segment
+            {
+                std::string key;
+                bool is_array = false;
+                std::size_t count = 0;
+            };
+
+            static bool is_identifier(std::string_view key)
+            {
+                if(key.empty() || (key[0] >= '0' && key[0] <= '9'))
+                    return false;
+                for(auto c : key)
+                {
+                    if(!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_'))
+                        return false;
+                }
+                return true;
+            }
+
+            bool begin_value()
+            {
+                if(!m_segments.empty() && m_segments.back().is_array)
+                    m_segments.back().count++;
+                return m_reader.value_offset() != m_offset;
+            }
+
+            const JsonReader& m_reader;
+            std::size_t m_offset;
+            std::vector<Segment> m_segments;
+        };
+    }
+
+    std::string ParseError::message(std::string_view input) const
+    {
+        switch(m_code)
+        {
+            case Code::None:
+                return "No error";
+            case Code::Syntax:
+                return fmt::format("Syntax error at byte {}: {}", m_offset, JsonReader::error_string(syntax_error()));
+            case Code::NotAnObject:
+                return "Component must be an object";
+            case Code::IncompleteComponent:
+                return "Imcomplete or unsupported component";
+            case Code::NotABoolean:
+                return not_a_boolean_message(flag());
+            case Code::InvalidHexColor:
+            case Code::InvalidColorName:
+                return color_message(m_code, string_at(input, m_offset));
+            case Code::ExtraNotAnArray:
+                return "Property \"extra\" must be an array";
+            case Code::WithNotAnArray:
+                return "Property \"with\" must be an array";
+            case Code::ScoreNotAnObject:
+                return "Property \"score\" must be an object";
+            case Code::IncompleteScore:
+                return "A score needs a name and an objective, which must be strings";
+            case Code::TooDeep:
+                return "Components are nested too deeply";
+            case Code::TooManyNodes:
+                return "Too many components";
+            case Code::TooMuchText:
+                return "Too much text";
+            case Code::TooManyColors:
+                return "Too many different colors";
+            case Code::InvalidNbt:
+                return fmt::format("Invalid NBT at byte {}: {}", m_offset, NbtReader::error_string(nbt_error()));
+        }
+
+        return "Unknown error";
+    }
+
+    std::string ParseError::nbt_message(std::string_view input) const
+    {
+        if(m_code != Code::InvalidHexColor && m_code != Code::InvalidColorName)
+            return message(input);
+
+        // The offset is that of the color's string tag, which is its length and then its bytes.
+        std::string color;
+        if(m_offset + 2 <= input.size())
+        {
+            auto length = static_cast<unsigned char>(input[m_offset]) << 8 | static_cast<unsigned char>(input[m_offset + 1]);
+            color = input.substr(m_offset + 2, length);
+        }
+        return color_message(m_code, color);
+    }
+
+    std::string ParseError::path(std::string_view input) const
+    {
+        JsonReader reader(input);
+        // Syntax errors are found at the same place again, with the path as it was then.
+        PathFinder finder(reader, m_code == Code::Syntax ? std::string_view::npos : m_offset);
+        reader.parse(finder);
+        return finder.path();
+    }
+
+    std::string ParseError::color_message(Code code, std::string_view color)
+    {
+        if(code == Code::InvalidHexColor)
+            return fmt::format("Invalid \"color\" hexadecimal property ({})", color);
+        return fmt::format("Invalid \"color\" name property ({})", color);
+    }
+
+    std::string ParseError::not_a_boolean_message(Style::Flag flag)
+    {
+        static constexpr const char* names[Style::flag_count] = {"bold", "italic", "underlined", "strikethrough", "obfuscated"};
+        return fmt::format("Property \"{}\" must be a boolean", names[static_cast<uint8_t>(flag)]);
+    }
+}
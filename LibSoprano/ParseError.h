@@ -0,0 +1,103 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include "JsonReader.h"
+#include "NbtReader.h"
+#include "Style.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace LibSoprano
+{
+    // Why parsing a chat component failed, and where. This is small and
+    // trivially copyable, so rejecting input never allocates; the message and
+    // the JSON path of the error are only worked out on demand, from the input
+    // that was parsed.
+    class ParseError
+    {
+    public:
+        enum class Code : uint8_t
+        {
+            None,
+            // The input isn't valid JSON (see syntax_error()).
+            Syntax,
+            NotAnObject,
+            IncompleteComponent,
+            // A style flag isn't a boolean (see flag()).
+            NotABoolean,
+            InvalidHexColor,
+            InvalidColorName,
+            ExtraNotAnArray,
+            // One of the Limits was exceeded, at the value pointed to.
+            TooDeep,
+            TooManyNodes,
+            TooMuchText,
+            // The input isn't valid NBT (see nbt_error()).
+            InvalidNbt,
+            WithNotAnArray,
+            ScoreNotAnObject,
+            // A score is missing its name or objective, or has one that isn't
+            // a string, number or boolean (at the offending value).
+            IncompleteScore,
+            // More different colors than a ChatTree can hold, at the first
+            // one that didn't fit.
+            TooManyColors
+        };
+
+        constexpr ParseError() = default;
+        constexpr ParseError(Code code, uint32_t offset, uint8_t detail = 0)
+            : m_code(code), m_detail(detail), m_offset(offset) {}
+        static constexpr ParseError syntax(JsonReader::Error error, uint32_t offset)
+        {
+            return {Code::Syntax, offset, static_cast<uint8_t>(error)};
+        }
+        static constexpr ParseError nbt(NbtReader::Error error, uint32_t offset)
+        {
+            return {Code::InvalidNbt, offset, static_cast<uint8_t>(error)};
+        }
+
+        constexpr Code code() const { return m_code; }
+        // The byte offset of the offending value, or of where reading stopped
+        // for syntax errors.
+        constexpr uint32_t offset() const { return m_offset; }
+        constexpr JsonReader::Error syntax_error() const { return static_cast<JsonReader::Error>(m_detail); }
+        constexpr NbtReader::Error nbt_error() const { return static_cast<NbtReader::Error>(m_detail); }
+        constexpr Style::Flag flag() const { return static_cast<Style::Flag>(m_detail); }
+
+        constexpr explicit operator bool() const { return m_code != Code::None; }
+
+        // The same messages that ChatComponent::Error has always held. Color
+        // errors quote the color, which is read back out of the input.
+        std::string message(std::string_view input) const;
+        // The same, for errors in components read from NBT.
+        std::string nbt_message(std::string_view input) const;
+        // Where the error is in JSON input, as a JSONPath (like
+        // $.extra[2].color). For syntax errors, this is the last value that
+        // was read before it.
+        std::string path(std::string_view input) const;
+
+        // The message for a color error, given the offending color.
+        static std::string color_message(Code, std::string_view color);
+        static std::string not_a_boolean_message(Style::Flag);
+
+    private:
+        Code m_code = Code::None;
+        uint8_t m_detail = 0;
+        uint32_t m_offset = 0;
+    };
+}
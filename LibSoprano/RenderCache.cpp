@@ -0,0 +1,110 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "RenderCache.h"
+#include "Hash.h"
+
+namespace LibSoprano
+{
+    std::size_t RenderCache::entry_size(const Entry& entry)
+    {
+        // A list node, and an index node with its bucket.
+        constexpr std::size_t overhead = sizeof(Entry) + 4 * sizeof(void*) + sizeof(uint64_t) + sizeof(Iterator);
+        return overhead + entry.json.capacity() + entry.output.capacity();
+    }
+
+    RenderCache::Iterator RenderCache::lookup(uint64_t hash, std::string_view json, uint32_t options, uint64_t language)
+    {
+        auto [begin, end] = m_index.equal_range(hash);
+        for(auto it = begin; it != end; ++it)
+        {
+            auto& entry = *it->second;
+            if(entry.options == options && entry.language == language && entry.json == json)
+                return it->second;
+        }
+        return m_entries.end();
+    }
+
+    std::optional<std::string_view> RenderCache::find(std::string_view json, uint32_t options, uint64_t language)
+    {
+        auto entry = lookup(hash_bytes(json, options ^ language), json, options, language);
+        if(entry == m_entries.end())
+        {
+            m_stats.misses++;
+            return {};
+        }
+
+        m_stats.hits++;
+        m_entries.splice(m_entries.begin(), m_entries, entry);
+        return entry->output;
+    }
+
+    void RenderCache::insert(std::string_view json, uint32_t options, uint64_t language, std::string_view output)
+    {
+        auto entry_hash = hash_bytes(json, options ^ language);
+        auto existing = lookup(entry_hash, json, options, language);
+        if(existing != m_entries.end())
+        {
+            m_stats.bytes -= entry_size(*existing);
+            existing->output = output;
+            m_stats.bytes += entry_size(*existing);
+            m_entries.splice(m_entries.begin(), m_entries, existing);
+            evict(0);
+            return;
+        }
+
+        Entry entry{entry_hash, options, language, std::string(json), std::string(output)};
+        auto size = entry_size(entry);
+        if(size > m_max_bytes)
+            return;
+
+        evict(size);
+        m_entries.push_front(std::move(entry));
+        m_index.emplace(entry_hash, m_entries.begin());
+        m_stats.bytes += size;
+        m_stats.entries++;
+    }
+
+    void RenderCache::evict(std::size_t needed)
+    {
+        while(!m_entries.empty() && m_stats.bytes + needed > m_max_bytes)
+        {
+            auto& oldest = m_entries.back();
+            auto [begin, end] = m_index.equal_range(oldest.hash);
+            for(auto it = begin; it != end; ++it)
+            {
+                if(&*it->second == &oldest)
+                {
+                    m_index.erase(it);
+                    break;
+                }
+            }
+
+            m_stats.bytes -= entry_size(oldest);
+            m_stats.entries--;
+            m_stats.evictions++;
+            m_entries.pop_back();
+        }
+    }
+
+    void RenderCache::clear()
+    {
+        m_entries.clear();
+        m_index.clear();
+        m_stats.entries = 0;
+        m_stats.bytes = 0;
+    }
+}
@@ -0,0 +1,85 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace LibSoprano
+{
+    // Remembers what components rendered to, so that a message that's been
+    // seen before skips parsing and rendering entirely. Entries are keyed by
+    // the raw JSON, as it was received, along with a caller-defined number
+    // standing for the render options (format, color depth and so on), and the
+    // hash of the language table rendered with, or 0 for none. The
+    // least recently used entries are evicted to keep the total size of the
+    // cache under a limit in bytes.
+    //
+    // Not thread-safe; give each thread its own, or lock around it.
+    class RenderCache
+    {
+    public:
+        struct Stats
+        {
+            uint64_t hits = 0;
+            uint64_t misses = 0;
+            uint64_t evictions = 0;
+            std::size_t entries = 0;
+            std::size_t bytes = 0;
+        };
+
+        explicit RenderCache(std::size_t max_bytes) : m_max_bytes(max_bytes) {}
+
+        // The output cached for json rendered with options and language, which
+        // stays valid until the cache is next changed.
+        std::optional<std::string_view> find(std::string_view json, uint32_t options, uint64_t language);
+        // Caches output as what json renders to with options and language.
+        // Anything bigger than the whole cache is never kept.
+        void insert(std::string_view json, uint32_t options, uint64_t language, std::string_view output);
+        void clear();
+
+        const Stats& stats() const { return m_stats; }
+        std::size_t max_bytes() const { return m_max_bytes; }
+
+    private:
+        struct Entry
+        {
+            uint64_t hash;
+            uint32_t options;
+            uint64_t language;
+            std::string json;
+            std::string output;
+        };
+
+        using Iterator = std::list<Entry>::iterator;
+
+        // What an entry costs, counting the bookkeeping around it.
+        static std::size_t entry_size(const Entry&);
+        Iterator lookup(uint64_t hash, std::string_view json, uint32_t options, uint64_t language);
+        void evict(std::size_t needed);
+
+        std::size_t m_max_bytes;
+        // Most recently used first.
+        std::list<Entry> m_entries;
+        std::unordered_multimap<uint64_t, Iterator> m_index;
+        Stats m_stats;
+    };
+}
@@ -0,0 +1,55 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include "Color.h"
+#include "Style.h"
+#include <optional>
+#include <string_view>
+
+namespace LibSoprano
+{
+    // Whose score in which objective a score component shows.
+    struct ScoreSource
+    {
+        std::string_view name;
+        std::string_view objective;
+    };
+
+    // What a renderer gets to see of a component, whichever representation
+    // (ChatComponent or ChatTree) it comes from. Renderers are visitors with
+    // the following methods, called in document order:
+    //     bool enter(const RenderNode&); // Returning false stops the walk
+    //     void leave(const RenderNode&);
+    // Walks use an explicit stack, so nesting depth never costs native stack.
+    struct RenderNode
+    {
+        std::string_view text;
+        std::optional<Color> color;
+        Style style;
+        // Only ever set for visitors that keep translations as they are (see
+        // ChatComponent::walk): a translation's text is its key, and its
+        // arguments come before its children.
+        bool is_translation = false;
+        bool is_argument = false;
+        // Set for selector components, whose text is the selector, until
+        // they're resolved (see EntitySnapshot.h).
+        bool is_selector = false;
+        // Set for score components, whose text is the score they show (see
+        // Scoreboard.h). It only lives as long as the call to enter.
+        const ScoreSource* score = nullptr;
+    };
+}
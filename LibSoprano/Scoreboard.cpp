@@ -0,0 +1,221 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "Scoreboard.h"
+#include "ChatComponent.h"
+#include "Hash.h"
+#include "InlineStack.h"
+#include <charconv>
+#include <cstring>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#endif
+
+namespace LibSoprano
+{
+    namespace
+    {
+        void prefetch(const void* address)
+        {
+#if defined(__GNUC__) || defined(__clang__)
+            __builtin_prefetch(address);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+            _mm_prefetch(static_cast<const char*>(address), _MM_HINT_T0);
+#else
+            (void)address;
+#endif
+        }
+    }
+
+    uint64_t Scoreboard::hash(std::string_view holder, std::string_view objective)
+    {
+        // Names and objectives are short, and hashing them together is about
+        // half the work of hashing one and then the other.
+        char key[64];
+        if(holder.size() + objective.size() > sizeof(key))
+            return hash_bytes(objective, hash_bytes(holder));
+        memcpy(key, holder.data(), holder.size());
+        memcpy(key + holder.size(), objective.data(), objective.size());
+        return hash_bytes(std::string_view(key, holder.size() + objective.size()), holder.size());
+    }
+
+    std::size_t Scoreboard::probe(uint64_t hash, std::string_view holder, std::string_view objective) const
+    {
+        auto mask = m_slots.size() - 1;
+        auto tag = static_cast<uint32_t>(hash >> 32);
+        for(auto index = hash & mask;; index = (index + 1) & mask)
+        {
+            auto& slot = m_slots[index];
+            if(slot.key_offset == empty_slot)
+                return index;
+            if(slot.tag == tag && slot.holder_length == holder.size() && slot.objective_length == objective.size()
+               && memcmp(m_keys.data() + slot.key_offset, holder.data(), holder.size()) == 0
+               && memcmp(m_keys.data() + slot.key_offset + holder.size(), objective.data(), objective.size()) == 0)
+                return index;
+        }
+    }
+
+    bool Scoreboard::set(std::string_view holder, std::string_view objective, int32_t score)
+    {
+        if(holder.size() > UINT16_MAX || objective.size() > UINT16_MAX)
+            return false;
+
+        // Kept at most three quarters full, so that probes stay short.
+        if((m_size + 1) * 4 > m_slots.size() * 3)
+            grow();
+
+        auto key_hash = hash(holder, objective);
+        auto& slot = m_slots[probe(key_hash, holder, objective)];
+        if(slot.key_offset == empty_slot)
+        {
+            slot.tag = static_cast<uint32_t>(key_hash >> 32);
+            slot.key_offset = static_cast<uint32_t>(m_keys.size());
+            slot.holder_length = static_cast<uint16_t>(holder.size());
+            slot.objective_length = static_cast<uint16_t>(objective.size());
+            m_keys.append(holder);
+            m_keys.append(objective);
+            m_size++;
+        }
+        slot.score = score;
+        return true;
+    }
+
+    std::optional<int32_t> Scoreboard::find(std::string_view holder, std::string_view objective) const
+    {
+        if(m_size == 0)
+            return std::nullopt;
+
+        auto& slot = m_slots[probe(hash(holder, objective), holder, objective)];
+        if(slot.key_offset == empty_slot)
+            return std::nullopt;
+        return slot.score;
+    }
+
+    void Scoreboard::clear()
+    {
+        m_slots.clear();
+        m_keys.clear();
+        m_size = 0;
+    }
+
+    void Scoreboard::grow()
+    {
+        auto old_slots = std::move(m_slots);
+        m_slots.assign(old_slots.empty() ? 64 : old_slots.size() * 2, Slot{0, empty_slot, 0, 0, 0});
+
+        // Keys stay where they are in m_keys; only the slots move.
+        for(auto& old_slot : old_slots)
+        {
+            if(old_slot.key_offset == empty_slot)
+                continue;
+            auto key = std::string_view(m_keys).substr(old_slot.key_offset, old_slot.holder_length + old_slot.objective_length);
+            auto holder = key.substr(0, old_slot.holder_length);
+            auto objective = key.substr(old_slot.holder_length);
+            m_slots[probe(hash(holder, objective), holder, objective)] = old_slot;
+        }
+    }
+
+    std::size_t Scoreboard::resolve(std::span<ChatComponent> components) const
+    {
+        // Scores are looked up a batch at a time: every slot a batch starts
+        // probing from is asked for before any of them are looked at, then
+        // the keys of the ones that look like a match, so that the cache
+        // misses overlap rather than come one after another.
+        constexpr std::size_t batch_size = 16;
+        struct Lookup
+        {
+            ChatComponent* component;
+            uint64_t hash;
+        };
+
+        Lookup batch[batch_size];
+        std::size_t batch_count = 0;
+        std::size_t found = 0;
+
+        auto flush = [&]()
+        {
+            if(m_size > 0)
+            {
+                auto mask = m_slots.size() - 1;
+                for(std::size_t i = 0; i < batch_count; i++)
+                    prefetch(&m_slots[batch[i].hash & mask]);
+                for(std::size_t i = 0; i < batch_count; i++)
+                {
+                    auto& slot = m_slots[batch[i].hash & mask];
+                    if(slot.key_offset != empty_slot && slot.tag == static_cast<uint32_t>(batch[i].hash >> 32))
+                        prefetch(m_keys.data() + slot.key_offset);
+                }
+            }
+
+            for(std::size_t i = 0; i < batch_count; i++)
+            {
+                auto& component = *batch[i].component;
+                auto& score = *component.m_score;
+                const Slot* slot = nullptr;
+                if(m_size > 0)
+                    slot = &m_slots[probe(batch[i].hash, score.name.view(), score.objective.view())];
+
+                // Sidebars are resolved over and over, with most of their
+                // scores the same as last time, which don't need copying again.
+                if(slot && slot->key_offset != empty_slot)
+                {
+                    char digits[16];
+                    auto end = std::to_chars(digits, digits + sizeof(digits), slot->score).ptr;
+                    std::string_view shown(digits, end - digits);
+                    if(component.m_text.view() != shown)
+                        component.m_text = Text::owned(shown);
+                    found++;
+                }
+                else if(component.m_text.view() != score.value.view())
+                {
+                    component.m_text = score.value;
+                }
+            }
+            batch_count = 0;
+        };
+
+        // Children and arguments alike, without recursing.
+        InlineStack<ChatComponent*> pending;
+        for(auto& component : components)
+            pending.push(&component);
+        while(!pending.empty())
+        {
+            auto component = pending.top();
+            pending.pop();
+            for(auto& child : component->m_children)
+                pending.push(&child);
+            for(auto& argument : component->m_arguments)
+                pending.push(&argument);
+
+            if(component->m_type != ChatComponent::Type::Score)
+                continue;
+
+            auto& score = *component->m_score;
+            batch[batch_count++] = {component, hash(score.name.view(), score.objective.view())};
+            if(batch_count == batch_size)
+                flush();
+        }
+        flush();
+
+        return found;
+    }
+
+    std::size_t Scoreboard::resolve(ChatComponent& component) const
+    {
+        return resolve(std::span<ChatComponent>(&component, 1));
+    }
+}
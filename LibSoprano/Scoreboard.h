@@ -0,0 +1,86 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace LibSoprano
+{
+    class ChatComponent;
+
+    // A snapshot of a scoreboard, taken by whoever has one (a server, or a
+    // plugin), for resolving score components against: the score of each
+    // holder (a player's name, or an entity's UUID) in each of the
+    // objectives they have one in.
+    //
+    // Scores are kept in a single open-addressed table of 16 byte slots,
+    // four to a cache line, probed linearly from where the hash of the holder
+    // and objective lands. A slot holds part of the hash, so that keys are
+    // only compared when that matches, and where the key is in one buffer
+    // shared by all of them.
+    class Scoreboard
+    {
+    public:
+        // Sets a holder's score in an objective. Returns false if either is
+        // longer than 65535 bytes, which no game allows.
+        bool set(std::string_view holder, std::string_view objective, int32_t score);
+        std::optional<int32_t> find(std::string_view holder, std::string_view objective) const;
+
+        std::size_t size() const { return m_size; }
+        void clear();
+
+        // Sets what every score component in the components (and their
+        // children and arguments) shows: the score of its holder, or the
+        // "value" it was given if there isn't one (which is nothing, unless
+        // it came from an older version), like the server does before sending
+        // them. The holder is taken as it is, so "*" (whoever is reading it)
+        // needs a score of its own. Every score is looked up in one sweep,
+        // with the slots of the next few loaded while the current ones are
+        // compared. Returns how many had a score.
+        std::size_t resolve(std::span<ChatComponent> components) const;
+        std::size_t resolve(ChatComponent& component) const;
+
+    private:
+        struct Slot
+        {
+            // The upper half of the hash.
+            uint32_t tag;
+            // Where the holder is in m_keys, followed by the objective, or
+            // empty_slot if there's nothing here.
+            uint32_t key_offset;
+            uint16_t holder_length;
+            uint16_t objective_length;
+            int32_t score;
+        };
+
+        static constexpr uint32_t empty_slot = UINT32_MAX;
+
+        static uint64_t hash(std::string_view holder, std::string_view objective);
+        // The index of the slot with the key in it, or the empty slot it would go in.
+        std::size_t probe(uint64_t hash, std::string_view holder, std::string_view objective) const;
+        void grow();
+
+        std::vector<Slot> m_slots;
+        std::string m_keys;
+        std::size_t m_size = 0;
+    };
+}
@@ -0,0 +1,107 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <fmt/format.h>
+
+namespace LibSoprano
+{
+    // Where renderers write their output. Every byte is written exactly once,
+    // straight to its final destination. Once a sink has failed, renderers
+    // stop at the next component.
+    class Sink
+    {
+    public:
+        virtual ~Sink() = default;
+
+        virtual void write(std::string_view) = 0;
+        void write(char c) { write(std::string_view(&c, 1)); }
+
+        bool failed() const { return m_failed; }
+
+    protected:
+        bool m_failed = false;
+    };
+
+    class StringSink final : public Sink
+    {
+    public:
+        explicit StringSink(std::string& string) : m_string(string) {}
+
+        void write(std::string_view data) override { m_string.append(data); }
+        using Sink::write;
+
+    private:
+        std::string& m_string;
+    };
+
+    class BufferSink final : public Sink
+    {
+    public:
+        explicit BufferSink(fmt::memory_buffer& buffer) : m_buffer(buffer) {}
+
+        void write(std::string_view data) override { m_buffer.append(data.data(), data.data() + data.size()); }
+        using Sink::write;
+
+    private:
+        fmt::memory_buffer& m_buffer;
+    };
+
+    // Writes through stdio, which does its own buffering.
+    class FileSink final : public Sink
+    {
+    public:
+        explicit FileSink(FILE* file) : m_file(file) {}
+
+        void write(std::string_view data) override
+        {
+            if(fwrite(data.data(), 1, data.size(), m_file) != data.size())
+                m_failed = true;
+        }
+        using Sink::write;
+
+    private:
+        FILE* m_file;
+    };
+
+    // Passes writes on to another sink until a limit on the number of bytes
+    // is reached, at which point it fails and drops everything after.
+    class LimitedSink final : public Sink
+    {
+    public:
+        LimitedSink(Sink& sink, std::size_t limit) : m_sink(sink), m_remaining(limit) {}
+
+        void write(std::string_view data) override
+        {
+            if(m_failed || data.size() > m_remaining || m_sink.failed())
+            {
+                m_failed = true;
+                return;
+            }
+
+            m_remaining -= data.size();
+            m_sink.write(data);
+        }
+        using Sink::write;
+
+    private:
+        Sink& m_sink;
+        std::size_t m_remaining;
+    };
+}
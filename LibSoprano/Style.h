@@ -0,0 +1,101 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include <cstdint>
+#include <optional>
+
+namespace LibSoprano
+{
+    // The formatting flags of a component, packed into two bits each. A flag
+    // might not be present, in which case it inherits the parent's, or
+    // defaults to false.
+    class Style
+    {
+    public:
+        enum class Flag : uint8_t
+        {
+            Bold,
+            Italic,
+            Underlined,
+            Strikethrough,
+            Obfuscated
+        };
+
+        static constexpr int flag_count = 5;
+
+        constexpr std::optional<bool> get(Flag flag) const
+        {
+            auto bits = (m_bits >> shift(flag)) & 0b11;
+            if(!(bits & is_set_bit))
+                return {};
+            return (bits & value_bit) != 0;
+        }
+
+        constexpr void set(Flag flag, std::optional<bool> value)
+        {
+            m_bits &= ~(0b11 << shift(flag));
+            if(value)
+                m_bits |= (is_set_bit | (*value ? value_bit : 0)) << shift(flag);
+        }
+
+        constexpr bool is_set(Flag flag) const { return (m_bits >> shift(flag)) & is_set_bit; }
+        // Whether the flag is present and true, without any inheritance.
+        constexpr bool is_enabled(Flag flag) const { return ((m_bits >> shift(flag)) & 0b11) == (is_set_bit | value_bit); }
+
+        constexpr std::optional<bool> bold() const { return get(Flag::Bold); }
+        constexpr std::optional<bool> italic() const { return get(Flag::Italic); }
+        constexpr std::optional<bool> underlined() const { return get(Flag::Underlined); }
+        constexpr std::optional<bool> strikethrough() const { return get(Flag::Strikethrough); }
+        constexpr std::optional<bool> obfuscated() const { return get(Flag::Obfuscated); }
+
+        // Fills in every flag that isn't present from the parent.
+        constexpr Style inherit(Style parent) const
+        {
+            uint16_t set_mask = 0;
+            for(int i = 0; i < flag_count; i++)
+            {
+                if(m_bits & (is_set_bit << (i * 2)))
+                    set_mask |= 0b11 << (i * 2);
+            }
+
+            Style inherited;
+            inherited.m_bits = (m_bits & set_mask) | (parent.m_bits & ~set_mask);
+            return inherited;
+        }
+
+        // Only the flags that are present and true, so that two styles which
+        // look the same also compare equal.
+        constexpr Style enabled() const
+        {
+            uint16_t values = m_bits & (m_bits >> 1) & all_value_bits;
+            Style style;
+            style.m_bits = values | (values << 1);
+            return style;
+        }
+
+        constexpr uint16_t bits() const { return m_bits; }
+        constexpr bool operator==(const Style&) const = default;
+
+    private:
+        static constexpr uint16_t is_set_bit = 0b10;
+        static constexpr uint16_t value_bit = 0b01;
+        static constexpr uint16_t all_value_bits = 0b0101010101;
+        static constexpr int shift(Flag flag) { return static_cast<int>(flag) * 2; }
+
+        uint16_t m_bits = 0;
+    };
+}
@@ -0,0 +1,94 @@
+// Copyright James Puleo 2021
+// Copyright LibSoprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <utility>
+
+namespace LibSoprano
+{
+    // The text of a component. It either owns a heap copy of its characters,
+    // or borrows them from a buffer that the caller promises to keep alive
+    // (see ChatComponent::parse_borrowed), in which case it never allocates.
+    class Text
+    {
+    public:
+        Text() = default;
+
+        static Text owned(std::string_view text)
+        {
+            Text owned;
+            if(!text.empty())
+            {
+                auto data = new char[text.size()];
+                memcpy(data, text.data(), text.size());
+                owned.m_data = data;
+                owned.m_size = static_cast<uint32_t>(text.size());
+                owned.m_owned = true;
+            }
+            return owned;
+        }
+
+        static Text borrowed(std::string_view text)
+        {
+            Text borrowed;
+            borrowed.m_data = text.data();
+            borrowed.m_size = static_cast<uint32_t>(text.size());
+            return borrowed;
+        }
+
+        Text(const Text& other) : m_data(other.m_data), m_size(other.m_size)
+        {
+            if(other.m_owned)
+                *this = owned(other.view());
+        }
+
+        Text(Text&& other) noexcept { swap(other); }
+        ~Text() { clear(); }
+
+        Text& operator=(Text other) noexcept
+        {
+            swap(other);
+            return *this;
+        }
+
+        void clear()
+        {
+            if(m_owned)
+                delete[] m_data;
+            m_data = nullptr;
+            m_size = 0;
+            m_owned = false;
+        }
+
+        std::string_view view() const { return {m_data, m_size}; }
+        bool is_borrowed() const { return !m_owned && m_data; }
+
+    private:
+        void swap(Text& other) noexcept
+        {
+            std::swap(m_data, other.m_data);
+            std::swap(m_size, other.m_size);
+            std::swap(m_owned, other.m_owned);
+        }
+
+        const char* m_data = nullptr;
+        uint32_t m_size = 0;
+        bool m_owned = false;
+    };
+}
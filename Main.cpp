@@ -15,6 +15,7 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <LibSoprano/ChatComponent.h>
+#include <LibSoprano/ImGuiRenderer.h>
 #include <fstream>
 #include <sstream>
 #include <imgui/imgui.h>
@@ -42,12 +43,13 @@ static char s_json_buffer[1024 * 16] = R"({
         }
     ]
 })";
-static LibSoprano::ChatComponent::FontOptions s_font_options;
+static LibSoprano::ImGuiRenderer::FontOptions s_font_options;
 
 void parse_json()
 {
-    std::string json_str = s_json_buffer;
-    s_active_component = std::make_shared<ChatComponentResult>(LibSoprano::ChatComponent::parse(json_str));
+    // The component borrows its text from s_json_buffer, but we parse again
+    // every time the buffer is edited, so it can never go stale.
+    s_active_component = std::make_shared<ChatComponentResult>(LibSoprano::ChatComponent::parse_borrowed(s_json_buffer));
 }
 
 bool poll()
@@ -88,7 +90,7 @@ void draw()
         if(ImGui::BeginChild("Chat Component Text", ImVec2(0, 0), true))
         {
             if(s_active_component && s_active_component->isOk())
-                s_active_component->storage().get<LibSoprano::ChatComponent>().draw_imgui(&s_font_options);
+                LibSoprano::ImGuiRenderer(&s_font_options).render(s_active_component->storage().get<LibSoprano::ChatComponent>());
             else
             {
                 ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(1.0f, 0.0f, 0.0f, 1.0f));
@@ -114,15 +116,11 @@ void draw()
 
 int main(int argc, char** argv)
 {
-    // TOOD: Allow this to be invoked commandline-wise for HTML and ANSI output.
-
+    // Converting without the editor is up to soprano-cli, which doesn't link any of this.
     cxxopts::Options options(*argv, "Build and visualize Minecraft chat components");
     options.add_options()
-            ("a,ansi",      "Output the chat component with ANSI sequences and exit")
-            ("e,escansi",   "Output the chat component with ANSI escape sequences (C++) and exit")
-            ("h,html",      "Output the chat component as HTML and exit")
             ("help",        "Shows help and exits")
-            ("i,input",     "The JSON chat component", cxxopts::value<std::string>());
+            ("i,input",     "The JSON chat component to start editing", cxxopts::value<std::string>());
 
     options.positional_help("[chat component]").show_positional_help();
 
@@ -137,34 +135,18 @@ int main(int argc, char** argv)
         }
 
         if(res.count("input"))
-            strcpy_s(s_json_buffer, res["input"].as<std::string>().c_str());
-
-        if(strlen(s_json_buffer) > 0)
-            parse_json();
-
-        if((res.count("ansi") || res.count("escansi") || res.count("html")) && s_active_component->isErr())
-        {
-            fprintf(stderr, "%s\n", s_active_component->storage().get<std::string>().c_str());
-            return 2;
-        }
-
-        if(res.count("ansi"))
-        {
-            printf("%s\n", s_active_component->storage().get<LibSoprano::ChatComponent>().to_ansi_string().c_str());
-            return 0;
-        }
-
-        if(res.count("escansi"))
         {
-            printf("%s\n", s_active_component->storage().get<LibSoprano::ChatComponent>().to_ansi_string(true).c_str());
-            return 0;
+            auto& input = res["input"].as<std::string>();
+            if(input.size() >= sizeof(s_json_buffer))
+            {
+                fprintf(stderr, "The chat component must be under %zu bytes to edit it\n", sizeof(s_json_buffer));
+                return 1;
+            }
+            strcpy_s(s_json_buffer, input.c_str());
         }
 
-        if(res.count("html"))
-        {
-            printf("%s\n", s_active_component->storage().get<LibSoprano::ChatComponent>().to_html_string().c_str());
-            return 0;
-        }
+        if(strlen(s_json_buffer) > 0)
+            parse_json();
     }
     catch(const cxxopts::OptionException& e)
     {
@@ -0,0 +1,498 @@
+// Copyright James Puleo 2021
+// Copyright Soprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "Server.h"
+#include <LibSoprano/ChatComponent.h>
+#include <LibSoprano/Sink.h>
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <fmt/format.h>
+#include <thread>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// How much is read from a client at once.
+static constexpr std::size_t s_read_size = 64 * 1024;
+// Once this much output is waiting on a slow client, its requests are left
+// unread until it catches up.
+static constexpr std::size_t s_max_pending_output = 1024 * 1024;
+// Length-prefixed requests must start with a zero byte.
+static constexpr uint32_t s_max_request_size = 0xFFFFFF;
+
+static volatile sig_atomic_t s_stopping = false;
+
+static void stop(int)
+{
+    s_stopping = true;
+}
+
+RenderServer::RenderServer(std::size_t cache_bytes, const LibSoprano::Limits& limits)
+    : m_limits(limits), m_cache(cache_bytes)
+{
+    for(auto escape : {false, true})
+    {
+        for(auto depth : {LibSoprano::AnsiRenderer::ColorDepth::TrueColor, LibSoprano::AnsiRenderer::ColorDepth::Palette256,
+                          LibSoprano::AnsiRenderer::ColorDepth::Palette16})
+            m_ansi_renderers.emplace_back(escape, depth);
+    }
+}
+
+RenderServer::~RenderServer()
+{
+    while(!m_connections.empty())
+        close(*m_connections.begin()->second);
+
+    if(m_epoll != -1)
+        ::close(m_epoll);
+
+    if(m_listener != -1)
+    {
+        ::close(m_listener);
+        unlink(m_path.c_str());
+    }
+}
+
+bool RenderServer::listen(const std::string& path)
+{
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if(path.size() >= sizeof(address.sun_path))
+    {
+        fprintf(stderr, "The socket path %s is too long\n", path.c_str());
+        return false;
+    }
+    memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    m_listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(m_listener == -1)
+    {
+        perror("Couldn't create the socket");
+        return false;
+    }
+
+    // A socket left behind by a server that died would otherwise be in the way.
+    unlink(path.c_str());
+    if(bind(m_listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1)
+    {
+        fprintf(stderr, "Couldn't bind to %s: %s\n", path.c_str(), strerror(errno));
+        return false;
+    }
+    m_path = path;
+
+    if(::listen(m_listener, SOMAXCONN) == -1)
+    {
+        perror("Couldn't listen on the socket");
+        return false;
+    }
+
+    m_epoll = epoll_create1(EPOLL_CLOEXEC);
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.ptr = nullptr;
+    if(m_epoll == -1 || epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_listener, &event) == -1)
+    {
+        perror("Couldn't set up epoll");
+        return false;
+    }
+
+    return true;
+}
+
+void RenderServer::run()
+{
+    // Without SA_RESTART, a signal interrupts epoll_wait so that we notice it.
+    struct sigaction action = {};
+    action.sa_handler = stop;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    epoll_event events[64];
+    while(!s_stopping)
+    {
+        auto count = epoll_wait(m_epoll, events, std::size(events), -1);
+        if(count == -1)
+        {
+            if(errno == EINTR)
+                continue;
+            perror("epoll_wait failed");
+            return;
+        }
+
+        for(int i = 0; i < count; i++)
+        {
+            auto connection = static_cast<Connection*>(events[i].data.ptr);
+            if(!connection)
+            {
+                accept_all();
+                continue;
+            }
+
+            if(events[i].events & (EPOLLERR | EPOLLHUP))
+            {
+                close(*connection);
+                continue;
+            }
+
+            // Anything still waiting to go out goes first, which may let reading resume.
+            if((events[i].events & EPOLLOUT) && !flush(*connection))
+                continue;
+
+            if(events[i].events & EPOLLIN)
+                read(*connection);
+        }
+    }
+}
+
+void RenderServer::accept_all()
+{
+    while(true)
+    {
+        auto fd = accept4(m_listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd == -1)
+        {
+            if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                perror("Couldn't accept a client");
+            return;
+        }
+
+        auto connection = std::make_unique<Connection>();
+        connection->fd = fd;
+        connection->events = EPOLLIN;
+
+        epoll_event event = {};
+        event.events = connection->events;
+        event.data.ptr = connection.get();
+        if(epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &event) == -1)
+        {
+            perror("Couldn't watch a client");
+            ::close(fd);
+            continue;
+        }
+
+        m_connections.emplace(fd, std::move(connection));
+    }
+}
+
+void RenderServer::read(Connection& connection)
+{
+    auto size = connection.input.size();
+    connection.input.resize(size + s_read_size);
+    auto received = recv(connection.fd, connection.input.data() + size, s_read_size, 0);
+    connection.input.resize(size + std::max<ssize_t>(received, 0));
+
+    if(received == -1)
+    {
+        if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            close(connection);
+        return;
+    }
+
+    if(received == 0)
+        connection.finished = true;
+
+    handle_requests(connection);
+    flush(connection);
+}
+
+void RenderServer::handle_requests(Connection& connection)
+{
+    std::string_view input = connection.input;
+    std::size_t consumed = 0;
+
+    while(consumed < input.size() && connection.output.size() - connection.output_start < s_max_pending_output)
+    {
+        auto remaining = input.substr(consumed);
+        if(remaining[0] == '\0')
+        {
+            if(remaining.size() < 4)
+                break;
+
+            auto bytes = reinterpret_cast<const unsigned char*>(remaining.data());
+            uint32_t length = (bytes[0] << 24) | (bytes[1] << 16) | (bytes[2] << 8) | bytes[3];
+            if(remaining.size() < 4 + length)
+                break;
+
+            handle(remaining.substr(4, length), Framing::Length, connection.output);
+            consumed += 4 + length;
+            continue;
+        }
+
+        auto end = remaining.find('\n');
+        if(end == std::string_view::npos)
+        {
+            // Nobody's going to finish a line this long, so stop waiting for it.
+            if(remaining.size() > s_max_request_size)
+            {
+                respond("error Request is too large", Framing::Line, connection.output);
+                connection.finished = true;
+                consumed = input.size();
+            }
+            break;
+        }
+
+        auto request = remaining.substr(0, end);
+        if(!request.empty() && request.back() == '\r')
+            request.remove_suffix(1);
+        handle(request, Framing::Line, connection.output);
+        consumed += end + 1;
+    }
+
+    connection.input.erase(0, consumed);
+
+    // Whatever's left over after the client has finished can never be a whole request.
+    if(connection.finished)
+        connection.input.clear();
+}
+
+void RenderServer::handle(std::string_view request, Framing framing, std::string& output)
+{
+    using LibSoprano::AnsiRenderer;
+
+    if(request == "stats")
+    {
+        auto& stats = m_cache.stats();
+        m_scratch = fmt::format("ok hits={} misses={} evictions={} entries={} bytes={}", stats.hits, stats.misses,
+                                stats.evictions, stats.entries, stats.bytes);
+        respond(m_scratch, framing, output);
+        return;
+    }
+
+    auto space = request.find(' ');
+    auto format = request.substr(0, space);
+    auto json = space == std::string_view::npos ? std::string_view() : request.substr(space + 1);
+
+    auto depth = AnsiRenderer::ColorDepth::TrueColor;
+    auto named_colors = false;
+    auto colon = format.find(':');
+    if(colon != std::string_view::npos)
+    {
+        auto colors = format.substr(colon + 1);
+        format = format.substr(0, colon);
+        if(colors == "256")
+            depth = AnsiRenderer::ColorDepth::Palette256;
+        else if(colors == "16")
+            depth = AnsiRenderer::ColorDepth::Palette16;
+        else if(colors == "named")
+            named_colors = true;
+        else if(colors != "truecolor")
+            format = {};
+    }
+
+    m_scratch = "ok ";
+    LibSoprano::StringSink sink(m_scratch);
+    LibSoprano::LimitedSink limited(sink, m_limits.max_output_bytes);
+
+    // Which renderer to use, which also tells their output apart in the cache.
+    auto is_ansi = format == "ansi" || format == "escansi";
+    int renderer;
+    if(is_ansi)
+        renderer = (format == "escansi") * 3 + static_cast<int>(depth);
+    else if(format == "html")
+        renderer = 6;
+    else if(format == "json")
+        renderer = 7;
+    else if(format == "canonical")
+        renderer = 8;
+    else if(format == "legacy")
+        renderer = 9 + named_colors;
+    else
+        renderer = -1;
+
+    if(renderer == -1)
+    {
+        m_scratch = "error Unknown format";
+    }
+    else if(auto cached = m_cache.find(json, renderer, 0))
+    {
+        m_scratch.append(*cached);
+    }
+    else
+    {
+        // The request outlives the component, so the text can be borrowed.
+        auto result = LibSoprano::ChatComponent::try_parse(json, true, m_limits);
+        if(result.isErr())
+        {
+            m_scratch = "error " + result.storage().get<LibSoprano::ParseError>().message(json);
+        }
+        else
+        {
+            auto& component = result.storage().get<LibSoprano::ChatComponent>();
+            bool rendered;
+            if(is_ansi)
+                rendered = m_ansi_renderers[renderer].render(component, limited);
+            else if(renderer == 6)
+                rendered = m_html_renderer.render(component, limited);
+            else if(renderer >= 9)
+                rendered = (renderer == 9 ? m_legacy_renderer : m_named_legacy_renderer).render(component, limited);
+            else
+                rendered = (renderer == 7 ? m_json_writer : m_canonical_writer).render(component, limited);
+            if(rendered)
+                m_cache.insert(json, renderer, 0, std::string_view(m_scratch).substr(3));
+            else
+                m_scratch = "error Output is too large";
+        }
+    }
+
+    respond(m_scratch, framing, output);
+}
+
+void RenderServer::respond(std::string_view response, Framing framing, std::string& output)
+{
+    if(framing == Framing::Length)
+    {
+        auto length = static_cast<uint32_t>(response.size());
+        char header[4] = {static_cast<char>(length >> 24), static_cast<char>(length >> 16),
+                          static_cast<char>(length >> 8), static_cast<char>(length)};
+        output.append(header, sizeof(header));
+        output.append(response);
+        return;
+    }
+
+    for(auto c : response)
+    {
+        if(c == '\\')
+            output += "\\\\";
+        else if(c == '\n')
+            output += "\\n";
+        else if(c == '\r')
+            output += "\\r";
+        else
+            output += c;
+    }
+    output += '\n';
+}
+
+bool RenderServer::flush(Connection& connection)
+{
+    while(connection.output_start < connection.output.size())
+    {
+        auto sent = send(connection.fd, connection.output.data() + connection.output_start,
+                         connection.output.size() - connection.output_start, MSG_NOSIGNAL);
+        if(sent == -1)
+        {
+            if(errno == EINTR)
+                continue;
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            close(connection);
+            return false;
+        }
+        connection.output_start += sent;
+    }
+
+    if(connection.output_start == connection.output.size())
+    {
+        connection.output.clear();
+        connection.output_start = 0;
+
+        // Requests that were held back while the client caught up.
+        if(!connection.input.empty())
+        {
+            handle_requests(connection);
+            if(!connection.output.empty())
+                return flush(connection);
+        }
+    }
+
+    if(connection.finished && connection.output.empty() && connection.input.empty())
+    {
+        close(connection);
+        return false;
+    }
+
+    update_events(connection);
+    return true;
+}
+
+void RenderServer::update_events(Connection& connection)
+{
+    // Stop reading while a lot of output is waiting, and only wait to write when there's something to write.
+    auto pending = connection.output.size() - connection.output_start;
+    uint32_t events = 0;
+    if(!connection.finished && pending < s_max_pending_output)
+        events |= EPOLLIN;
+    if(pending > 0)
+        events |= EPOLLOUT;
+
+    if(events == connection.events)
+        return;
+
+    epoll_event event = {};
+    event.events = events;
+    event.data.ptr = &connection;
+    epoll_ctl(m_epoll, EPOLL_CTL_MOD, connection.fd, &event);
+    connection.events = events;
+}
+
+void RenderServer::close(Connection& connection)
+{
+    epoll_ctl(m_epoll, EPOLL_CTL_DEL, connection.fd, nullptr);
+    ::close(connection.fd);
+    m_connections.erase(connection.fd);
+}
+
+int run_client(const std::string& path)
+{
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if(path.size() >= sizeof(address.sun_path))
+    {
+        fprintf(stderr, "The socket path %s is too long\n", path.c_str());
+        return 3;
+    }
+    memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    auto fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd == -1 || connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1)
+    {
+        fprintf(stderr, "Couldn't connect to %s: %s\n", path.c_str(), strerror(errno));
+        return 3;
+    }
+
+    // Requests go out as fast as they're read, without waiting for responses.
+    std::thread sender([fd]()
+    {
+        char buffer[s_read_size];
+        ssize_t size;
+        while((size = ::read(STDIN_FILENO, buffer, sizeof(buffer))) > 0)
+        {
+            for(ssize_t sent = 0; sent < size;)
+            {
+                auto result = send(fd, buffer + sent, size - sent, MSG_NOSIGNAL);
+                if(result == -1)
+                    return;
+                sent += result;
+            }
+        }
+        shutdown(fd, SHUT_WR);
+    });
+
+    char buffer[s_read_size];
+    ssize_t size;
+    while((size = recv(fd, buffer, sizeof(buffer), 0)) > 0)
+        fwrite(buffer, 1, size, stdout);
+
+    sender.join();
+    ::close(fd);
+    return 0;
+}
@@ -0,0 +1,113 @@
+// Copyright James Puleo 2021
+// Copyright Soprano 2021
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include <LibSoprano/AnsiRenderer.h>
+#include <LibSoprano/HtmlRenderer.h>
+#include <LibSoprano/JsonWriter.h>
+#include <LibSoprano/LegacyRenderer.h>
+#include <LibSoprano/Limits.h>
+#include <LibSoprano/RenderCache.h>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Renders chat components for any number of clients over a Unix domain
+// socket, from a single thread with an epoll event loop. Renderers and
+// buffers live as long as the server, so requests never start cold.
+//
+// A request is a target format, a space, and the component's JSON:
+//     ansi {"text":"Hello"}
+// The format is ansi, escansi, html, json or canonical (the component
+// written back out, see JsonWriter.h), or legacy (§ codes, see
+// LegacyRenderer.h). The ANSI ones may be suffixed with the colors
+// available (ansi:256, ansi:16), and legacy:named writes hex colors as the
+// nearest named color. The response is either
+// "ok " and the output, or "error " and why. The request "stats" responds
+// with the render cache's counters instead.
+//
+// Requests are framed either by a line break, or by a 4 byte big-endian
+// length up front. A length-prefixed request starts with a zero byte (as
+// no request is 16 MB or more), which is how the two are told apart, so
+// they can be mixed freely. Each response is framed the same way as its
+// request; on a line, backslashes and line breaks in the output are
+// escaped as \\, \n and \r. Clients may send as many requests as they like
+// without waiting, and the responses come back in order.
+class RenderServer
+{
+public:
+    // Repeated requests are answered from a cache of up to cache_bytes.
+    explicit RenderServer(std::size_t cache_bytes, const LibSoprano::Limits& = {});
+    ~RenderServer();
+
+    // Creates the socket at path, replacing any stale one. Prints why and
+    // returns false if that's not possible.
+    bool listen(const std::string& path);
+    // Serves clients until interrupted by SIGINT or SIGTERM.
+    void run();
+
+private:
+    struct Connection
+    {
+        int fd = -1;
+        std::string input;
+        std::string output;
+        std::size_t output_start = 0;
+        // What we're waiting for from epoll.
+        uint32_t events = 0;
+        // The client has shut down its end, so close once everything is sent.
+        bool finished = false;
+    };
+
+    enum class Framing : uint8_t
+    {
+        Line,
+        Length
+    };
+
+    void accept_all();
+    void read(Connection&);
+    void handle_requests(Connection&);
+    void handle(std::string_view request, Framing, std::string& output);
+    static void respond(std::string_view response, Framing, std::string& output);
+    bool flush(Connection&);
+    void update_events(Connection&);
+    void close(Connection&);
+
+    LibSoprano::Limits m_limits;
+    int m_listener = -1;
+    int m_epoll = -1;
+    std::string m_path;
+    std::unordered_map<int, std::unique_ptr<Connection>> m_connections;
+
+    // One for every combination of escaping and color depth.
+    std::vector<LibSoprano::AnsiRenderer> m_ansi_renderers;
+    LibSoprano::HtmlRenderer m_html_renderer;
+    LibSoprano::JsonWriter m_json_writer{LibSoprano::JsonWriter::Mode::Minified};
+    LibSoprano::JsonWriter m_canonical_writer{LibSoprano::JsonWriter::Mode::Canonical};
+    LibSoprano::LegacyRenderer m_legacy_renderer;
+    LibSoprano::LegacyRenderer m_named_legacy_renderer{LibSoprano::LegacyRenderer::HexColors::Nearest};
+    LibSoprano::RenderCache m_cache;
+    std::string m_scratch;
+};
+
+// Sends stdin to the server listening at path, and writes whatever comes back
+// to stdout. It's all that's needed to try the server out by hand.
+int run_client(const std::string& path);
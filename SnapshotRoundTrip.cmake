@@ -0,0 +1,44 @@
+# Renders each component straight from its JSON, and again from a snapshot
+# of it, and fails unless both come out the same. Run by ctest, with CLI
+# (soprano-cli), FORMAT (its output option) and SNAPSHOT (a scratch file)
+# set.
+
+set(inputs
+    # Every style flag, on and then off again.
+    [=[{"text":"styled","bold":true,"italic":true,"underlined":true,"strikethrough":true,"obfuscated":true,"extra":[{"text":" plain","bold":false,"italic":false,"underlined":false,"strikethrough":false,"obfuscated":false}]}]=]
+    # Named and hex colors, inherited and overridden.
+    [=[{"text":"","color":"gold","extra":[{"text":"gold "},{"text":"red ","color":"red"},{"text":"hex ","color":"#12ab9F"},{"text":"black","color":"#000000"}]}]=]
+    # Extras nested in extras, with styles coming and going.
+    [=[{"text":"a","color":"aqua","bold":true,"extra":[{"text":"b","bold":false,"extra":[{"text":"c","italic":true,"extra":[{"text":"d","color":"#ff8800"}]},{"text":"e"}]},{"text":"f","underlined":true}]}]=]
+    # Text beyond ASCII, and text that HTML has to escape.
+    [=[{"text":"héllo wörld 😀 日本語 ","color":"light_purple","extra":[{"text":"<b>&amp;\"'</b>","underlined":true}]}]=]
+    # Empty text, on its own and around other components.
+    [=[{"text":""}]=]
+    [=[{"text":"","color":"red","bold":true,"extra":[{"text":""},{"text":"","extra":[{"text":"end"}]}]}]=]
+)
+
+foreach(input IN LISTS inputs)
+    execute_process(COMMAND ${CLI} ${FORMAT} ${input}
+                    OUTPUT_VARIABLE direct
+                    RESULT_VARIABLE result)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "Rendering ${input} failed (${result})")
+    endif()
+
+    execute_process(COMMAND ${CLI} --snapshot ${SNAPSHOT} ${input}
+                    RESULT_VARIABLE result)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "Saving a snapshot of ${input} failed (${result})")
+    endif()
+
+    execute_process(COMMAND ${CLI} ${FORMAT} --load-snapshot ${SNAPSHOT}
+                    OUTPUT_VARIABLE from_snapshot
+                    RESULT_VARIABLE result)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "Rendering the snapshot of ${input} failed (${result})")
+    endif()
+
+    if(NOT direct STREQUAL from_snapshot)
+        message(FATAL_ERROR "The snapshot of ${input} rendered differently:\n${from_snapshot}\ninstead of:\n${direct}")
+    endif()
+endforeach()